@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file adc.h
  * @brief ADC functionality for reading the (battery) voltage and internal temperature.
- * @version 2.1
+ * @version 2.5
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file cable.h
  * @brief Cable checking functionality.
- * @version 2.1
+ * @version 2.8
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -39,12 +39,35 @@
 
 
 /* Includes necessary for this header file */
+#include <stdint.h>    /* (u)intXX_t */
 #include <stdbool.h>   /* "bool", "true", "false" */
 #include "datatypes.h" /* Definitions of the custom data-types */
 
 
-/* Public prototype */
+/* Public definitions for the values send on the *cable broken* channel */
+#define CABLE_BROKEN   1
+#define CABLE_DEGRADED 2
+
+
+/** Public definition to select the cable checking method
+ *    @li `1` - Keep the loop powered and wake up on a rising edge of `BREAK_1` (interrupt-driven).
+ *              **Only negligible in sleep with `CABLE_EXTERNAL_PULLUP` set to `1`.**
+ *    @li `0` - Only check the loop once every measurement cycle (polling). */
+#define CABLE_MONITOR 0
+
+
+/** Public definition to select the pull-up resistor on `BREAK_1`
+ *    @li `1` - A high-value pull-up resistor has been fitted between `BREAK_1` and VDD, the internal one is disabled.
+ *    @li `0` - Use the internal pull-up resistor of the MCU.
+ *              **See the section "Cable monitoring" in `documentation.h` for the current this draws.** */
+#define CABLE_EXTERNAL_PULLUP 0
+
+
+/* Public prototypes */
 bool checkCable (MeasurementData_t data);
+uint8_t readCableLevel (void);
+void initCableMonitor (void);
+bool CABLE_confirmBreak (void);
 
 
 #endif /* _CABLE_H_ */
@@ -0,0 +1,71 @@
+/***************************************************************************//**
+ * @file config.h
+ * @brief Runtime settings which can be changed with a downlink.
+ * @version 1.1
+ * @author Brecht Van Eeckhoudt
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+/* Include guards prevent multiple inclusions of the same header */
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+
+/* Includes necessary for this header file */
+#include <stdint.h>    /* (u)intXX_t */
+#include <stdbool.h>   /* "bool", "true", "false" */
+#include "datatypes.h" /* Definitions of the custom data-types */
+
+
+/* Public definitions (default values, used until a downlink changes them) */
+/** Time between each wake-up in seconds (`60 - 65 535`, the maximum of the LFXO delay) */
+#define WAKE_UP_PERIOD_S        180 // On buoy: 1800 /* 600 = every 10 minutes */
+
+/** Amount of PIN interrupt wakeups (before a RTC wake-up) to be considered as a *storm* */
+#define STORM_INTERRUPTS        8
+
+/** The threshold value [g] for the accelerometer to detect and send an interrupt to wake-up the MCU */
+#define ADXL_THRESHOLD          7
+
+/** The ODR setting to configure the accelerometer with */
+#define ADXL_ODR                ADXL_ODR_12_5_HZ
+
+/** Amount of measurements gathered before they are sent (`1 - 6`, the size of the arrays in `MeasurementData_t`) */
+#define MEASUREMENTS_PER_UPLINK 6
+
+/** The LoRaWAN port on which the configuration downlinks are expected */
+#define CONFIG_DOWNLINK_PORT    2
+
+/** Values in the acknowledgment of a configuration downlink, otherwise it's the code of the rejected command */
+#define CONFIG_ACK_OK           0x00
+#define CONFIG_ACK_MALFORMED    0xFF
+
+
+/* Public prototypes */
+void initConfig (void);
+const Settings_t * CONFIG_get (void);
+void CONFIG_setLink (uint8_t dataRate, uint8_t txPower);
+uint8_t CONFIG_handleDownlink (uint8_t port, const uint8_t *data, uint8_t length);
+
+
+#endif /* _CONFIG_H_ */
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file datatypes.h
  * @brief Definitions of the custom data-types used.
- * @version 2.0
+ * @version 2.5
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -13,6 +13,12 @@
  *   @li v1.2: Added another `MCU_State_t` option.
  *   @li v1.3: Changed data types in `MeasurementData_t` struct.
  *   @li v2.0: Updated version number.
+ *   @li v2.1: Added cable loop levels to `MeasurementData_t`.
+ *   @li v2.2: Added `ErrorReport_t` struct data type.
+ *   @li v2.3: Added `CrashRecord_t` struct data type.
+ *   @li v2.1: Added cable loop level to `MeasurementData_t` struct.
+ *   @li v2.4: Added `Settings_t` struct data type.
+ *   @li v2.5: Added the output power to `Settings_t`.
  *
  * ******************************************************************************
  *
@@ -72,7 +78,52 @@ typedef struct
 	int32_t voltage[6];
 	int32_t intTemp[6];
 	int32_t extTemp[6];
+	uint8_t cableLevel[6];
 } MeasurementData_t;
 
 
+/** Struct type for one error number in an `ErrorReport_t` */
+typedef struct
+{
+	uint8_t number;
+	uint8_t count; /* Saturates at 255 */
+	uint8_t first; /* Measurement cycles ago (saturates at 255) */
+	uint8_t last;  /* Measurement cycles ago (saturates at 255) */
+} ErrorRecord_t;
+
+
+/** Struct type to send the accumulated errors */
+typedef struct
+{
+	uint8_t bitmap[16]; /* Bit `n` set = `error(n)` was called (numbers 0 - 127) */
+	uint8_t amount;     /* Amount of used places in `records` */
+	ErrorRecord_t records[8];
+} ErrorReport_t;
+
+
+/** Struct type for the information about the last crash (see `fault.c`) */
+typedef struct
+{
+	uint8_t type;   /* `FAULT_xxx` definition */
+	uint8_t state;  /* `MCU_State_t` value when it happened */
+	uint8_t number; /* Error number in the case of `FAULT_ERROR` */
+	uint32_t pc;    /* Stacked program counter (zero if not available) */
+	uint32_t lr;    /* Stacked link register (zero if not available) */
+	uint32_t xpsr;  /* Stacked program status register (zero if not available) */
+} CrashRecord_t;
+
+
+/** Struct type for the settings which can be changed with a downlink (see `config.c`) */
+typedef struct
+{
+	uint32_t wakeUpPeriod;   /* Time between each wake-up in seconds */
+	uint8_t stormInterrupts; /* Amount of accelerometer wake-ups to be considered as a *storm* */
+	uint8_t adxlThreshold;   /* Accelerometer activity threshold [g] */
+	uint8_t adxlODR;         /* `ADXL_ODR_t` value */
+	uint8_t measurements;    /* Amount of measurements per uplink */
+	uint8_t dataRate;        /* `LoRaDataRate_t` value after a (new) join */
+	uint8_t txPower;         /* RN2483 output power index (`1 = 14 dBm` - `5 = 2 dBm`) */
+} Settings_t;
+
+
 #endif /* _DATATYPES_H_ */
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file delay.h
  * @brief Delay functionality.
- * @version 3.2
+ * @version 4.7
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -39,28 +39,71 @@
 
 
 /* Includes necessary for this header file */
-#include <stdint.h> /* (u)intXX_t */
+#include <stdint.h>  /* (u)intXX_t */
+#include <stdbool.h> /* "bool", "true", "false" */
 
 
-/** Public definition to select which delay to use
- *    @li `1` - Use SysTick delays.
- *    @li `0` - Use EM2/3 RTC compare delays. */
-#define SYSTICKDELAY 0
-
-
-/** Public definition to select the use of the crystal or the oscillator
+/** Public definition to select the clock source of the RTC
  *    @li `0` - Use the low-frequency crystal oscillator (LFXO), EM2 sleep is used.
- *    @li `1` - Use the ultra low-frequency RC oscillator (ULFRCO), EM3 sleep is used but delays are less precise timing-wise.
+ *    @li `1` - Use the ultra low-frequency RC oscillator (ULFRCO, calibrated), EM3 sleep is used unless the LFXO is requested.
  *              ** EM3: All unwanted oscillators are disabled, they don't need to manually disabled before `EMU_EnterEM3`.**    */
 #define ULFRCO 1
 
 
+/** Public definition of a software timer (see `TIMER_start`), the fields are managed by `delay.c` */
+typedef struct timer
+{
+	uint32_t deadline;        /* Tick value when the timer expires */
+	uint32_t period;          /* Period in ticks, `0` for one-shot timers */
+	void (*callback)(void);   /* Method to call when the timer expires (can be `NULL`) */
+	volatile bool expired;    /* Set when the timer expires */
+	volatile bool running;    /* `true` while the timer is in the queue */
+	struct timer *next;       /* Next timer in the queue */
+} Timer_t;
+
+
+/** Enum type for the delay mechanisms (see `delayUs`) */
+typedef enum delay_modes
+{
+	DELAY_BUSY,  /* Busy wait in EM0 */
+	DELAY_EM1,   /* TIMER1 wake-up from EM1 */
+	DELAY_RTC,   /* RTC wake-up from EM2/3 */
+	DELAY_MODES  /* Amount of mechanisms */
+} DelayMode_t;
+
+
+/** Public definition of the statistics of a delay mechanism (see `DELAY_getStats`) */
+typedef struct delay_stats
+{
+	uint32_t calls;      /* Amount of delays */
+	uint64_t usTotal;    /* Total time spent (µs) */
+	uint64_t usLate;     /* Total measured overshoot (µs) */
+	uint32_t usLateMax;  /* Largest measured overshoot (µs) */
+} DelayStats_t;
+
+
 /* Public prototypes */
 void delay (uint32_t msDelay);
+void delayUs (uint32_t usDelay);
+void DELAY_getStats (DelayMode_t mode, DelayStats_t *stats);
+void DELAY_clearStats (void);
 void sleep (uint32_t sSleep);
-bool RTC_checkWakeup (void);
-void RTC_clearWakeup (void);
-uint32_t RTC_getPassedSleeptime (void);
+void sleepUntil (uint32_t deadline);
+bool waitForFlag (volatile bool *flag, uint32_t msTimeout, bool allowEM2);
+uint32_t RTC_secondsToTicks (uint32_t seconds);
+uint32_t RTC_getTicks (void);
+uint32_t RTC_getUptime (void);
+
+void LFXO_request (void);
+void LFXO_release (void);
+
+#if ULFRCO == 1 /* ULFRCO selected */
+void RTC_calibrate (int32_t temperature);
+#endif /* ULFRCO selected */
+
+void TIMER_start (Timer_t *timer, uint32_t msTime, bool periodic, void (*callback)(void));
+void TIMER_stop (Timer_t *timer);
+bool TIMER_isExpired (Timer_t *timer);
 
 
 #endif /* _DELAY_H_ */
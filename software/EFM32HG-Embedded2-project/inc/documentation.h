@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file documentation.h
  * @brief This file contains useful documentation about the project.
- * @version 3.1
+ * @version 3.12
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -31,10 +31,8 @@
  *   are disabled throughout the source code because they're all surrounded with
  *   `#if DEBUG_DBPRINT == 1 ... #endif` checks.
  *
- *   In the file `delay.h` one can **choose between SysTicks or RTC sleep functionality**
- *   for delays. This can be selected with the definition `#define SYSTICKDELAY`.
- *   If it's value is `0`, the RTC compare sleep functionality is used. if it's value
- *   is `1`, delays are generated using SysTicks.
+ *   Delays don't need a selection anymore: `delay` and `delayUs` choose between a busy wait,
+ *   an EM1 wait using TIMER1 and an EM2/3 wait using the RTC depending on the requested time.
  *
  *   In the file `delay.h` one can also **choose between the use of the ultra low-frequency
  *   RC oscillator (ULFRCO) or the low-frequency crystal oscillator (LFXO)** when being
@@ -55,6 +53,43 @@
  *   cloud using LoRaWAN. After this, the code execution will be resumed. The MCU doesn't
  *   get put in a `while(true)` loop.
  *
+ *   In the file `cable.h` one can **choose between interrupt-driven or polled cable checking**
+ *   with the definition `#define CABLE_MONITOR`. If it's value is `1`, the loop is kept
+ *   powered and a cable break wakes the MCU immediately. If it's value is `0`, the cable
+ *   only gets checked once every measurement cycle (default). The definition `#define CABLE_EXTERNAL_PULLUP`
+ *   selects if the internal pull-up resistor of the MCU or an externally fitted one is used,
+ *   the monitor should only be enabled together with an external high-value pull-up.
+ *
+ *   @note Check the section @ref CABLE "Cable monitoring" for more info about this.
+ *
+ *   In the file `lora_wrappers.h` one can **choose to keep the RN2483 joined between uplinks**
+ *   with the definition `#define LORA_PERSISTENT`. If it's value is `0`, the module gets
+ *   powered down after every uplink and is reset and joined again the next time (this
+ *   takes a few seconds and about fifteen commands). If it's value is `1`, the module stays
+ *   powered in `sys sleep` and only gets woken up by a break condition on the LEUART before
+ *   the `mac tx` command. A new join is only done if the module answers `not_joined` or
+ *   `frame_counter_err_rejoin_needed`, or if it didn't wake up.
+ *
+ *   In the file `pin_mapping.h` one can **choose the peripheral for the RN2483** with the
+ *   definition `#define RN2483_HF_USART`. If it's value is `0`, LEUART0 is used at 4800 baud
+ *   and the MCU can sleep in EM2 during the transfers. If it's value is `1`, USART1 is used
+ *   at 57600 baud: an uplink of about 110 characters then takes ~20 ms on the wire instead
+ *   of ~230 ms, but the MCU waits in EM1. This option needs the RN2483 wired to PD7/PD6
+ *   and `DEBUG_DBPRINT` disabled since dbprint also uses USART1.
+ *
+ *   The file `config.h` contains the **default wake-up period, storm detection amount,
+ *   accelerometer threshold/ODR and amount of measurements per uplink**. These (and the
+ *   data rate) can be changed afterwards with a downlink on port `CONFIG_DOWNLINK_PORT`,
+ *   the new values are kept in the user data page of the flash and acknowledged with an
+ *   uplink. The command set is described in `config.c`.
+ *
+ *   In the file `lora_settings.h` one can **choose who picks the data rate and output
+ *   power** with the definition `#define LINK_MANAGER`. If it's value is `0`, ADR is enabled
+ *   and the network chooses the data rate. If it's value is `1`, ADR is disabled and
+ *   `link.c` uses Link Check answers to choose the cheapest SF and output power which
+ *   still leave `LINK_TARGET_MARGIN_DB` of margin at the gateway. In both cases the choice
+ *   is kept in the user data page for the next join.
+ *
  * ******************************************************************************
  *
  * @section Initializations
@@ -111,6 +146,59 @@
  *
  * ******************************************************************************
  *
+ * @section CABLE Cable monitoring (cable.c)
+ *
+ *   The link breakage sensor is a wire loop between `BREAK_1` and `BREAK_2`.
+ *   `BREAK_2` is driven low and `BREAK_1` is pulled high, so `BREAK_1` reads
+ *   low while the loop is intact and rises when it breaks. When `CABLE_MONITOR`
+ *   is `1`, a rising-edge interrupt on `BREAK_1` wakes the MCU from EM2/EM3.
+ *   `BREAK_1` is then sampled a few times over about 20 ms (`delayUs`)
+ *   before the break is accepted, and the measurements are taken and send
+ *   immediately instead of at the next RTC wake-up.
+ *
+ *   The amount of cable-broken messages is rate limited in `cable.c`: at most
+ *   `ALARM_BURST` messages can be send back-to-back and one more is earned back
+ *   every `ALARM_REFILL_CYCLES` measurement cycles. After a confirmed break
+ *   the monitor interrupt is disabled until the cable reads intact again.
+ *
+ *   @warning There is no pull-up resistor on `BREAK_1` on the custom board. While the
+ *   loop is intact, the pull-up resistor sees the full supply voltage, so the
+ *   monitor draws a **continuous** current:
+ *     - Internal pull-up (about 40 kOhm): 3.3 V / 40 kOhm = **about 80 µA**, this
+ *       is a lot more than the EM3 sleep current of the MCU.
+ *     - External 1 MOhm pull-up (`CABLE_EXTERNAL_PULLUP = 1`): 3.3 V / 1 MOhm = **about 3.3 µA**.
+ *     - External 10 MOhm pull-up: about 0.33 µA, but the input becomes more sensitive to
+ *       leakage through the water.
+ *
+ *   When the loop is broken no current flows. With `CABLE_MONITOR = 0`, the pull-up
+ *   is only enabled for a few microseconds every measurement cycle, which is negligible.
+ *   **Only use the monitor with the internal pull-up if this extra current is acceptable.**
+ *
+ *   @subsection CABLELEVEL Cable loop level
+ *
+ *   Every measurement cycle `readCableLevel` also measures the voltage on `BREAK_1`
+ *   with the analog comparator (ACMP0). It is compared against the internal VDD
+ *   divider of the ACMP (64 steps) using a successive approximation, so the result
+ *   is a fraction of VDD between `0` (short) and `63` (open) and doesn't depend on
+ *   the battery voltage. The pull-up is the top of the divider, so near a healthy (low)
+ *   loop one step is roughly 650 Ohm of loop resistance with the internal pull-up (about
+ *   40 kOhm) and 16 kOhm with a 1 MOhm external pull-up. The ACMP and, when polling, the
+ *   loop are only powered for about 100 µs.
+ *
+ *   This resolution is too coarse to follow corrosion (a slow change of a few Ohm), the
+ *   level only shows a leak through the water (lower) or a nearly broken cable (higher).
+ *   It is send along with each measurement (channel `0x16`). The MCU also keeps a slowly
+ *   updated baseline: the first 8 results are averaged and afterwards it follows with a
+ *   weight of 1/256. If the level drifts 4 steps or more above the baseline, a *cable
+ *   broken* message with the value `2` (*degrading*) gets send once. This needs kOhms of
+ *   extra loop resistance, so it works as a second, less strict break detector.
+ *   Degrading results are kept out of the baseline.
+ *
+ *   @warning The internal pull-up resistor isn't a precision resistor and changes with
+ *   temperature, so only look at the *change* of the level and not at its absolute value.
+ *
+ * ******************************************************************************
+ *
  * @section CLOCKS1 Crystals and RC oscillators (delay.c)
  *
  *   Normally using an external oscillator/crystal uses less energy than the internal
@@ -130,6 +218,10 @@
  *   they chose to use the LFXO instead of the ULFRCO in sleep because the crystal was
  *   more stable for high baudrate communication using the LEUART peripheral.
  *
+ *   With the ULFRCO selected, the LFXO is now only started while LoRaWAN functionality
+ *   is enabled (`LFXO_request`/`LFXO_release`). The MCU then waits in EM2 instead of EM3
+ *   so the LEUART keeps its clock, the RTC keeps running on the (calibrated) ULFRCO.
+ *
  *   @note For low-power development it's advised to consistently enable peripherals and
  *   oscillators/clocks when needed and disable them afterwards. For some methods it can
  *   be useful to provide a boolean argument so that in the case of sending more bytes
@@ -158,15 +250,24 @@
  *
  *   At the start of this project it was the plan to also implement a *watchdog* timer
  *   to make sure the MCU wouldn't get stuck in some logic and waste unnecessary power.
- *   `RMU_ResetCauseGet` and `RMU_ResetCauseClear` also seemed interesting methods to use.
- *   However, because of the relatively short time this watchdog can handle (9 - 256 000 cycles,
- *   max 256 seconds) it would only be able to be active when the MCU was awake, and because
- *   implementing this would take extra time it was opted to just focus on writing
- *   code which couldn't get stuck anywhere.
- *
- *   This was done by carefully **making sure that the MCU couldn't get stuck in a WHILE
- *   loop anywhere**, by also **incrementing a counter and checking it's value against a
- *   *timeout* value**, defined at the top of each file.
+ *   Because of the relatively short time this watchdog can handle (9 - 256 000 cycles,
+ *   max 256 seconds) this was first postponed. It's now implemented in `fault.c`: the
+ *   watchdog runs on the ULFRCO (also in EM2/EM3) and gets fed on every pass through the
+ *   state machine. While delaying or sleeping, a periodic RTC timer wakes the MCU every
+ *   `WDOG_FEED_S` seconds to feed it, after which it immediately goes back to sleep.
+ *
+ *   The fault handlers (`HardFault_Handler`, ...) and `error` (if `ERROR_FORWARDING` is `0`)
+ *   don't stay in a `while(true)` loop anymore. They save a *crash record* (stacked PC/LR/xPSR,
+ *   the state and the error number) in RAM which isn't cleared on a reset, and reset the MCU.
+ *   After a watchdog reset a record is made using `RMU_ResetCauseGet`. The record gets
+ *   sent once along with the next status message (`LPP_CRASH_RECORD_CHANNEL`).
+ *
+ *   Getting stuck should still be avoided though. This was done by carefully **making sure that the MCU couldn't get stuck in a WHILE
+ *   loop anywhere**, by also **checking a *timeout* in milliseconds**, defined at the top of each file.
+ *   At first this was a counter which was incremented in the loop, but the real waiting time then
+ *   depended on the clock frequency and the compiler. Now `waitForFlag` (`delay.c`) sleeps (EM1 or EM2)
+ *   until an interrupt handler sets a flag or a RTC timer expires. Only the short waits on a bit
+ *   without an interrupt (`SYNCBUSY`, the DS18B20 *presence* pulse) are still busy loops.
  *
  *   @warning `While` loops can pose problems if for some reason the thing they are waiting
  *   for doesn't happen (for example a bit doesn't get set). Because of this it's necessary
@@ -208,6 +309,8 @@
  *   the RTCC (RTC calendar) to wake up the MCU every hour. This peripheral can
  *   run down to EM4H when using LFRCO, LFXO or ULFRCO. Unfortunately the Happy
  *   Gecko doesn't have this functionality so it can't be implemented in this case.
+ *   Long wake-up periods are instead made possible by counting the overflows of
+ *   the regular RTC (see `delay.c`), the MCU only wakes up shortly on each overflow.
  *
  * ******************************************************************************
  *
@@ -215,8 +318,9 @@
  *
  *   At one point a method was developed to go in EM1 when waiting in a delay.
  *   This however didn't seem to work as intended and EM2 would also be fine.
- *   Because of this, development for this EM1 delay method was halted.
- *   EM1 is sometimes used when waiting on bits to be set.
+ *   Because of this, development for this EM1 delay method was halted. It's now
+ *   used again, but only for delays which are too short for the RTC (TIMER1 wakes
+ *   the MCU). EM1 is sometimes used when waiting on bits to be set.
  *
  *   When the MCU is in EM1, the clock to the CPU is disabled. All peripherals,
  *   as well as RAM and flash, are available.
@@ -0,0 +1,65 @@
+/***************************************************************************//**
+ * @file fault.h
+ * @brief Watchdog and fault capture functionality.
+ * @version 1.1
+ * @author Brecht Van Eeckhoudt
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+/* Include guards prevent multiple inclusions of the same header */
+#ifndef _FAULT_H_
+#define _FAULT_H_
+
+
+/* Includes necessary for this header file */
+#include <stdint.h>    /* (u)intXX_t */
+#include <stdbool.h>   /* "bool", "true", "false" */
+#include "datatypes.h" /* Definitions of the custom data-types */
+
+
+/** Public definitions for the `type` field of `CrashRecord_t` */
+#define FAULT_HARDFAULT 1
+#define FAULT_NMI       2
+#define FAULT_SVC       3
+#define FAULT_PENDSV    4
+#define FAULT_WATCHDOG  5
+#define FAULT_LOCKUP    6
+#define FAULT_ERROR     7
+
+/** Watchdog timeout in seconds (256k ULFRCO cycles) */
+#define WDOG_TIMEOUT_S  256
+
+/** Interval in seconds to feed the watchdog while waiting on an RTC timer (see `delay.c`) */
+#define WDOG_FEED_S     64
+
+
+/* Public prototypes */
+void initWatchdog (void);
+void feedWatchdog (void);
+void FAULT_setState (MCU_State_t state);
+void FAULT_reset (uint8_t number);
+bool FAULT_getCrashRecord (CrashRecord_t *record);
+void FAULT_clearCrashRecord (void);
+
+
+#endif /* _FAULT_H_ */
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file interrupt.h
  * @brief Interrupt functionality.
- * @version 3.1
+ * @version 3.6
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -43,10 +43,31 @@
 #include <stdbool.h> /* "bool", "true", "false" */
 
 
+/** Enum type for the source of an event */
+typedef enum event_sources
+{
+	EVENT_PB0,   /* Button PB0 pushed */
+	EVENT_PB1,   /* Button PB1 pushed */
+	EVENT_ADXL,  /* Accelerometer interrupt on INT1 */
+	EVENT_CABLE, /* Cable monitor interrupt on BREAK_1 */
+	EVENT_RTC,   /* RTC wake-up after sleeping (payload: the deadline in ticks) */
+	EVENT_ADC    /* ADC conversion completed (payload: the raw sample) */
+} Event_Source_t;
+
+/** Struct type for an event added to the ring by an interrupt handler */
+typedef struct
+{
+	Event_Source_t source;
+	uint32_t tick;    /* RTC counter value when the interrupt handler ran */
+	uint32_t payload; /* Extra data, depends on the source */
+} Event_t;
+
+
 /* Public prototypes */
 void initGPIOwakeup (void);
-bool BTN_getTriggered (uint8_t number);
-void BTN_setTriggered (uint8_t number, bool value);
+void EVENT_push (Event_Source_t source, uint32_t payload);
+bool EVENT_get (Event_t *event);
+uint16_t EVENT_getCount (void);
 
 
 #endif /* _INTERRUPT_H_ */
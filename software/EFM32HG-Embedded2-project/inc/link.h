@@ -0,0 +1,59 @@
+/***************************************************************************//**
+ * @file link.h
+ * @brief Choose the data rate and output power from the LoRaWAN link margin.
+ * @version 1.0
+ * @author Brecht Van Eeckhoudt
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+/* Include guards prevent multiple inclusions of the same header */
+#ifndef _LINK_H_
+#define _LINK_H_
+
+
+/* Includes necessary for this header file */
+#include <stdint.h>  /* (u)intXX_t */
+#include <stdbool.h> /* "bool", "true", "false" */
+#include "lora.h"    /* LoRaSettings_t */
+
+
+/* Public definitions */
+/** Wanted average link margin [dB], with Rayleigh fading an uplink arrives with a chance of `exp(-10^(-margin/10))`: 13 dB = 95 % */
+#define LINK_TARGET_MARGIN_DB 13
+
+/** Extra margin [dB] needed before a cheaper setting is used, prevents toggling between two settings */
+#define LINK_HYSTERESIS_DB    3
+
+/** Amount of uplinks between two Link Check requests */
+#define LINK_CHECK_UPLINKS    12
+
+/** Amount of uplinks with a request but without an answer before a more robust setting is used */
+#define LINK_LOST_UPLINKS     6
+
+
+/* Public prototypes */
+void LINK_configure (LoRaSettings_t *settings);
+void LINK_update (void);
+
+
+#endif /* _LINK_H_ */
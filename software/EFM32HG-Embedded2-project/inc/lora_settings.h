@@ -47,6 +47,18 @@
  */
 #define DEFAULT_DATA_RATE           SF10_BW125
 
+/*
+ * SET default output power (pwridx)
+ * 1 = 14 dBm, 2 = 11 dBm, 3 = 8 dBm, 4 = 5 dBm, 5 = 2 dBm
+ */
+#define DEFAULT_TX_POWER            1
+
+/* LINK_MANAGER:
+ * 	- set to 1 to let link.c choose the data rate and output power from Link Check answers (ADR off)
+ * 	- set to 0 to let the network choose the data rate (ADR on)
+ */
+#define LINK_MANAGER                1
+
 
 #if OVER_THE_AIR_ACTIVATION == 1
 // Copy your settings here
@@ -93,6 +105,9 @@
 	"",                                 /* Device address */        \
 	"",                                 /* Network session key*/    \
 	"",                                 /* App session key*/        \
+	DEFAULT_TX_POWER,                   /* Output power */          \
+	(LINK_MANAGER == 0),                /* ADR */                   \
+	0,                                  /* Link Check interval */   \
 }
 #else
 #define LORA_INIT_MY_DEVICE                                         \
@@ -104,6 +119,9 @@
 	LORAWAN_DEVICE_ADDRESS,             /* Device address */        \
 	LORAWAN_NWKSKEY,                    /* Network session key*/    \
 	LORAWAN_APPSKEY,                    /* App session key*/        \
+	DEFAULT_TX_POWER,                   /* Output power */          \
+	(LINK_MANAGER == 0),                /* ADR */                   \
+	0,                                  /* Link Check interval */   \
 }
 #endif
 
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file lora_wrappers.h
  * @brief LoRa wrapper methods
- * @version 2.4
+ * @version 2.9
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -44,6 +44,24 @@
 #include "datatypes.h" /* Definitions of the custom data-types */
 
 
+/** Public definition to select what happens with the RN2483 between uplinks.
+ *    @li `0` - `disableLoRaWAN` cuts the power, `initLoRaWAN` resets the module and joins again each time.
+ *    @li `1` - `disableLoRaWAN` puts the joined module in `sys sleep`, `initLoRaWAN` wakes it with a break condition and
+ *              the session is used right away. A new join only happens if the module lost its session (or didn't wake up). */
+#define LORA_PERSISTENT 1
+
+/** Public definitions for the order in which pending messages are packed into uplinks (lowest value first).
+ *  The messages of one LoRaWAN session are only sent in `disableLoRaWAN` (or when too many are pending),
+ *  messages which don't fit in the first uplink anymore are sent in the next one. */
+#define PRIORITY_CABLE        0
+#define PRIORITY_STORM        1
+#define PRIORITY_STATUS       2
+#define PRIORITY_CONFIG_ACK   3
+#define PRIORITY_MEASUREMENTS 4
+#define PRIORITY_ERRORS       5
+#define PRIORITY_TEST         6
+
+
 /* Public prototypes */
 void initLoRaWAN (void);
 void disableLoRaWAN (void);
@@ -53,8 +71,9 @@ void wakeLoRaWAN (void);
 
 void sendMeasurements (MeasurementData_t data);
 void sendStormDetected (bool stormDetected);
-void sendCableBroken (bool cableBroken);
+void sendCableBroken (uint8_t cableBroken);
 void sendStatus (uint8_t status);
+void sendErrorReport (ErrorReport_t report);
 
 void sendTest (MeasurementData_t data);
 
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file pin_mapping.h
  * @brief The pin definitions for the regular and custom Happy Gecko board.
- * @version 2.0
+ * @version 2.2
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -14,6 +14,8 @@
  *   @li v1.3: Updated code with new DEFINE checks.
  *   @li v1.4: Added IIC definitions.
  *   @li v2.0: Updated version number.
+ *   @li v2.1: Added ACMP channel definitions for `BREAK_1`.
+ *   @li v2.2: Added `RN2483_HF_USART` to drive the RN2483 from USART1 instead of LEUART0.
  *
  * ******************************************************************************
  *
@@ -59,6 +61,12 @@
  *    @li `0` - Use the regular Happy Gecko board pinout. */
 #define CUSTOM_BOARD 1
 
+/** Public definition to select the peripheral used for the RN2483
+ *    @li `1` - Use USART1 at 57600 baud (location 2, PD7/PD6). This needs the RN2483 wired to
+ *              these pins and `DEBUG_DBPRINT` disabled (dbprint also uses USART1).
+ *    @li `0` - Use LEUART0 at 4800 baud (location 0, PD4/PD5), the DMA transfers also run in EM2. */
+#define RN2483_HF_USART 0
+
 
 #if CUSTOM_BOARD == 1 /* Custom Happy Gecko pinout */
 
@@ -108,16 +116,26 @@
 	/* Link breakage sensor */
 	#define BREAK1_PORT         gpioPortC
 	#define BREAK1_PIN          2
+	#define BREAK1_ACMP_CHANNEL acmpChannel2 /* ACMP0_CH2 = PC2 */
 	#define BREAK2_PORT         gpioPortC
 	#define BREAK2_PIN          3
 
 	/* RN2483 */
+#if RN2483_HF_USART == 1 /* RN2483_HF_USART */
+	#define RN2483_UART         USART1
+	#define RN2483_UART_LOC     USART_ROUTE_LOCATION_LOC2
+	#define RN2483_TX_PORT      gpioPortD
+	#define RN2483_TX_PIN       7
+	#define RN2483_RX_PORT      gpioPortD
+	#define RN2483_RX_PIN       6
+#else /* RN2483_HF_USART */
 	#define RN2483_UART         LEUART0
 	#define RN2483_UART_LOC     0
 	#define RN2483_TX_PORT      gpioPortD
 	#define RN2483_TX_PIN       4
 	#define RN2483_RX_PORT      gpioPortD
 	#define RN2483_RX_PIN       5
+#endif /* RN2483_HF_USART */
 	#define RN2483_RESET_PORT   gpioPortA
 	#define RN2483_RESET_PIN    10
 
@@ -183,16 +201,26 @@
 	/* Link breakage sensor */
 	#define BREAK1_PORT         gpioPortC
 	#define BREAK1_PIN          1
+	#define BREAK1_ACMP_CHANNEL acmpChannel1 /* ACMP0_CH1 = PC1 */
 	#define BREAK2_PORT         gpioPortC
 	#define BREAK2_PIN          2
 
 	/* RN2483 */
+#if RN2483_HF_USART == 1 /* RN2483_HF_USART */
+	#define RN2483_UART         USART1
+	#define RN2483_UART_LOC     USART_ROUTE_LOCATION_LOC2
+	#define RN2483_TX_PORT      gpioPortD
+	#define RN2483_TX_PIN       7
+	#define RN2483_RX_PORT      gpioPortD
+	#define RN2483_RX_PIN       6
+#else /* RN2483_HF_USART */
 	#define RN2483_UART         LEUART0
 	#define RN2483_UART_LOC     0
 	#define RN2483_TX_PORT      gpioPortD
 	#define RN2483_TX_PIN       4
 	#define RN2483_RX_PORT      gpioPortD
 	#define RN2483_RX_PIN       5
+#endif /* RN2483_HF_USART */
 	#define RN2483_RESET_PORT   gpioPortA
 	#define RN2483_RESET_PIN    10
 
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file util.h
  * @brief Utility functionality.
- * @version 3.1
+ * @version 3.5
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -43,15 +43,77 @@
 #include <stdbool.h> /* "bool", "true", "false" */
 
 
-/** Public definition to enable/disable the logic to send certain error call values (everything except 30 - 50) to the cloud using LoRaWAN.
- *    @li `0` - Keep the MCU in a `while(true)` loop if the `error` method is called while flashing the LED and displaying a UART message.
- *    @li `1` - Display a UART message when the `error` method is called but also forward the number to the cloud using LoRaWAN. Don't go in a `while(true)` loop.  */
+/** Public definition to enable/disable the logic to send error call values to the cloud using LoRaWAN.
+ *    @li `0` - Display a UART message and flash the LED for a few seconds if the `error` method is called, then reset the MCU (the number is kept in a crash record).
+ *    @li `1` - Display a UART message when the `error` method is called but also forward the number to the cloud using LoRaWAN (accumulated, see `ERROR_sendReport`). Don't go in a `while(true)` loop.  */
 #define ERROR_FORWARDING 1
 
 
+/** Amount of GPIO ports a `PinProfile_t` keeps masks for (`gpioPortA` - `gpioPortF`) */
+#define PIN_PROFILE_PORTS 6
+
+
+/** Mode and output masks of one GPIO port, only the bits set in the `xxxMask` fields are written */
+typedef struct
+{
+	uint32_t modelMask;
+	uint32_t model;
+	uint32_t modehMask;
+	uint32_t modeh;
+	uint16_t doutMask;
+	uint16_t dout;
+} PinPortProfile_t;
+
+/** Pin configuration of a peripheral state (see `PIN_PROFILE` and `applyPinProfile`) */
+typedef struct
+{
+	PinPortProfile_t port[PIN_PROFILE_PORTS];
+} PinProfile_t;
+
+
+/* Per-pin terms of the masks, `p` is the port the masks are calculated for */
+#define PIN_TERM_MODEL_MASK(p, port, pin, mode, out) | ((((port) == (p)) && ((pin) < 8)) ? (0xFUL << (((pin) & 7) * 4)) : 0)
+#define PIN_TERM_MODEL(p, port, pin, mode, out)      | ((((port) == (p)) && ((pin) < 8)) ? ((uint32_t)(mode) << (((pin) & 7) * 4)) : 0)
+#define PIN_TERM_MODEH_MASK(p, port, pin, mode, out) | ((((port) == (p)) && ((pin) >= 8)) ? (0xFUL << (((pin) & 7) * 4)) : 0)
+#define PIN_TERM_MODEH(p, port, pin, mode, out)      | ((((port) == (p)) && ((pin) >= 8)) ? ((uint32_t)(mode) << (((pin) & 7) * 4)) : 0)
+#define PIN_TERM_DOUT_MASK(p, port, pin, mode, out)  | (((port) == (p)) ? (1U << (pin)) : 0)
+#define PIN_TERM_DOUT(p, port, pin, mode, out)       | ((((port) == (p)) && (out)) ? (1U << (pin)) : 0)
+
+/** Masks of one port, `PINS(X, p)` should expand to `X(p, port, pin, mode, out)` for every pin */
+#define PIN_PROFILE_PORT(PINS, p) {                  \
+		.modelMask = 0 PINS(PIN_TERM_MODEL_MASK, p), \
+		.model     = 0 PINS(PIN_TERM_MODEL, p),      \
+		.modehMask = 0 PINS(PIN_TERM_MODEH_MASK, p), \
+		.modeh     = 0 PINS(PIN_TERM_MODEH, p),      \
+		.doutMask  = 0 PINS(PIN_TERM_DOUT_MASK, p),  \
+		.dout      = 0 PINS(PIN_TERM_DOUT, p)       }
+
+/** Initializer of a `PinProfile_t`, everything is calculated by the compiler */
+#define PIN_PROFILE(PINS) { .port = {                         \
+		PIN_PROFILE_PORT(PINS, 0), PIN_PROFILE_PORT(PINS, 1), \
+		PIN_PROFILE_PORT(PINS, 2), PIN_PROFILE_PORT(PINS, 3), \
+		PIN_PROFILE_PORT(PINS, 4), PIN_PROFILE_PORT(PINS, 5) } }
+
+/** Change the mode of a single pin with one read-modify-write of `MODEL` or `MODEH` (the register is selected at compile time).
+ *    @li Unlike `GPIO_PinModeSet` the `DOUT` register isn't touched.
+ *    @li The calling file should include `em_gpio.h`. */
+#define PIN_MODE_SET(port, pin, mode) do {                                                         \
+		if ((pin) < 8) GPIO->P[port].MODEL = (GPIO->P[port].MODEL & ~(0xFUL << (((pin) & 7) * 4))) \
+		                                     | ((uint32_t)(mode) << (((pin) & 7) * 4));            \
+		else GPIO->P[port].MODEH = (GPIO->P[port].MODEH & ~(0xFUL << (((pin) & 7) * 4)))           \
+		                           | ((uint32_t)(mode) << (((pin) & 7) * 4));                      \
+	} while (0)
+
+
 /* Public prototypes */
 void led (bool enabled);
 void error (uint8_t number);
+void applyPinProfile (const PinProfile_t *profile);
+
+#if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
+void ERROR_nextCycle (void);
+void ERROR_sendReport (void);
+#endif /* ERROR_FORWARDING */
 
 
 #endif /* _UTIL_H_ */
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file leuart.c
  * @brief LEUART (serial communication) functionality required by the RN2483 LoRa modem.
- * @version 2.0
+ * @version 2.9
  * @author
  *   Guus Leenders@n
  *   Modified by Brecht Van Eeckhoudt
@@ -15,6 +15,17 @@
  *   @li v1.2: Added (basic) timeout functionality.
  *   @li v1.3: Refined timeout functionality and cleaned up unused things in comments.
  *   @li v2.0: Updated version number.
+ *   @li v2.1: Started sleeping (EM1 for TX, EM2 for RX) while waiting, the timeouts are now in milliseconds.
+ *   @li v2.2: The clocks for the GPIO pins are held by the RN2483 power rail.
+ *   @li v2.3: Started waiting on the TX DMA at a low HFRCO band.
+ *   @li v2.4: `Leuart_SendData` doesn't wait on a response anymore (used for `sys sleep`) and `Leuart_Reinit`
+ *             only wakes the module, the *ok* response is read by `RN2483_Wake`.
+ *   @li v2.5: Added asynchronous sending and a response callback for the RN2483 command engine,
+ *             the DMA transfers also run in EM2 now (TXDMAWU).
+ *   @li v2.6: Added `RN2483_HF_USART` to use USART1 at 57600 baud instead of LEUART0 at 4800 baud.
+ *   @li v2.7: The responses are received in a ring with one interrupt per line (SIGFRAME) and read in place.
+ *   @li v2.8: Added `Leuart_WaitForFlag` so the RN2483 command engine also waits in the right energy mode.
+ *   @li v2.9: The lines end at the '\r' of "\r\n", `Leuart_GetResponse` returns "" without a complete line.
  *
  ******************************************************************************/
 
@@ -46,7 +57,9 @@
 #include "em_cmu.h"        /* Clock management unit */
 #include "em_gpio.h"       /* General Purpose IO */
 #include "em_leuart.h"     /* Low Energy Universal Asynchronous Receiver/Transmitter Peripheral API */
+#include "em_usart.h"      /* Universal synchr./asynchr. receiver/transmitter (RN2483_HF_USART) */
 #include "em_dma.h"        /* Direct Memory Access (DMA) API */
+#include "em_core.h"       /* Core interrupt handling API */
 #include "dmactrl.h"       /* DMA driver */
 
 #include "leuart.h"        /* Corresponding header file */
@@ -55,17 +68,37 @@
 #include "debug_dbprint.h" /* Enable or disable printing to UART for debugging */
 #include "util_string.h"   /* Utility functionality regarding strings */
 #include "util.h"          /* Utility functionality */
+#include "pm.h"            /* HFRCO band listener */
 
 
-/* Local definitions */
-/** Enable (1) or disable (0) printing the timeout counter value using DBPRINT */
-#define DBPRINT_TIMEOUT 0
+#if (RN2483_HF_USART == 1) && (DEBUG_DBPRINT == 1)
+#error "dbprint and the RN2483 can't both use USART1, disable DEBUG_DBPRINT or RN2483_HF_USART."
+#endif
+
 
-/* Maximum values for the counters before exiting a `while` loop */
-#define TIMEOUT_SYNC         80
-#define TIMEOUT_DMA          50000
-#define TIMEOUT_SENDCMD      40000
-#define TIMEOUT_WAITRESPONSE 2000000 /* Depends on spreading factor! */
+/* Local definitions */
+/* Maximum waiting times in milliseconds */
+#define TIMEOUT_SYNC_MS         5     /* A few LFB clock cycles */
+#define TIMEOUT_RXDMA_MS        1     /* The DMA controller reads the signal frame right after it's received */
+#define TIMEOUT_TXC_MS          10    /* The last two characters at 4800 baud take ~4 ms */
+#define TIMEOUT_DMA_MS          1000  /* 255 characters at 4800 baud take ~530 ms */
+#define TIMEOUT_SENDCMD_MS      1000
+#define TIMEOUT_WAITRESPONSE_MS 10000 /* Depends on spreading factor! (the RX2 window of a join is 6 s after TX) */
+
+/* Peripheral specific settings */
+#if RN2483_HF_USART == 1 /* RN2483_HF_USART */
+#define RN2483_BAUDRATE      57600 /* Default baudrate of the RN2483 */
+#define DMAREQ_RN2483_RX     DMAREQ_USART1_RXDATAV
+#define DMAREQ_RN2483_TX     DMAREQ_USART1_TXBL
+#define RN2483_TX_COMPLETE() (USART_StatusGet(RN2483_UART) & USART_STATUS_TXC)
+#define WAIT_IN_EM2          false /* The USART needs the HF clock, wait in EM1 */
+#else /* RN2483_HF_USART */
+#define RN2483_BAUDRATE      4800
+#define DMAREQ_RN2483_RX     DMAREQ_LEUART0_RXDATAV
+#define DMAREQ_RN2483_TX     DMAREQ_LEUART0_TXBL
+#define RN2483_TX_COMPLETE() (LEUART_StatusGet(RN2483_UART) & LEUART_STATUS_TXC)
+#define WAIT_IN_EM2          true  /* RXDMAWU and TXDMAWU wake up the DMA controller */
+#endif /* RN2483_HF_USART */
 
 /* DMA Configurations */
 #define DMA_CHANNEL_TX       0 /* DMA channel is 0 */
@@ -75,56 +108,77 @@
 
 /* Local variables */
 static DMA_CB_TypeDef dmaCallBack[DMA_CHANNELS]; /* DMA callback structure */
-char receiveBuffer[RECEIVE_BUFFER_SIZE];
-volatile uint8_t bufferPointer = 0;
+char receiveBuffer[RECEIVE_BUFFER_SIZE];    /* Receive ring, the lines are terminated in place */
+static volatile uint8_t lineStart = 0;      /* Start of the line that's being received */
+static volatile uint8_t readIndex = 0;      /* Start of the oldest line that wasn't read yet */
+static volatile uint8_t linesPending = 0;   /* Amount of received lines that weren't read yet */
+#if RN2483_HF_USART == 1 /* RN2483_HF_USART */
+static volatile uint8_t writeIndex = 0;     /* Filled by the RX interrupt handler instead of the DMA */
+#endif /* RN2483_HF_USART */
 volatile bool receiveComplete = false;
+volatile bool transmitComplete = false;
+static void (*responseCallback)(void) = NULL; /* Called from the interrupt handler when a line is received */
 
 
-void Leuart_ClearBuffers(void)
+/* Static (internal) functions */
+/* (Re)start the receive ring at the start of the buffer, lines that weren't read yet are dropped */
+static void startReceive(void)
 {
 	memset(receiveBuffer, '\0', RECEIVE_BUFFER_SIZE);
+	lineStart = 0;
+	readIndex = 0;
+	linesPending = 0;
 	receiveComplete = false;
-}
 
-/* Static (internal) functions */
-static void basicTxComplete(unsigned int channel, bool primary, void *user)
-{
-	(void) user;
-	/* Refresh DMA basic transaction cycle */
+#if RN2483_HF_USART == 1 /* RN2483_HF_USART */
+	writeIndex = 0;
+#else /* RN2483_HF_USART */
+	/* One transfer for the whole ring, the last byte stays '\0' */
 	DMA_ActivateBasic(DMA_CHANNEL_RX,
-					primary,
+					true,
 					false,
 					(void *)&receiveBuffer[0],
 					(void *)&RN2483_UART->RXDATA,
-					0);
-	bufferPointer = 0;
+					RECEIVE_BUFFER_SIZE - 2);
+#endif /* RN2483_HF_USART */
+
 }
 
-static void basicRxComplete(unsigned int channel, bool primary, void *user)
+/* Terminate the newly received line(s) in place and hand them over (called from an interrupt handler) */
+static void linesReceived(void)
 {
-	(void) user;
-
-	/* Refresh DMA basic transaction cycle */
-	char c = RN2483_UART->RXDATA;
-	if(bufferPointer < RECEIVE_BUFFER_SIZE - 1){
-		if(c != '\n'){
-			bufferPointer++;
-			DMA_ActivateBasic(DMA_CHANNEL_RX,
-								  primary,
-								  false,
-								  &receiveBuffer[bufferPointer],
-								  NULL,
-								  0);
-		}
-		else{
+	for(uint8_t i = lineStart; i < RECEIVE_BUFFER_SIZE - 1; i++){
+		if(receiveBuffer[i] == '\n'){
+			/* The module ends its lines with "\r\n", the '\n' is skipped by Leuart_GetResponse */
+			if((i > lineStart) && (receiveBuffer[i - 1] == '\r')){
+				receiveBuffer[i - 1] = '\0';
+			}
+			else{
+				receiveBuffer[i] = '\0';
+			}
+			lineStart = i + 1;
+			linesPending++;
 			receiveComplete = true;
-			receiveBuffer[bufferPointer+1] = '\0';
+			if(responseCallback != NULL){
+				responseCallback();
+			}
 		}
 	}
 }
 
-static bool Leuart_ResponseAvailable(void){
-	return (receiveComplete);
+static void basicTxComplete(unsigned int channel, bool primary, void *user)
+{
+	(void) user;
+	transmitComplete = true;
+	/* Every command gets its responses at the start of the ring */
+	startReceive();
+}
+
+static void basicRxComplete(unsigned int channel, bool primary, void *user)
+{
+	(void) user;
+	/* The ring is full, the line that didn't fit is lost */
+	startReceive();
 }
 
 void setupDma(void){
@@ -150,14 +204,14 @@ void setupDma(void){
 	rxChnlCfg.highPri   = false; /* Can't use with peripherals */
 	rxChnlCfg.enableInt = true;  /* Enabling interrupt to refresh DMA cycle*/
 	/*Setting up DMA transfer trigger request*/
-	rxChnlCfg.select = DMAREQ_LEUART0_RXDATAV; /* DMAREQ_LEUART0_RXDATAV; */
+	rxChnlCfg.select = DMAREQ_RN2483_RX;
 	/* Setting up callback function to refresh descriptors*/
 	rxChnlCfg.cb     = &(dmaCallBack[DMA_CHANNEL_RX]);
 	DMA_CfgChannel(DMA_CHANNEL_RX, &rxChnlCfg);
 
 	/* Setting up channel descriptor */
-	/* Destination is buffer, increment ourselves */
-	rxDescrCfg.dstInc = dmaDataIncNone;
+	/* Destination is the receive ring */
+	rxDescrCfg.dstInc = dmaDataInc1;
 	/* Source is LEUART_RX register and transfers 8 bits each time */
 	rxDescrCfg.srcInc = dmaDataIncNone;
 	rxDescrCfg.size   = dmaDataSize1;
@@ -178,7 +232,7 @@ void setupDma(void){
 	txChnlCfg.highPri   = false; /* Can't use with peripherals */
 	txChnlCfg.enableInt = true;  /* Enabling interrupt to refresh DMA cycle*/
 	/*Setting up DMA transfer trigger request*/
-	txChnlCfg.select = DMAREQ_LEUART0_TXBL; /* DMAREQ_LEUART0_RXDATAV; */
+	txChnlCfg.select = DMAREQ_RN2483_TX;
 	/* Setting up callback function to refresh descriptors*/
 	txChnlCfg.cb     = &(dmaCallBack[DMA_CHANNEL_TX]);
 	DMA_CfgChannel(DMA_CHANNEL_TX, &txChnlCfg);
@@ -196,16 +250,18 @@ void setupDma(void){
 	DMA_CfgDescr(DMA_CHANNEL_TX, true, &txDescrCfg);
 }
 
-static void sendLeuartData(char * buffer, uint8_t bufferLength)
+static void startLeuartData(char * buffer, uint8_t bufferLength)
 {
-	/* Timeout counter */
-	uint32_t counter = 0;
 
-	/* Wait for sync */
-	while ((counter < TIMEOUT_SYNC) && RN2483_UART->SYNCBUSY) counter++;
+#if RN2483_HF_USART == 0 /* RN2483_HF_USART */
+	/* Wait for sync (no interrupt is available for this so it's a short busy wait), the RTC
+	 * counter is read directly because this can be called from an interrupt handler */
+	uint32_t start = RTC_getTicks();
+	uint32_t ticks = RTC_secondsToTicks(1) / (1000 / TIMEOUT_SYNC_MS);
+	while (RN2483_UART->SYNCBUSY && ((RTC_getTicks() - start) < ticks));
 
 	/* Exit the function if the maximum waiting time was reached */
-	if (counter == TIMEOUT_SYNC)
+	if (RN2483_UART->SYNCBUSY)
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
@@ -214,16 +270,9 @@ static void sendLeuartData(char * buffer, uint8_t bufferLength)
 
 		error(51);
 	}
-#if DBPRINT_TIMEOUT == 1 /* DBPRINT_TIMEOUT */
-	else
-	{
+#endif /* RN2483_HF_USART */
 
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbwarnInt("sendLeuartData SYNC (", counter, ")");
-#endif /* DEBUG_DBPRINT */
-
-	}
-#endif /* DBPRINT_TIMEOUT */
+	transmitComplete = false;
 
 	DMA_ActivateBasic(DMA_CHANNEL_TX,
 	                  true,
@@ -231,15 +280,14 @@ static void sendLeuartData(char * buffer, uint8_t bufferLength)
 	                  (void *)&RN2483_UART->TXDATA,
 	                  buffer,
 	                  (unsigned int)(bufferLength - 1));
+}
 
-	/* Reset timeout counter */
-	counter = 0;
-
-	/* Wait in EM1 for DMA channel enable */
-	while ((counter < TIMEOUT_DMA) && DMA_ChannelEnabled(DMA_CHANNEL_TX)) counter++;
+static void sendLeuartData(char * buffer, uint8_t bufferLength)
+{
+	startLeuartData(buffer, bufferLength);
 
-	/* Exit the function if the maximum waiting time was reached */
-	if (counter == TIMEOUT_DMA)
+	/* Wait until the DMA transfer is completed (in EM2 for the LEUART, TXDMAWU wakes up the DMA controller) */
+	if (!waitForFlag(&transmitComplete, TIMEOUT_DMA_MS, WAIT_IN_EM2))
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
@@ -248,31 +296,58 @@ static void sendLeuartData(char * buffer, uint8_t bufferLength)
 
 		error(52);
 	}
-#if DBPRINT_TIMEOUT == 1 /* DBPRINT_TIMEOUT */
-	else
+}
+
+#if RN2483_HF_USART == 1 /* RN2483_HF_USART */
+/* Recalculate the baudrate divider after a HFRCO band change (HFPER clock) */
+static void updateUsartBaudrate(void)
+{
+	if (CMU->HFPERCLKEN0 & CMU_HFPERCLKEN0_USART1)
 	{
+		USART_BaudrateAsyncSet(RN2483_UART, 0, RN2483_BAUDRATE, usartOVS16); /* "0" - Use the current HFPER clock */
+	}
+}
 
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbwarnInt("sendLeuartData DMA (", counter, ")");
-#endif /* DEBUG_DBPRINT */
+static void setupLeuart(void)
+{
+	/* The HFPER and GPIO clocks are held by the RN2483 power rail (see pm.c) */
+	/* To avoid false start, configure output as high */
+	GPIO_PinModeSet(RN2483_TX_PORT, RN2483_TX_PIN, gpioModePushPull, 1);
+	GPIO_PinModeSet(RN2483_RX_PORT, RN2483_RX_PIN, gpioModeInput, 0);
 
-	}
-#endif /* DBPRINT_TIMEOUT */
+	CMU_ClockEnable(cmuClock_USART1, true);
 
-}
+	USART_InitAsync_TypeDef init = USART_INITASYNC_DEFAULT; /* 8N1 */
+	init.baudrate = RN2483_BAUDRATE;
+	init.enable = usartDisable;
+
+	USART_InitAsync(RN2483_UART, &init);
+
+	/* Enable pins at the selected location */
+	RN2483_UART->ROUTE = USART_ROUTE_RXPEN | USART_ROUTE_TXPEN | RN2483_UART_LOC;
+
+	/* The USART has no signal frame detection, the RX interrupt fills the ring */
+	USART_IntClear(RN2483_UART, USART_IF_RXDATAV);
+	USART_IntEnable(RN2483_UART, USART_IEN_RXDATAV);
+	NVIC_ClearPendingIRQ(USART1_RX_IRQn);
+	NVIC_EnableIRQ(USART1_RX_IRQn);
 
+	/* The divider depends on the HFPER clock */
+	PM_AddBandListener(updateUsartBaudrate);
+
+	/* Finally enable it */
+	USART_Enable(RN2483_UART, usartEnable);
+}
+#else /* RN2483_HF_USART */
 static void setupLeuart(void)
 {
-	/* Enable peripheral clocks */
-	CMU_ClockEnable(cmuClock_HFPER, true);
-	/* Configure GPIO pins */
-	CMU_ClockEnable(cmuClock_GPIO, true);
+	/* The HFPER and GPIO clocks are held by the RN2483 power rail (see pm.c) */
 	/* To avoid false start, configure output as high */
 	GPIO_PinModeSet(RN2483_TX_PORT, RN2483_TX_PIN, gpioModePushPull, 1);
 	GPIO_PinModeSet(RN2483_RX_PORT, RN2483_RX_PIN, gpioModeInput, 0);
 
 	LEUART_Init_TypeDef init = LEUART_INIT_DEFAULT; /* Default config is fine */
-	init.baudrate = 4800;
+	init.baudrate = RN2483_BAUDRATE;
 
 	/* Enable CORE LE clock in order to access LE modules */
 	CMU_ClockEnable(cmuClock_CORELE, true);
@@ -292,16 +367,23 @@ static void setupLeuart(void)
 	/* Enable pins at default location */
 	RN2483_UART->ROUTE = LEUART_ROUTE_RXPEN | LEUART_ROUTE_TXPEN | RN2483_UART_LOC;
 
-	/* Set RXDMAWU to wake up the DMA controller in EM2 */
+	/* Set RXDMAWU and TXDMAWU to wake up the DMA controller in EM2 */
 	LEUART_RxDmaInEM2Enable(RN2483_UART, true);
+	LEUART_TxDmaInEM2Enable(RN2483_UART, true);
+
+	/* Interrupt at the end of each line instead of at every character */
+	RN2483_UART->SIGFRAME = '\n';
 
 	/* Clear previous RX interrupts */
-	LEUART_IntClear(RN2483_UART, LEUART_IF_RXDATAV);
+	LEUART_IntClear(RN2483_UART, LEUART_IF_RXDATAV | LEUART_IF_SIGF);
+	LEUART_IntEnable(RN2483_UART, LEUART_IEN_SIGF);
 	NVIC_ClearPendingIRQ(LEUART0_IRQn);
+	NVIC_EnableIRQ(LEUART0_IRQn);
 
 	/* Finally enable it */
 	LEUART_Enable(RN2483_UART, leuartEnable);
 }
+#endif /* RN2483_HF_USART */
 
 void Leuart_Init(void)
 {
@@ -327,16 +409,28 @@ void Leuart_Reinit(void)
 	//CMU_ClockEnable(cmuClock_DMA, true);
 	//CMU_ClockEnable(cmuClock_LEUART0, true);
 
-	LEUART_Reset(RN2483_UART);
+	Leuart_Reset();
 	Leuart_BreakCondition();
 	setupLeuart();
 
-	/* Auto baud setting */
+	/* Auto baud setting, the response of the command that put the module to sleep follows (see RN2483_Wake) */
 	char b[] = "U";
 	sendLeuartData(b, 1);
-	Leuart_WaitForResponse();
-	delay(20);
-	Leuart_WaitForResponse();
+}
+
+/** Reset the peripheral used for the RN2483 (the TX pin keeps its GPIO configuration) */
+void Leuart_Reset(void)
+{
+
+#if RN2483_HF_USART == 1 /* RN2483_HF_USART */
+	NVIC_DisableIRQ(USART1_RX_IRQn);
+	USART_Reset(RN2483_UART);
+	CMU_ClockEnable(cmuClock_USART1, false);
+#else /* RN2483_HF_USART */
+	NVIC_DisableIRQ(LEUART0_IRQn);
+	LEUART_Reset(RN2483_UART);
+#endif /* RN2483_HF_USART */
+
 }
 
 void Leuart_BreakCondition(void)
@@ -348,60 +442,70 @@ void Leuart_BreakCondition(void)
 	GPIO_PinOutSet(RN2483_TX_PORT, RN2483_TX_PIN);
 }
 
-void Leuart_ReadResponse(char * buffer, uint8_t bufferLength)
+/** Restart the receive ring */
+void Leuart_ClearBuffers(void)
 {
-	sprintf(buffer, "%s", receiveBuffer);
-	receiveComplete = false;
-	bufferPointer = 0;
+	startReceive();
 }
 
-void Leuart_SendData(char * buffer, uint8_t bufferLength) /* TODO: Not used... */
+/** Get the oldest received line (without "\r\n") right from the receive ring, "" if no complete line is pending.
+ *  It stays valid until the next command is sent. */
+const char * Leuart_GetResponse(void)
 {
-	/* Timeout counter */
-	uint32_t counter = 0;
+	const char * line = "";
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+
+	if(linesPending > 0){
+		line = &receiveBuffer[readIndex];
+		readIndex += strlen(line) + 1;
+		if(receiveBuffer[readIndex] == '\n'){
+			readIndex++;
+		}
+		linesPending--;
+	}
+	receiveComplete = (linesPending > 0);
+
+	CORE_EXIT_ATOMIC();
+
+	return (line);
+}
+
+/** Send data over the LEUART without waiting on a response (for `sys sleep` the module only answers when it wakes up).
+ *  Returns after the last character has been shifted out so the LEUART can be reset right away. */
+void Leuart_SendData(char * buffer, uint8_t bufferLength)
+{
+	/* Timer to limit the waiting time on the TX complete flag */
+	Timer_t timeout;
 
 	/* Send data over LEUART */
 	sendLeuartData(buffer, bufferLength);
 
-	/* Wait for response */
-	while ((counter < TIMEOUT_WAITRESPONSE) && !Leuart_ResponseAvailable()) counter++;
+	/* The DMA is done when the last character is in the TX buffer, wait until it's sent (short busy wait) */
+	TIMER_start(&timeout, TIMEOUT_TXC_MS, false, NULL);
+	while (!RN2483_TX_COMPLETE() && !TIMER_isExpired(&timeout));
+	TIMER_stop(&timeout);
 
-	/* Exit the function if the maximum waiting time was reached */
-	if (counter == TIMEOUT_WAITRESPONSE)
+	if (!RN2483_TX_COMPLETE())
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbcrit("Waiting time for response reached! (Leuart_SendData)");
+		dbcrit("Waiting time for TX complete reached! (Leuart_SendData)");
 #endif /* DEBUG_DBPRINT */
 
 		error(53);
 	}
-	else
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbwarnInt("Leuart_SendData (", counter, ")");
-#endif /* DEBUG_DBPRINT */
-
-	}
-
-	receiveComplete = true;
 }
 
 /** Send a command string over the LEUART. "wakeUp" IS NOT USED */
 Leuart_Status_t Leuart_SendCommand(char * cb, uint8_t cbl, volatile bool * wakeUp)
 {
-	/* Timeout counter */
-	uint32_t counter = 0;
-
 	/* Send data over LEUART */
 	sendLeuartData(cb, cbl);
 
-	/* Wait for response */
-	while ((counter < TIMEOUT_SENDCMD) && !Leuart_ResponseAvailable()) counter++;
-
-	/* Exit the function if the maximum waiting time was reached */
-	if (counter == TIMEOUT_SENDCMD)
+	/* Wait for response (in EM2 for the LEUART, RXDMAWU wakes up the DMA controller) */
+	if (!waitForFlag(&receiveComplete, TIMEOUT_SENDCMD_MS, WAIT_IN_EM2))
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
@@ -412,39 +516,33 @@ Leuart_Status_t Leuart_SendCommand(char * cb, uint8_t cbl, volatile bool * wakeU
 
 		return (TX_TIMEOUT);
 	}
-#if DBPRINT_TIMEOUT == 1 /* DBPRINT_TIMEOUT */
-	else
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbwarnInt("Leuart_SendCommand (", counter, ")");
-#endif /* DEBUG_DBPRINT */
-
-	}
-#endif /* DBPRINT_TIMEOUT */
-
 	return (DATA_SENT);
 }
 
 
-Leuart_Status_t Leuart_WaitForResponse()
+/** Start sending data without waiting, the DMA arms the receive buffer when it's done (used by the RN2483 command engine) */
+void Leuart_SendAsync(char * buffer, uint8_t bufferLength)
 {
-	/* Timeout counter */
-	uint32_t counter = 0;
+	startLeuartData(buffer, bufferLength);
+}
 
-	/* Activate DMA */
-	DMA_ActivateBasic(	DMA_CHANNEL_RX,
-						true,
-						false,
-						(void *)&receiveBuffer[0],
-						(void *)&RN2483_UART->RXDATA,
-						0);
+/** Wait on a flag set by an interrupt handler, in the lowest energy mode the peripheral allows (EM2 for the LEUART, EM1 for USART1) */
+bool Leuart_WaitForFlag(volatile bool * flag, uint32_t msTimeout)
+{
+	return (waitForFlag(flag, msTimeout, WAIT_IN_EM2));
+}
 
-	/* Wait for response */
-	while ((counter < TIMEOUT_WAITRESPONSE) && !Leuart_ResponseAvailable()) counter++;
+/** Set the method to call (from an interrupt handler) each time a complete line is received, `NULL` to disable it */
+void Leuart_SetResponseCallback(void (*callback)(void))
+{
+	responseCallback = callback;
+}
 
-	/* Exit the function if the maximum waiting time was reached */
-	if (counter == TIMEOUT_WAITRESPONSE)
+/** Wait for the next line, the ring keeps receiving after the previous one (for a second response) */
+Leuart_Status_t Leuart_WaitForResponse()
+{
+	/* Wait for response (in EM2 for the LEUART, RXDMAWU wakes up the DMA controller) */
+	if (!waitForFlag(&receiveComplete, TIMEOUT_WAITRESPONSE_MS, WAIT_IN_EM2))
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
@@ -455,17 +553,41 @@ Leuart_Status_t Leuart_WaitForResponse()
 
 		return (RX_TIMEOUT);
 	}
-#if DBPRINT_TIMEOUT == 1 /* DBPRINT_TIMEOUT */
-	else
-	{
+	return (DATA_RECEIVED);
+}
 
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbwarnInt("Leuart_WaitForResponse (", counter, ")");
-#endif /* DEBUG_DBPRINT */
 
+#if RN2483_HF_USART == 1 /* RN2483_HF_USART */
+/** USART1 RX interrupt handler, puts the characters in the receive ring */
+void USART1_RX_IRQHandler(void)
+{
+	/* Reading RXDATA clears the interrupt flag */
+	char c = RN2483_UART->RXDATA;
+
+	if(writeIndex >= RECEIVE_BUFFER_SIZE - 1){
+		startReceive(); /* The ring is full, the line that didn't fit is lost */
+		return;
 	}
-#endif /* DBPRINT_TIMEOUT */
+	receiveBuffer[writeIndex++] = c;
 
-	return (DATA_RECEIVED);
+	if(c == '\n'){
+		linesReceived();
+	}
 }
+#else /* RN2483_HF_USART */
+/** LEUART0 interrupt handler, called once per received line (signal frame) */
+void LEUART0_IRQHandler(void)
+{
+	uint32_t flags = LEUART_IntGet(RN2483_UART);
+	LEUART_IntClear(RN2483_UART, flags);
 
+	/* Make sure the DMA controller moved the '\n' to the ring (the RTC counter is used, this is an interrupt handler) */
+	uint32_t start = RTC_getTicks();
+	uint32_t ticks = RTC_secondsToTicks(1) / (1000 / TIMEOUT_RXDMA_MS);
+	while((LEUART_StatusGet(RN2483_UART) & LEUART_STATUS_RXDATAV) && ((RTC_getTicks() - start) <= ticks));
+
+	if(flags & LEUART_IF_SIGF){
+		linesReceived();
+	}
+}
+#endif /* RN2483_HF_USART */
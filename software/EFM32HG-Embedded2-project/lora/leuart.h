@@ -20,7 +20,7 @@
 #ifndef _LEUART_H_
 #define _LEUART_H_
 
-#define RECEIVE_BUFFER_SIZE 50
+#define RECEIVE_BUFFER_SIZE 128 /* "ok" and "mac_rx <port> <data>" with the maximum downlink (51 bytes) */
 #define COMMAND_BUFFER_SIZE 50
 
 typedef enum leuart_statuses{
@@ -32,11 +32,15 @@ typedef enum leuart_statuses{
 
 void Leuart_Init(void);
 void Leuart_Reinit(void);
+void Leuart_Reset(void);
 void Leuart_ClearBuffers(void);
 void Leuart_BreakCondition(void);
 void Leuart_SendData(char * buffer, uint8_t bufferLength);
-void Leuart_ReadResponse(char * buffer, uint8_t bufferLength);
+const char * Leuart_GetResponse(void);
 Leuart_Status_t Leuart_SendCommand(char * cb, uint8_t cbl, volatile bool * wakeUp);
 Leuart_Status_t Leuart_WaitForResponse();
+void Leuart_SendAsync(char * buffer, uint8_t bufferLength);
+void Leuart_SetResponseCallback(void (*callback)(void));
+bool Leuart_WaitForFlag(volatile bool * flag, uint32_t msTimeout);
 
 #endif /* _LEUART_H_ */
@@ -32,22 +32,107 @@
 #define LORA_BUFFERSIZE		64
 #define MAX_JOIN_RETRIES	5
 
+/* Frame around the application payload: MHDR (1), DevAddr (4), FCtrl (1), FCnt (2), FPort (1) and MIC (4) */
+#define LORA_FRAME_OVERHEAD		13
+#define LORA_JOIN_REQUEST_SIZE	23
+
+/* The default channels (868.1, 868.3 and 868.5 MHz) are all in sub-band g1 (868.0 - 868.6 MHz, 1%).
+ * Like the RN2483 ("mac get ch dcycle 0" = 302) each channel gets a third of it: off for 302 times the airtime */
+#define LORA_CHANNELS			3
+#define LORA_CHANNEL_OFF_FACTOR	302
+
 char loraReceiveBuffer[LORA_BUFFERSIZE];
+static LoRaSettings_t joinSettings; /* Kept to join again when the module lost its session */
 
-LoRaStatus_t LoRa_Init(LoRaSettings_t init){
-	PM_Enable(PM_RN2483);
+/* Maximum application payload (N) per EU868 data rate (SF12 - SF7) */
+static const uint8_t maxPayload[] = {51, 51, 51, 115, 222, 222};
 
-	RN2483_Init();
+/* Uptime (seconds) from which each channel can be used again */
+static uint32_t channelFree[LORA_CHANNELS];
+static LoRaAirtime_t airtime;
+
+/* Downlink counter at the last LoRa_GetLinkCheck or at the start of the requests, "mac reset" (join) starts it at 0 again */
+static uint32_t downlinkCounter;
+
+/* Time-on-air in ms (rounded up) for a PHY payload, BW125, CR 4/5, explicit header, CRC and 8 preamble symbols */
+static uint32_t timeOnAir(LoRaDataRate_t dataRate, uint8_t phyLength){
+	int32_t sf = 12 - dataRate;
+	int32_t de = (sf >= 11) ? 1 : 0; /* Low data rate optimization (symbols longer than 16 ms) */
+
+	int32_t bits = 8*phyLength - 4*sf + 28 + 16;
+	int32_t symbols = 8;
+	if(bits > 0){
+		symbols += ((bits + 4*(sf - 2*de) - 1) / (4*(sf - 2*de))) * 5;
+	}
+
+	/* Symbol time = 2^SF / 125 kHz = 2^SF * 8 us, preamble = 12.25 symbols */
+	uint32_t us = ((uint32_t)(1 << sf) * 8 * (49 + 4*symbols)) / 4;
+	return ((us + 999) / 1000);
+}
+
+/* Seconds until a channel is free (0 = now) */
+static uint32_t channelWait(void){
+	uint32_t now = RTC_getUptime();
+	uint32_t wait = UINT32_MAX;
+	for(uint8_t i = 0; i < LORA_CHANNELS; i++){
+		uint32_t left = (channelFree[i] > now) ? (channelFree[i] - now) : 0;
+		if(left < wait){
+			wait = left;
+		}
+	}
+	return (wait);
+}
+
+/* Take the first free channel (the modem picks a random one, but the set of free times stays the same) */
+static void accountUplink(uint32_t ms){
+	uint32_t now = RTC_getUptime();
+	for(uint8_t i = 0; i < LORA_CHANNELS; i++){
+		if(channelFree[i] <= now){
+			channelFree[i] = now + ((ms * LORA_CHANNEL_OFF_FACTOR) + 999) / 1000;
+			break;
+		}
+	}
+	airtime.ms += ms;
+	airtime.uplinks++;
+}
+
+/* Defer instead of letting the modem answer "no_free_ch" */
+static void waitForChannel(void){
+	uint32_t wait = channelWait();
+	if(wait == 0){
+		return;
+	}
 
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbwarnInt("Duty cycle: uplink deferred for ", wait, " s");
+#endif /* DEBUG_DBPRINT */
+
+	airtime.deferred++;
+	airtime.deferredSeconds += wait;
+	delay(wait*1000);
+}
+
+static LoRaStatus_t join(void){
 	int retries = 0;
 	while(retries < MAX_JOIN_RETRIES){
-		if(RN2483_Setup(init, loraReceiveBuffer, LORA_BUFFERSIZE) == JOIN_ACCEPTED){
+		RN2483_Status_t status;
+		if(joinSettings.activationMethod == OTAA){
+			/* Only OTAA sends something (a join request) */
+			waitForChannel();
+			status = RN2483_Setup(joinSettings, loraReceiveBuffer, LORA_BUFFERSIZE);
+			accountUplink(timeOnAir(joinSettings.dataRate, LORA_JOIN_REQUEST_SIZE));
+		}
+		else{
+			status = RN2483_Setup(joinSettings, loraReceiveBuffer, LORA_BUFFERSIZE);
+		}
+		if(status == JOIN_ACCEPTED){
+			downlinkCounter = 0;
 			break;
 		}
 		retries++;
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbwarnInt("Retry join in 5 seconds (LoRa_Init) (", retries, ")\n\r");
+		dbwarnInt("Retry join in 5 seconds (", retries, ")\n\r");
 #endif /* DEBUG_DBPRINT */
 
 		delay(5000);
@@ -58,19 +143,146 @@ LoRaStatus_t LoRa_Init(LoRaSettings_t init){
 	return (JOINED);
 }
 
-LoRaStatus_t LoRa_SendLppBuffer(LPP_Buffer_t b, bool ackNoAck){
-	if(ackNoAck == LORA_CONFIRMED){ // Not tested yet !!
-		if(RN2483_TransmitConfirmed(b.buffer, b.fill, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_RX){
-			return (ERROR);
+static RN2483_Status_t transmit(LPP_Buffer_t b, bool ackNoAck){
+	RN2483_Status_t status = NO_FREE_CH;
+	uint32_t ms = LoRa_TimeOnAir(joinSettings.dataRate, b.fill); /* Estimate, ADR can change the data rate in the modem */
+
+	for(uint8_t attempt = 0; (attempt < 2) && (status == NO_FREE_CH); attempt++){
+		if(attempt > 0){
+			/* Out of sync with the modem (it kept its counters over a reset of the MCU), block all channels once */
+			uint32_t now = RTC_getUptime();
+			for(uint8_t i = 0; i < LORA_CHANNELS; i++){
+				channelFree[i] = now + ((ms * LORA_CHANNEL_OFF_FACTOR) + 999) / 1000;
+			}
+		}
+
+		waitForChannel();
+		if(ackNoAck == LORA_CONFIRMED){ // Not tested yet !!
+			status = RN2483_TransmitConfirmed(b.buffer, b.fill, loraReceiveBuffer, LORA_BUFFERSIZE);
+		}
+		else{
+			status = RN2483_TransmitUnconfirmed(b.buffer, b.fill, loraReceiveBuffer, LORA_BUFFERSIZE);
 		}
-		return (SUCCESS);
 	}
-	else{
-		if(RN2483_TransmitUnconfirmed(b.buffer, b.fill, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_TX_OK){
+
+	if((status == MAC_TX_OK) || (status == MAC_RX) || (status == MAC_ERR)){
+		accountUplink(ms); /* Sent, also if the modem reported an error afterwards */
+	}
+	return (status);
+}
+
+LoRaStatus_t LoRa_Init(LoRaSettings_t init){
+	PM_Enable(PM_RN2483);
+
+	RN2483_Init();
+
+	joinSettings = init;
+	return (join());
+}
+
+uint8_t LoRa_MaxPayload(void){
+	return (maxPayload[joinSettings.dataRate]);
+}
+
+uint32_t LoRa_TimeOnAir(LoRaDataRate_t dataRate, uint8_t payloadSize){
+	return (timeOnAir(dataRate, payloadSize + LORA_FRAME_OVERHEAD));
+}
+
+void LoRa_GetAirtime(LoRaAirtime_t * stats){
+	*stats = airtime;
+}
+
+LoRaStatus_t LoRa_SendLppBuffer(LPP_Buffer_t b, bool ackNoAck){
+	/* The module would answer "invalid_data_len", don't build and send the command */
+	if(b.fill > LoRa_MaxPayload()){
+		return (ERROR);
+	}
+
+	RN2483_Status_t status = transmit(b, ackNoAck);
+
+	/* A session kept over "sys sleep" can get lost, only then a (new) join is done */
+	if((status == NOT_JOINED) || (status == FRAME_COUNTER_ERR_REJOIN_NEEDED)){
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbwarn("RN2483 session lost, joining again...");
+#endif /* DEBUG_DBPRINT */
+
+		if(join() != JOINED){
 			return (ERROR);
 		}
-		return (SUCCESS);
+		status = transmit(b, ackNoAck);
+	}
+
+	/* "mac_rx" instead of "mac_tx_ok" if a downlink was received (see LoRa_GetDownlink) */
+	if((status != MAC_TX_OK) && (status != MAC_RX)){
+		return (ERROR);
+	}
+	return (SUCCESS);
+}
+
+bool LoRa_GetDownlink(LoRaDownlink_t * downlink){
+	return (RN2483_GetDownlink(downlink));
+}
+
+/* Also used for a (new) join, ADR can still change the data rate afterwards */
+LoRaStatus_t LoRa_SetDataRate(LoRaDataRate_t dataRate){
+	joinSettings.dataRate = dataRate;
+	if(RN2483_SetDataRate(dataRate, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_OK){
+		return (ERROR);
+	}
+	return (SUCCESS);
+}
+
+LoRaStatus_t LoRa_SetPower(uint8_t power){
+	joinSettings.power = power;
+	if(RN2483_SetOutputPower(power, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_OK){
+		return (ERROR);
+	}
+	return (SUCCESS);
+}
+
+/* The data rate in the modem (ADR can change it), the last one set if it can't be read */
+LoRaDataRate_t LoRa_GetDataRate(void){
+	int8_t dr;
+	if((RN2483_GetDataRate(&dr, loraReceiveBuffer, LORA_BUFFERSIZE) == MAC_OK) && (dr <= SF7_BW125)){
+		joinSettings.dataRate = (LoRaDataRate_t)dr;
+	}
+	return (joinSettings.dataRate);
+}
+
+/* 0 stops the Link Check requests, also kept for a (new) join */
+LoRaStatus_t LoRa_SetLinkCheck(uint16_t interval){
+	joinSettings.linkCheckInterval = interval;
+	if(RN2483_SetLinkCheck(interval, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_OK){
+		return (ERROR);
+	}
+	/* Downlinks before the requests can't carry an answer */
+	if((interval > 0) && (RN2483_GetDownlinkCounter(&downlinkCounter, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_OK)){
+		return (ERROR);
+	}
+	return (SUCCESS);
+}
+
+/* True if a downlink was received since the last call (or the start of the requests) and the modem has a Link Check answer.
+ * The network answers in the downlink after the request, other downlinks don't change the margin.
+ * Only call it while requests are added, "mac get mrgn" keeps returning the last answer */
+bool LoRa_GetLinkCheck(LoRaLink_t * link){
+	uint32_t counter;
+	if((RN2483_GetDownlinkCounter(&counter, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_OK) || (counter == downlinkCounter)){
+		return (false);
+	}
+	downlinkCounter = counter;
+
+	if((RN2483_GetGateways(&link->gateways, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_OK) || (link->gateways == 0)){
+		return (false);
+	}
+	if(RN2483_GetMargin(&link->margin, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_OK){
+		return (false);
+	}
+	if(RN2483_GetSnr(&link->snr, loraReceiveBuffer, LORA_BUFFERSIZE) != MAC_OK){
+		link->snr = 0;
 	}
+	return (true);
 }
 
 void LoRa_Sleep(uint32_t durationMs, volatile bool * wakeUp){
@@ -26,6 +26,7 @@
 #define LORA_EUI_LENGTH				16
 #define LORA_KEY_LENGTH				32
 #define LORA_DEVICE_ADDRESS_LENGTH	8
+#define LORA_DOWNLINK_SIZE			51 /* Maximum payload at SF12 - SF10 */
 
 #include <em_device.h>
 #include "lpp.h"
@@ -60,11 +61,44 @@ typedef struct{
 	char deviceAddress[LORA_DEVICE_ADDRESS_LENGTH+1];
 	char networkSessionKey[LORA_KEY_LENGTH+1];
 	char applicationSessionKey[LORA_KEY_LENGTH+1];
+	uint8_t power;               /* RN2483_POWER_xxx */
+	bool adaptiveDataRate;
+	uint16_t linkCheckInterval;  /* Seconds, 0 = no Link Check requests */
 } LoRaSettings_t;
 
+typedef struct{
+	uint8_t port;
+	uint8_t length;
+	uint8_t data[LORA_DOWNLINK_SIZE];
+} LoRaDownlink_t;
+
+/* Last Link Check answer (see LoRa_GetLinkCheck) */
+typedef struct{
+	uint8_t margin;   /* Demodulation margin (dB) of the request at the best gateway */
+	uint8_t gateways; /* Amount of gateways that received the request */
+	int8_t snr;       /* SNR (dB) of the downlink at the modem */
+} LoRaLink_t;
+
+/* Airtime statistics since the start (see LoRa_GetAirtime) */
+typedef struct{
+	uint32_t ms;              /* Total time-on-air of the uplinks */
+	uint16_t uplinks;         /* Amount of uplinks (join requests included) */
+	uint16_t deferred;        /* Amount of uplinks which had to wait on the duty cycle */
+	uint32_t deferredSeconds; /* Total time waited on the duty cycle */
+} LoRaAirtime_t;
+
 LoRaStatus_t LoRa_Init(LoRaSettings_t init);
 
+uint8_t LoRa_MaxPayload(void);
+uint32_t LoRa_TimeOnAir(LoRaDataRate_t dataRate, uint8_t payloadSize);
+void LoRa_GetAirtime(LoRaAirtime_t * stats);
 LoRaStatus_t LoRa_SendLppBuffer(LPP_Buffer_t b, bool ackNoAck);
+bool LoRa_GetDownlink(LoRaDownlink_t * downlink);
+LoRaStatus_t LoRa_SetDataRate(LoRaDataRate_t dataRate);
+LoRaDataRate_t LoRa_GetDataRate(void);
+LoRaStatus_t LoRa_SetPower(uint8_t power);
+LoRaStatus_t LoRa_SetLinkCheck(uint16_t interval);
+bool LoRa_GetLinkCheck(LoRaLink_t * link);
 
 void LoRa_Sleep(uint32_t durationMs, volatile bool * wakeUp);
 LoRaStatus_t LoRa_WakeUp(void);
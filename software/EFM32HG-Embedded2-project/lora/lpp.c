@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file lpp.c
  * @brief Basic Low Power Payload (LPP) functionality.
- * @version 2.3
+ * @version 2.8
  * @author
  *   Geoffrey Ottoy@n
  *   Modified by Brecht Van Eeckhoudt
@@ -18,6 +18,11 @@
  *   @li v2.1: Added extra dbprint debugging statements.
  *   @li v2.2: Fixed suboptimal buffer logic causing lockups after some runtime.
  *   @li v2.3: Chanced logic to clear the buffer before going to sleep.
+ *   @li v2.4: Added cable loop levels to the measurements.
+ *   @li v2.5: Added method to add an error report.
+ *   @li v2.6: Added method to add a crash record.
+ *   @li v2.7: Replaced the `malloc`ed payload by static storage (`LPP_FreeBuffer` is gone).
+ *   @li v2.8: Added method to acknowledge a configuration downlink.
  *
  ******************************************************************************/
 
@@ -41,7 +46,7 @@
  */
 
 #include <em_device.h> /* Math functionality */
-#include <stdlib.h>    /* Memory functionality */
+#include <string.h>    /* memset */
 #include <stdint.h>    /* (u)intXX_t */
 #include <stdbool.h>   /* "bool", "true", "false" */
 
@@ -80,6 +85,13 @@
 #define LPP_STORM_CHANNEL           0x13 /* 19 */
 #define LPP_CABLE_BROKEN_CHANNEL    0x14 /* 20 */
 #define LPP_STATUS_CHANNEL          0x15 /* 21 */
+#define LPP_CABLE_LEVEL_CHANNEL     0x16 /* 22 */
+#define LPP_ERROR_REPORT_CHANNEL    0x17 /* 23 */
+#define LPP_CRASH_RECORD_CHANNEL    0x18 /* 24 */
+#define LPP_CONFIG_ACK_CHANNEL      0x19 /* 25 */
+
+/* Storage for the payload, only one LPP buffer (`appData`) is filled at a time */
+static uint8_t lppStorage[LPP_MAX_PAYLOAD];
 
 bool LPP_InitBuffer(LPP_Buffer_t *b, uint8_t size)
 {
@@ -88,16 +100,10 @@ bool LPP_InitBuffer(LPP_Buffer_t *b, uint8_t size)
 	dbinfo("Started initializing LPP buffer...");
 #endif /* DEBUG_DBPRINT */
 
-	// LPP_FreeBuffer(b); // Before: LPP_ClearBuffer(b);
-
-	b->buffer = (uint8_t *) malloc(sizeof(uint8_t) * size);
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-	dbinfo("> Memory allocated.");
-#endif /* DEBUG_DBPRINT */
-
-	if(b->buffer != NULL)
+	/* No heap: the payload is put in the static storage */
+	if(size <= LPP_MAX_PAYLOAD)
 	{
+		b->buffer = lppStorage;
 		b->fill = 0;
 		b->length = size;
 
@@ -126,16 +132,6 @@ void LPP_ClearBuffer(LPP_Buffer_t *b)
 
 }
 
-void LPP_FreeBuffer(LPP_Buffer_t *b)
-{
-    if (b->buffer != NULL) free(b->buffer); /* This logic was previously in `LPP_ClearBuffer` */
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-	dbinfo("> LPP buffer freed.");
-#endif /* DEBUG_DBPRINT */
-
-}
-
 /**************************************************************************//**
  * @brief
  *   Add measurement data to the LPP packet following the *custom message
@@ -159,8 +155,12 @@ void LPP_FreeBuffer(LPP_Buffer_t *b)
  *     - **byte 15-16:** An external temperature measurement
  *     - **byte 17-18:** Another external temperature measurement (in the case of `2` measurements)
  *     - ...
+ *     - **byte 19:** Cable level channel (`LPP_CABLE_LEVEL_CHANNEL = 0x16`)
+ *     - **byte 20:** LPP digital input type (`LPP_DIGITAL_INPUT = 0x00`)
+ *     - **byte 21:** A cable loop level (`0` = short, `63` = open)
+ *     - **byte 22:** Another cable loop level (in the case of `2` measurements)
  *
- *   If we have **6 measurements** we need **43 bytes**:
+ *   If we have **6 measurements** we need **51 bytes**:
  *     - `1 byte` to hold the amount of measurements
  *     - `2 bytes` to hold the battery voltage channel and LPP analog input type
  *     - `6*2bytes` to hold the battery voltage measurements
@@ -168,6 +168,10 @@ void LPP_FreeBuffer(LPP_Buffer_t *b)
  *     - `6*2bytes` to hold the internal temperature measurements
  *     - `2 bytes` to hold the external temperature channel and LPP temperature type
  *     - `6*2bytes` to hold the external temperature measurements
+ *     - `2 bytes` to hold the cable level channel and LPP digital input type
+ *     - `6*1byte` to hold the cable loop levels
+ *
+ *   @note 51 bytes is the maximum payload size for SF10 (`DEFAULT_DATA_RATE`).
  *
  * @param[in] b
  *   The pointer to the LPP pointer.
@@ -195,6 +199,9 @@ bool LPP_AddMeasurements (LPP_Buffer_t *b, MeasurementData_t data)
 	 * (1 byte for the channel ID, 1 byte for the data type, 2 bytes for each measurement) */
 	necessarySpace += 3*(2+(2*(data.index)));
 
+	/* Add space necessary for the cable loop levels (1 byte for the channel ID, 1 byte for the data type, 1 byte for each measurement) */
+	necessarySpace += 2+data.index;
+
 	/* Return `false` if we don't have the necessary space available */
 	if (space < necessarySpace) return (false);
 
@@ -240,6 +247,15 @@ bool LPP_AddMeasurements (LPP_Buffer_t *b, MeasurementData_t data)
 		b->buffer[b->fill++] = (uint8_t)(0x00FF & extTempLPP);
 	}
 
+	/* Fill the next bytes with cable loop levels */
+	b->buffer[b->fill++] = LPP_CABLE_LEVEL_CHANNEL;
+	b->buffer[b->fill++] = LPP_DIGITAL_INPUT;
+
+	for (uint8_t i = 0; i < data.index; i++)
+	{
+		b->buffer[b->fill++] = data.cableLevel[i];
+	}
+
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
 	dbinfo("Measurements successfully added.");
 #endif /* DEBUG_DBPRINT */
@@ -300,7 +316,7 @@ bool LPP_AddStormDetected (LPP_Buffer_t *b, uint8_t stormDetected)
  *     - **byte 0:** Amount of measurements (in this case always one)
  *     - **byte 1:** *Cable broken* channel (`LPP_CABLE_BROKEN_CHANNEL = 0x14`)
  *     - **byte 2:** LPP digital input type (`LPP_DIGITAL_INPUT = 0x00`)
- *     - **byte 3:** The `cableBroken` value
+ *     - **byte 3:** The `cableBroken` value (`CABLE_BROKEN = 1` or `CABLE_DEGRADED = 2`, see `cable.h`)
  *
  *   **We always need 4 bytes.**
  *
@@ -376,6 +392,154 @@ bool LPP_AddStatus (LPP_Buffer_t *b, uint8_t status)
 	return (true);
 }
 
+/**************************************************************************//**
+ * @brief
+ *   Add a crash record to the LPP packet following the *custom message
+ *   convention*, **after** a status value added with `LPP_AddStatus`.
+ *
+ * @details
+ *   This is what each added byte represents (no extra "amount" byte since
+ *   the record gets sent along with a status value):
+ *     - **byte 0:** *Crash record* channel (`LPP_CRASH_RECORD_CHANNEL = 0x18`)
+ *     - **byte 1:** LPP digital input type (`LPP_DIGITAL_INPUT = 0x00`)
+ *     - **byte 2:** Type of crash (`FAULT_xxx` in `fault.h`)
+ *     - **byte 3:** State of the state machine when it happened
+ *     - **byte 4:** Error number (in the case of `FAULT_ERROR`)
+ *     - **byte 5-8:** Stacked program counter (MSB first)
+ *     - **byte 9-12:** Stacked link register (MSB first)
+ *     - **byte 13-16:** Stacked program status register (MSB first)
+ *
+ *   **We always need 17 bytes.**
+ *
+ * @param[in] b
+ *   The pointer to the LPP pointer.
+ *
+ * @param[in] record
+ *   The crash record.
+ *
+ * @return
+ *   @li `true` - Successfully added the data to the LoRaWAN packet.
+ *   @li `false` - Couldn't add the data to the LoRaWAN packet.
+ *****************************************************************************/
+bool LPP_AddCrashRecord (LPP_Buffer_t *b, CrashRecord_t record)
+{
+	/* Calculate free space in the buffer */
+	uint8_t space = b->length - b->fill;
+
+	/* Return `false` if we don't have the necessary space available */
+	if (space < 17) return (false);
+
+	b->buffer[b->fill++] = LPP_CRASH_RECORD_CHANNEL;
+	b->buffer[b->fill++] = LPP_DIGITAL_INPUT;
+	b->buffer[b->fill++] = record.type;
+	b->buffer[b->fill++] = record.state;
+	b->buffer[b->fill++] = record.number;
+
+	for (int8_t shift = 24; shift >= 0; shift -= 8) b->buffer[b->fill++] = (uint8_t)(record.pc >> shift);
+	for (int8_t shift = 24; shift >= 0; shift -= 8) b->buffer[b->fill++] = (uint8_t)(record.lr >> shift);
+	for (int8_t shift = 24; shift >= 0; shift -= 8) b->buffer[b->fill++] = (uint8_t)(record.xpsr >> shift);
+
+	return (true);
+}
+
+/**************************************************************************//**
+ * @brief
+ *   Add the acknowledgment of a configuration downlink to the LPP packet following
+ *   the *custom message convention*.
+ *
+ * @details
+ *   This is what each added byte represents:
+ *     - **byte 0:** Amount of measurements (in this case always one)
+ *     - **byte 1:** *Configuration acknowledgment* channel (`LPP_CONFIG_ACK_CHANNEL = 0x19`)
+ *     - **byte 2:** LPP digital input type (`LPP_DIGITAL_INPUT = 0x00`)
+ *     - **byte 3:** The result (`CONFIG_ACK_xxx` or the code of the rejected command, see `config.c`)
+ *
+ *   **We always need 4 bytes.**
+ *
+ * @param[in] b
+ *   The pointer to the LPP pointer.
+ *
+ * @param[in] result
+ *   The result of the configuration downlink.
+ *
+ * @return
+ *   @li `true` - Successfully added the data to the LoRaWAN packet.
+ *   @li `false` - Couldn't add the data to the LoRaWAN packet.
+ *****************************************************************************/
+bool LPP_AddConfigAck (LPP_Buffer_t *b, uint8_t result)
+{
+	/* Calculate free space in the buffer */
+	uint8_t space = b->length - b->fill;
+
+	/* Return `false` if we don't have the necessary space available */
+	if (space < LPP_DIGITAL_INPUT_SIZE + 1) return (false); /* "+1": One extra byte for the amount of measurements */
+
+	/* Fill the first byte with the amount of measurements (in this case always one) */
+	b->buffer[b->fill++] = 0x01;
+
+	b->buffer[b->fill++] = LPP_CONFIG_ACK_CHANNEL;
+	b->buffer[b->fill++] = LPP_DIGITAL_INPUT;
+	b->buffer[b->fill++] = result;
+
+	return (true);
+}
+
+/**************************************************************************//**
+ * @brief
+ *   Add the accumulated errors to the LPP packet following the *custom message
+ *   convention*.
+ *
+ * @details
+ *   This is what each added byte represents:
+ *     - **byte 0:** Amount of records
+ *     - **byte 1:** *Error report* channel (`LPP_ERROR_REPORT_CHANNEL = 0x17`)
+ *     - **byte 2:** LPP digital input type (`LPP_DIGITAL_INPUT = 0x00`)
+ *     - **byte 3-18:** Bitmap of the called error numbers (bit 0 of byte 3 = `error(0)`)
+ *     - **byte 19:** Error number of the first record
+ *     - **byte 20:** Amount of calls (saturates at 255)
+ *     - **byte 21:** Measurement cycles ago since the first call (saturates at 255)
+ *     - **byte 22:** Measurement cycles ago since the last call (saturates at 255)
+ *     - ... (4 bytes for each other record)
+ *
+ *   We need **19 + 4*records bytes**, so **51 bytes** for the maximum of 8 records.
+ *
+ * @param[in] b
+ *   The pointer to the LPP pointer.
+ *
+ * @param[in] report
+ *   The struct which contains the accumulated errors.
+ *
+ * @return
+ *   @li `true` - Successfully added the data to the LoRaWAN packet.
+ *   @li `false` - Couldn't add the data to the LoRaWAN packet.
+ *****************************************************************************/
+bool LPP_AddErrorReport (LPP_Buffer_t *b, ErrorReport_t report)
+{
+	/* Calculate free space in the buffer */
+	uint8_t space = b->length - b->fill;
+
+	/* Return `false` if we don't have the necessary space available */
+	if (space < (19 + 4*report.amount)) return (false);
+
+	/* Fill the first byte with the amount of records */
+	b->buffer[b->fill++] = report.amount;
+
+	b->buffer[b->fill++] = LPP_ERROR_REPORT_CHANNEL;
+	b->buffer[b->fill++] = LPP_DIGITAL_INPUT;
+
+	for (uint8_t i = 0; i < 16; i++) b->buffer[b->fill++] = report.bitmap[i];
+
+	for (uint8_t i = 0; i < report.amount; i++)
+	{
+		b->buffer[b->fill++] = report.records[i].number;
+		b->buffer[b->fill++] = report.records[i].count;
+		b->buffer[b->fill++] = report.records[i].first;
+		b->buffer[b->fill++] = report.records[i].last;
+	}
+
+	return (true);
+}
+
 /**************************************************************************//**
  * @brief
  *   Add a battery voltage measurement to the LPP packet, disguised as an
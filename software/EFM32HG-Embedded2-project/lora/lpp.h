@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file lpp.h
  * @brief Basic Low Power Payload (LPP) functionality.
- * @version 2.3
+ * @version 2.8
  * @author
  *   Geoffrey Ottoy@n
  *   Modified by Brecht Van Eeckhoudt
@@ -35,6 +35,10 @@
 
 #include "datatypes.h" /* Definitions of the custom data-types */
 
+/* Size of the static payload storage, the largest payload (51 bytes, `LPP_AddMeasurements`)
+ * is also the maximum for SF12 - SF10 */
+#define LPP_MAX_PAYLOAD 51
+
 typedef struct lpp_buffer
 {
 	uint8_t * buffer;
@@ -44,12 +48,14 @@ typedef struct lpp_buffer
 
 bool LPP_InitBuffer(LPP_Buffer_t * b, uint8_t size);
 void LPP_ClearBuffer(LPP_Buffer_t *b);
-void LPP_FreeBuffer(LPP_Buffer_t *b);
 
 bool LPP_AddMeasurements (LPP_Buffer_t *b, MeasurementData_t data);
 bool LPP_AddStormDetected (LPP_Buffer_t *b, uint8_t stormDetected);
 bool LPP_AddCableBroken (LPP_Buffer_t *b, uint8_t cableBroken);
 bool LPP_AddStatus (LPP_Buffer_t *b, uint8_t status);
+bool LPP_AddErrorReport (LPP_Buffer_t *b, ErrorReport_t report);
+bool LPP_AddCrashRecord (LPP_Buffer_t *b, CrashRecord_t record);
+bool LPP_AddConfigAck (LPP_Buffer_t *b, uint8_t result);
 
 bool LPP_deprecated_AddVBAT (LPP_Buffer_t *b, int16_t vbat);
 bool LPP_deprecated_AddIntTemp (LPP_Buffer_t *b, int16_t intTemp);
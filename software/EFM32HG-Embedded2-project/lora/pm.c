@@ -1,3 +1,23 @@
+/***************************************************************************//**
+ * @file pm.c
+ * @brief Reference counted power rails, shared clocks and HFRCO band selection.
+ * @version 2.1
+ * @author
+ *   Geoffrey Ottoy@n
+ *   Modified by Brecht Van Eeckhoudt
+ *
+ * ******************************************************************************
+ *
+ * @section Versions
+ *
+ *   @li v1.0: DRAMCO GitHub version (https://github.com/DRAMCO/EFM32-RN2483-LoRa-Node).
+ *   @li v2.0: Added reference counts per rail and per clock, warm-up times which
+ *             run in parallel (see `PM_WaitReady`), the on-time of each rail and
+ *             the accelerometer and temperature sensor rails.
+ *   @li v2.1: Added HFRCO band (and HFPER prescaler) selection per workload phase.
+ *
+ ******************************************************************************/
+
 /*  ____  ____      _    __  __  ____ ___
  * |  _ \|  _ \    / \  |  \/  |/ ___/ _ \
  * | | | | |_) |  / _ \ | |\/| | |  | | | |
@@ -12,66 +32,376 @@
  *
  *         File: pm.c
  *      Created: 2018-03-21
- *       Author: Geoffrey Ottoy
+ *       Author: Geoffrey Ottoy - Modified by Brecht Van Eeckhoudt
  *
  *  Description: Power management functions. Allows you to enable/disable
- *  	certain subsystems of the LoRa extension board.
+ *  	certain subsystems of the LoRa extension board and the sensors.
  */
 
-#include <em_gpio.h>
 
-#include "pm.h"          /* Corresponding header file */
-#include "delay.h"       /* Delay functionality */
-#include "pin_mapping.h" /* PORT and PIN definitions */
+#include <stdint.h>        /* (u)intXX_t */
+#include <stdbool.h>       /* "bool", "true", "false" */
+#include <stddef.h>        /* NULL */
+#include "em_cmu.h"        /* Clock management unit */
+#include "em_gpio.h"       /* General Purpose IO */
+#include "em_usart.h"      /* Universal synchr./asynchr. receiver/transmitter (dbprint baudrate) */
+
+#include "pm.h"            /* Corresponding header file */
+#include "delay.h"         /* Delay functionality */
+#include "pin_mapping.h"   /* PORT and PIN definitions */
+#include "debug_dbprint.h" /* Enable or disable printing to UART for debugging */
+
+
+/* Local definitions */
+/** Definition of a power rail, `warmUp` is the time in milliseconds before the powered device can be used */
+typedef struct pm_rails{
+	bool available;
+	GPIO_Port_TypeDef port;
+	uint8_t pin;
+	uint16_t warmUp;
+} PM_Rail_t;
+
+/** Definition of a HFRCO band and the HFPER prescaler used with it */
+typedef struct pm_band_configs{
+	CMU_HFRCOBand_TypeDef band;
+	CMU_ClkDiv_TypeDef hfperDiv;
+} PM_BandConfig_t;
+
+/** Maximum amount of methods to call after a band change */
+#define PM_LISTENERS 4
+
+/** Baudrate of dbprint (`USART_INITASYNC_DEFAULT`) */
+#define DBPRINT_BAUDRATE 115200
+
+
+/* Local variables */
+/* The sensor rail on the Happy Gecko itself isn't available on this board */
+const PM_Rail_t rails[PM_ALL] = {
+	[PM_SENS_GECKO] = { false, gpioPortA,        0,               0   },
+	[PM_SENS_EXT]   = { true,  PM_SENS_EXT_PORT, PM_SENS_EXT_PIN, 40  },
+	[PM_RN2483]     = { true,  PM_RN2483_PORT,   PM_RN2483_PIN,   100 },
+	[PM_ADXL]       = { true,  ADXL_VDD_PORT,    ADXL_VDD_PIN,    40  },
+	[PM_DS18B20]    = { true,  TEMP_VDD_PORT,    TEMP_VDD_PIN,    5   }
+};
+
+uint8_t railRequests[PM_ALL];
+uint32_t railOnSince[PM_ALL];  /* RTC tick value when the rail was enabled */
+uint32_t railOnTicks[PM_ALL];  /* Total RTC ticks the rail was enabled before `railOnSince` */
+Timer_t railWarmUp[PM_ALL];    /* Expires when the powered device can be used */
+uint8_t clockRequests[PM_CLOCKS];
+
+const PM_BandConfig_t bands[PM_BANDS] = {
+	[PM_BAND_LOW]     = { cmuHFRCOBand_7MHz,  cmuClkDiv_1 },
+	[PM_BAND_DEFAULT] = { cmuHFRCOBand_14MHz, cmuClkDiv_1 },
+	[PM_BAND_HIGH]    = { cmuHFRCOBand_21MHz, cmuClkDiv_2 }
+};
 
+PM_Band_t currentBand = PM_BAND_DEFAULT;
+uint32_t bandSince = 0;         /* RTC tick value when the current band was selected */
+uint32_t bandTicks[PM_BANDS];   /* Total RTC ticks spent in each band before `bandSince` */
+void (*bandListeners[PM_LISTENERS])(void);
+
+
+/* Local prototypes */
+static void enableRail (PM_SubSystem_t pmss);
+static void disableRail (PM_SubSystem_t pmss);
+
+
+/**************************************************************************//**
+ * @brief
+ *   Initialize the pins of the power rails, all rails are disabled.
+ *****************************************************************************/
 void PM_Init(void){
-	//GPIO_PinModeSet(PM_SENS_GECKO_PORT, PM_SENS_GECKO_PIN, gpioModePushPull, 0);
-	GPIO_PinModeSet(PM_SENS_EXT_PORT, PM_SENS_EXT_PIN, gpioModePushPull, 0);
-	GPIO_PinModeSet(PM_RN2483_PORT, PM_RN2483_PIN, gpioModePushPull, 0);
+	PM_ClockRequest(PM_CLOCK_GPIO);
+
+	for (uint8_t i = 0; i < PM_ALL; i++)
+	{
+		if (rails[i].available && (railRequests[i] == 0)) GPIO_PinModeSet(rails[i].port, rails[i].pin, gpioModePushPull, 0);
+	}
+
+	PM_ClockRelease(PM_CLOCK_GPIO);
 }
 
+
+/**************************************************************************//**
+ * @brief
+ *   Request a power rail.
+ *
+ * @details
+ *   The rail is switched on by the first request, the warm-up time starts
+ *   counting at that moment but this method doesn't wait (see `PM_WaitReady`).
+ *   This way rails which are enabled together warm up at the same time.
+ *   A powered rail also holds the GPIO clock.
+ *
+ * @param[in] pmss
+ *   The rail to enable (`PM_ALL` enables all of them).
+ *****************************************************************************/
 void PM_Enable(PM_SubSystem_t pmss){
-	switch(pmss){
-		case PM_SENS_GECKO: {
-			//GPIO_PinOutSet(PM_SENS_GECKO_PORT, PM_SENS_GECKO_PIN);
-			//DelayMs(40); /* Give sensor time to power up */
-		} break;
-		case PM_SENS_EXT: {
-			GPIO_PinOutSet(PM_SENS_EXT_PORT, PM_SENS_EXT_PIN);
-			delay(40); /* Give sensor time to power up */
-		} break;
-		case PM_RN2483: {
-			GPIO_PinOutSet(PM_RN2483_PORT, PM_RN2483_PIN);
-		} break;
-		case PM_ALL: {
-			//GPIO_PinOutSet(PM_SENS_GECKO_PORT, PM_SENS_GECKO_PIN);
-			GPIO_PinOutSet(PM_SENS_EXT_PORT, PM_SENS_EXT_PIN);
-			delay(40); /* Give sensor time to power up */
-			GPIO_PinOutSet(PM_RN2483_PORT, PM_RN2483_PIN);
-		} break;
-		default: {
-			return;
-		}
+	if (pmss == PM_ALL)
+	{
+		for (uint8_t i = 0; i < PM_ALL; i++) enableRail((PM_SubSystem_t) i);
 	}
+	else if (pmss < PM_ALL) enableRail(pmss);
 }
 
+
+/**************************************************************************//**
+ * @brief
+ *   Release a power rail, the last release switches it off.
+ *
+ * @param[in] pmss
+ *   The rail to disable (`PM_ALL` disables all of them).
+ *****************************************************************************/
 void PM_Disable(PM_SubSystem_t pmss){
-	switch(pmss){
-		case PM_SENS_GECKO: {
-			//GPIO_PinOutClear(PM_SENS_GECKO_PORT, PM_SENS_GECKO_PIN);
-		} break;
-		case PM_SENS_EXT: {
-			GPIO_PinOutClear(PM_SENS_EXT_PORT, PM_SENS_EXT_PIN);
-		} break;
-		case PM_RN2483: {
-			GPIO_PinOutClear(PM_RN2483_PORT, PM_RN2483_PIN);
-		} break;
-		case PM_ALL: {
-			//GPIO_PinOutClear(PM_SENS_GECKO_PORT, PM_SENS_GECKO_PIN);
-			GPIO_PinOutClear(PM_SENS_EXT_PORT, PM_SENS_EXT_PIN);
-			GPIO_PinOutClear(PM_RN2483_PORT, PM_RN2483_PIN);
-		} break;
-		default: {
-		} break;
+	if (pmss == PM_ALL)
+	{
+		for (uint8_t i = 0; i < PM_ALL; i++) disableRail((PM_SubSystem_t) i);
 	}
+	else if (pmss < PM_ALL) disableRail(pmss);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Wait until the warm-up time of a rail has passed.
+ *
+ * @details
+ *   The MCU sleeps for the remaining warm-up time, if the rail has been on
+ *   long enough this method returns immediately.
+ *
+ * @param[in] pmss
+ *   The rail to wait on (`PM_ALL` waits on all enabled rails).
+ *****************************************************************************/
+void PM_WaitReady(PM_SubSystem_t pmss){
+	for (uint8_t i = 0; i < PM_ALL; i++)
+	{
+		if (((pmss == PM_ALL) || (pmss == i)) && (railRequests[i] > 0))
+		{
+			waitForFlag(&railWarmUp[i].expired, rails[i].warmUp, true);
+		}
+	}
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Get the total time a rail has been enabled.
+ *
+ * @param[in] pmss
+ *   The rail.
+ *
+ * @return
+ *   The on-time in milliseconds since boot.
+ *****************************************************************************/
+uint32_t PM_GetOnTime(PM_SubSystem_t pmss){
+	if (pmss >= PM_ALL) return (0);
+
+	uint32_t ticks = railOnTicks[pmss];
+
+	if (railRequests[pmss] > 0) ticks += RTC_getTicks() - railOnSince[pmss];
+
+	return ((uint32_t)(((uint64_t)ticks * 1000) / RTC_secondsToTicks(1)));
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Request a clock shared by multiple modules.
+ *
+ * @details
+ *   Modules which keep using the clock (for example for GPIO interrupts)
+ *   request it once and never release it.
+ *
+ * @param[in] clock
+ *   The clock to enable.
+ *****************************************************************************/
+void PM_ClockRequest(PM_Clock_t clock){
+	if (clock >= PM_CLOCKS) return;
+
+	if (clock == PM_CLOCK_GPIO) PM_ClockRequest(PM_CLOCK_HFPER); /* GPIO is a High Frequency Peripheral */
+
+	if (clockRequests[clock]++ == 0)
+	{
+		if (clock == PM_CLOCK_HFPER) CMU_ClockEnable(cmuClock_HFPER, true);
+		else CMU_ClockEnable(cmuClock_GPIO, true);
+	}
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Release a clock shared by multiple modules, the last release disables it.
+ *
+ * @param[in] clock
+ *   The clock to release.
+ *****************************************************************************/
+void PM_ClockRelease(PM_Clock_t clock){
+	if ((clock >= PM_CLOCKS) || (clockRequests[clock] == 0)) return;
+
+	if (--clockRequests[clock] == 0)
+	{
+		if (clock == PM_CLOCK_HFPER) CMU_ClockEnable(cmuClock_HFPER, false);
+		else CMU_ClockEnable(cmuClock_GPIO, false);
+	}
+
+	if (clock == PM_CLOCK_GPIO) PM_ClockRelease(PM_CLOCK_HFPER);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Select the HFRCO band for the next workload phase.
+ *
+ * @details
+ *   Code which mostly waits on peripherals in EM1 runs cheaper at a low band
+ *   (the EM1 current scales with the frequency), short bursts of computation
+ *   finish faster at a high band (the HFRCO is off in EM2/3 anyway).
+ *   The HFPER prescaler is changed first when going up and last when going
+ *   down so the peripherals never run faster than in both bands. Afterwards
+ *   the dbprint baudrate is corrected and the registered listeners are called
+ *   (ADC prescaler, SPI baudrate, ...). Delays calculate their timing with
+ *   the current frequency so they don't need to be notified.
+ *
+ * @param[in] band
+ *   The band to select.
+ *
+ * @return
+ *   The previous band, to restore it after the phase.
+ *****************************************************************************/
+PM_Band_t PM_SetBand(PM_Band_t band){
+	PM_Band_t previous = currentBand;
+
+	if ((band >= PM_BANDS) || (band == currentBand)) return (previous);
+
+	uint32_t now = RTC_getTicks();
+	bandTicks[currentBand] += now - bandSince;
+	bandSince = now;
+
+	if (band > currentBand)
+	{
+		CMU_ClockDivSet(cmuClock_HFPER, bands[band].hfperDiv);
+		CMU_HFRCOBandSet(bands[band].band); /* Also updates the flash wait states and `SystemCoreClock` */
+	}
+	else
+	{
+		CMU_HFRCOBandSet(bands[band].band);
+		CMU_ClockDivSet(cmuClock_HFPER, bands[band].hfperDiv);
+	}
+
+	currentBand = band;
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	USART_BaudrateAsyncSet(DBG_UART, 0, DBPRINT_BAUDRATE, usartOVS16);
+#endif /* DEBUG_DBPRINT */
+
+	for (uint8_t i = 0; i < PM_LISTENERS; i++)
+	{
+		if (bandListeners[i] != NULL) bandListeners[i]();
+	}
+
+	return (previous);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Register a method to reconfigure a peripheral after a band change.
+ *
+ * @details
+ *   Registering the same method again doesn't do anything.
+ *
+ * @param[in] callback
+ *   The method to call after each band change.
+ *****************************************************************************/
+void PM_AddBandListener(void (*callback)(void)){
+	for (uint8_t i = 0; i < PM_LISTENERS; i++)
+	{
+		if (bandListeners[i] == callback) return;
+
+		if (bandListeners[i] == NULL)
+		{
+			bandListeners[i] = callback;
+			return;
+		}
+	}
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbcrit("No room for another band listener!");
+#endif /* DEBUG_DBPRINT */
+
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Get the total time a HFRCO band has been selected.
+ *
+ * @details
+ *   This also includes the time the MCU slept while the band was selected.
+ *
+ * @param[in] band
+ *   The band.
+ *
+ * @return
+ *   The time in milliseconds since boot.
+ *****************************************************************************/
+uint32_t PM_GetBandTime(PM_Band_t band){
+	if (band >= PM_BANDS) return (0);
+
+	uint32_t ticks = bandTicks[band];
+
+	if (band == currentBand) ticks += RTC_getTicks() - bandSince;
+
+	return ((uint32_t)(((uint64_t)ticks * 1000) / RTC_secondsToTicks(1)));
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Add a request for a rail, switch it on and start the warm-up if it's the first one.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] pmss
+ *   The rail to enable.
+ *****************************************************************************/
+static void enableRail (PM_SubSystem_t pmss){
+	if (!rails[pmss].available) return;
+
+	if (railRequests[pmss]++ > 0) return;
+
+	PM_ClockRequest(PM_CLOCK_GPIO);
+
+	/* In the case of gpioModePushPull, the last argument directly sets the pin state */
+	GPIO_PinModeSet(rails[pmss].port, rails[pmss].pin, gpioModePushPull, 1);
+
+	railOnSince[pmss] = RTC_getTicks();
+	TIMER_start(&railWarmUp[pmss], rails[pmss].warmUp, false, NULL);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Remove a request for a rail and switch it off if it was the last one.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] pmss
+ *   The rail to disable.
+ *****************************************************************************/
+static void disableRail (PM_SubSystem_t pmss){
+	if (!rails[pmss].available || (railRequests[pmss] == 0)) return;
+
+	if (--railRequests[pmss] > 0) return;
+
+	GPIO_PinOutClear(rails[pmss].port, rails[pmss].pin);
+
+	TIMER_stop(&railWarmUp[pmss]);
+	railOnTicks[pmss] += RTC_getTicks() - railOnSince[pmss];
+
+	PM_ClockRelease(PM_CLOCK_GPIO);
 }
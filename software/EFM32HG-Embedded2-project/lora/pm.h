@@ -12,7 +12,7 @@
  *
  *         File: pm.h
  *      Created: 2018-03-21
- *       Author: Geoffrey Ottoy
+ *       Author: Geoffrey Ottoy - Modified by Brecht Van Eeckhoudt
  *
  *  Description: Header file for pm.c
  */
@@ -20,17 +20,52 @@
 #ifndef _PM_H_
 #define _PM_H_
 
+#include <stdint.h>  /* (u)intXX_t */
+#include <stdbool.h> /* "bool", "true", "false" */
+
+/** Power rails, `PM_ALL` selects all of them */
 typedef enum PM_subsystems{
 	PM_SENS_GECKO,
 	PM_SENS_EXT,
 	PM_RN2483,
+	PM_ADXL,
+	PM_DS18B20,
 	PM_ALL
 } PM_SubSystem_t;
 
+/** HFRCO bands for the workload phases (see `PM_SetBand`) */
+typedef enum PM_bands{
+	PM_BAND_LOW,     /* 7 MHz, waiting on peripherals in EM1 */
+	PM_BAND_DEFAULT, /* 14 MHz (reset value) */
+	PM_BAND_HIGH,    /* 21 MHz with HFPER at 10.5 MHz, bursts of computation */
+	PM_BANDS
+} PM_Band_t;
+
+/** Clocks shared by multiple modules */
+typedef enum PM_clocks{
+	PM_CLOCK_HFPER,
+	PM_CLOCK_GPIO, /* Also requests HFPER */
+	PM_CLOCKS
+} PM_Clock_t;
+
 void PM_Init(void);
 
 void PM_Enable(PM_SubSystem_t pmss);
 
 void PM_Disable(PM_SubSystem_t pmss);
 
+void PM_WaitReady(PM_SubSystem_t pmss);
+
+uint32_t PM_GetOnTime(PM_SubSystem_t pmss);
+
+void PM_ClockRequest(PM_Clock_t clock);
+
+void PM_ClockRelease(PM_Clock_t clock);
+
+PM_Band_t PM_SetBand(PM_Band_t band);
+
+void PM_AddBandListener(void (*callback)(void));
+
+uint32_t PM_GetBandTime(PM_Band_t band);
+
 #endif /* _PM_H_ */
@@ -22,7 +22,6 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <em_device.h>
 #include <em_chip.h>
 #include <em_cmu.h>
@@ -35,94 +34,237 @@
 #include "rn2483.h"      /* RN2483_xxxx */
 
 #include "delay.h"       /* Delay functionality */
+#include "pm.h"          /* Power rails */
 #include "pin_mapping.h" /* PORT and PIN definitions */
 #include "util_string.h" /* Utility functionality regarding strings */
 
 
+/* Maximum waiting times of the command engine in milliseconds */
+#define ENGINE_TIMEOUT_MS        1000
+#define ENGINE_TIMEOUT_SECOND_MS 10000 /* Depends on spreading factor! (the RX2 window of a join is 6 s after TX) */
+
+#define RN2483_SETUP_COMMANDS    12
+
 char commandBuffer[RN2483_COMMANDBUFFER_SIZE];
 
+/* Command engine */
+static const RN2483_Command_t * engineCommands;
+static uint8_t engineCount;
+static uint8_t engineIndex;
+static bool engineSecond;
+static char * engineBuffer;
+static uint8_t engineBufferSize;
+static void (*engineCallback)(RN2483_Status_t status);
+static volatile bool engineDone = true;
+static RN2483_Status_t engineStatus;
+static Timer_t engineTimeout;
+
+/* Setup sequence, kept here because the engine runs after RN2483_SetupAsync returns */
+static RN2483_Command_t setupCommands[RN2483_SETUP_COMMANDS];
+static char powerArgument[4];
+static char dataRateArgument[4];
+static char linkCheckArgument[6];
+
+/* Last received downlink */
+static LoRaDownlink_t downlink;
+static volatile bool downlinkPending = false;
+
+/* Response tables, the prefix lengths are calculated at compile time */
+typedef struct{
+	const char * prefix;
+	uint8_t length;
+	RN2483_Status_t status;
+}RN2483_Response_t;
+
+#define RESPONSE(prefix, status) {prefix, sizeof(prefix) - 1, status}
+#define RESPONSES(table) (sizeof(table) / sizeof(table[0]))
+
+static const RN2483_Response_t firstResponses[] = {
+	RESPONSE("ok", MAC_OK),
+	RESPONSE("invalid_param", INVALID_PARAM),
+	RESPONSE("invalid_data_len", INVALID_DATA_LEN),
+	RESPONSE("not_joined", NOT_JOINED),
+	RESPONSE("no_free_ch", NO_FREE_CH),
+	RESPONSE("silent", SILENT),
+	RESPONSE("frame_counter_err_rejoin_needed", FRAME_COUNTER_ERR_REJOIN_NEEDED),
+	RESPONSE("busy", BUSY),
+	RESPONSE("mac_paused", MAC_PAUSED),
+	RESPONSE("keys_not_init", KEYS_NOT_INIT)
+};
+
+static const RN2483_Response_t secondResponses[] = {
+	RESPONSE("accepted", JOIN_ACCEPTED),
+	RESPONSE("denied", JOIN_DENIED),
+	RESPONSE("mac_tx_ok", MAC_TX_OK),
+	RESPONSE("mac_rx", MAC_RX),
+	RESPONSE("mac_err", MAC_ERR),
+	RESPONSE("invalid_data_len", INVALID_DATA_LEN),
+	RESPONSE("radio_tx_ok", RADIO_TX_OK),
+	RESPONSE("radio_err", RADIO_ERR)
+};
+
+/* The response is parsed where it was received, the copy is only for callers that use the returned data */
+static const char * RN2483_ReadResponse(char * receiveBuffer, uint8_t bufferSize){
+	const char * response = Leuart_GetResponse();
+	strncpy(receiveBuffer, response, bufferSize - 1);
+	receiveBuffer[bufferSize - 1] = '\0';
+	return (response);
+}
+
+/* Store the data of "mac_rx <port> <data>" (port in decimal, data as hex) for LoRa_GetDownlink */
+static void RN2483_CaptureDownlink(const char * arguments){
+	uint8_t port = 0;
+	while((*arguments >= '0') && (*arguments <= '9')){
+		port = (port * 10) + (*arguments++ - '0');
+	}
+	if(*arguments++ != ' '){
+		return;
+	}
+	downlink.port = port;
+	downlink.length = HexToBin(arguments, downlink.data, LORA_DOWNLINK_SIZE);
+	downlinkPending = true;
+}
+
+/* The first character rejects most entries, only the candidates are compared further */
+static RN2483_Status_t RN2483_MatchResponse(const RN2483_Response_t * table, uint8_t count, const char * response, RN2483_Status_t unknown){
+	for(uint8_t i = 0; i < count; i++){
+		if((response[0] == table[i].prefix[0]) && (strncmp(response, table[i].prefix, table[i].length) == 0)){
+			return (table[i].status);
+		}
+	}
+	return (unknown);
+}
+
+static RN2483_Status_t RN2483_ParseResponse(const char * response, bool secondResponse){
+	if(secondResponse){
+		RN2483_Status_t status = RN2483_MatchResponse(secondResponses, RESPONSES(secondResponses), response, UNKOWN_ERR);
+		if(status == MAC_RX){
+			RN2483_CaptureDownlink(response + sizeof("mac_rx ") - 1);
+		}
+		return (status);
+	}
+	return (RN2483_MatchResponse(firstResponses, RESPONSES(firstResponses), response, DATA_RETURNED));
+}
+
 static RN2483_Status_t RN2483_ProcessMacCommand(char * receiveBuffer, uint8_t bufferSize, bool secondResponse){
 	volatile bool dummy = false;
 	if(Leuart_SendCommand(commandBuffer, strlen(commandBuffer), &dummy) == TX_TIMEOUT){
 		return (RN_TX_TIMEOUT);
 	}
 
-	/* Read first response */
-	Leuart_ReadResponse(receiveBuffer, bufferSize);
-
-	/* Analyze response */
-	if(StringStartsWith(receiveBuffer, "ok")){
-		if(secondResponse){
-			/* Wait for second response */
-			Leuart_WaitForResponse(receiveBuffer, bufferSize);
-			/* Read second response */
-			Leuart_ReadResponse(receiveBuffer, bufferSize);
-			/* Analyze response */
-			if(StringStartsWith(receiveBuffer, "accepted")){
-				return (JOIN_ACCEPTED);
-			} else if(StringStartsWith(receiveBuffer, "denied")){
-				return (JOIN_DENIED);
-			} else if(StringStartsWith(receiveBuffer, "mac_tx_ok")){
-				return (MAC_TX_OK);
-			} else if(StringStartsWith(receiveBuffer, "mac_rx")){
-				// TODO: capture data
-				return (MAC_RX);
-			} else if(StringStartsWith(receiveBuffer, "mac_err")){
-				return (MAC_ERR);
-			} else if(StringStartsWith(receiveBuffer, "invalid_data_len")){
-				return (INVALID_DATA_LEN);
-			} else if(StringStartsWith(receiveBuffer, "radio_tx_ok")){
-				return (RADIO_TX_OK);
-			} else if(StringStartsWith(receiveBuffer, "radio_err")){
-				return (RADIO_ERR);
-			}
-			return (UNKOWN_ERR);
-		} else {
-			return (MAC_OK);
+	/* Read and analyze first response */
+	RN2483_Status_t status = RN2483_ParseResponse(RN2483_ReadResponse(receiveBuffer, bufferSize), false);
+
+	if((status == MAC_OK) && secondResponse){
+		/* Wait for second response */
+		if(Leuart_WaitForResponse() == RX_TIMEOUT){
+			return (RN_RX_TIMEOUT);
 		}
+		/* Read and analyze second response */
+		return (RN2483_ParseResponse(RN2483_ReadResponse(receiveBuffer, bufferSize), true));
 	}
-	else if(StringStartsWith(receiveBuffer, "invalid_param")){
-		return (INVALID_PARAM);
-	} else if(StringStartsWith(receiveBuffer, "not_joined")){
-		return (NOT_JOINED);
-	} else if(StringStartsWith(receiveBuffer, "no_free_ch")){
-		return (NO_FREE_CH);
-	} else if(StringStartsWith(receiveBuffer, "silent")){
-		return (SILENT);
-	} else if(StringStartsWith(receiveBuffer, "frame_counter_err_rejoin_needed")){
-		return (FRAME_COUNTER_ERR_REJOIN_NEEDED);
-	} else if(StringStartsWith(receiveBuffer, "busy")){
-		return (BUSY);
-	} else if(StringStartsWith(receiveBuffer, "mac_paused")){
-		return (MAC_PAUSED);
-	} else if(StringStartsWith(receiveBuffer, "invalid_data_len")){
-		return (INVALID_DATA_LEN);
+
+	return (status);
+}
+
+/* Commands expecting one of these get an "ok" first and the final response later */
+static bool RN2483_HasSecondResponse(RN2483_Status_t expected){
+	return ((expected == JOIN_ACCEPTED) || (expected == MAC_TX_OK) || (expected == MAC_RX) || (expected == RADIO_TX_OK));
+}
+
+static void RN2483_EngineFinish(RN2483_Status_t status){
+	TIMER_stop(&engineTimeout);
+	Leuart_SetResponseCallback(NULL);
+	engineStatus = status;
+	engineDone = true;
+	if(engineCallback != NULL){
+		engineCallback(status);
 	}
+}
 
-	return (DATA_RETURNED);
+static void RN2483_EngineTimedOut(void){ /* RTC interrupt handler */
+	RN2483_EngineFinish(RN_RX_TIMEOUT);
 }
 
-static RN2483_Status_t RN2483_ProcessSleepCommand(char * receiveBuffer, uint8_t bufferSize, volatile bool * wakeUp){
-	if(Leuart_SendCommand(commandBuffer, strlen(commandBuffer), wakeUp) == TX_TIMEOUT){
-		return (RN_TX_TIMEOUT);
+static void RN2483_EngineSend(void){
+	const RN2483_Command_t * command = &engineCommands[engineIndex];
+	if(command->argument != NULL){
+		snprintf(commandBuffer, RN2483_COMMANDBUFFER_SIZE, "%s %s\r\n", command->command, command->argument);
+	}else{
+		snprintf(commandBuffer, RN2483_COMMANDBUFFER_SIZE, "%s\r\n", command->command);
 	}
+	engineSecond = false;
+	TIMER_start(&engineTimeout, ENGINE_TIMEOUT_MS, false, RN2483_EngineTimedOut);
+	Leuart_SendAsync(commandBuffer, strlen(commandBuffer));
+}
 
-	/* Read first response */
-	Leuart_ReadResponse(receiveBuffer, bufferSize);
+static void RN2483_EngineResponse(void){ /* LEUART (line received) interrupt handler */
+	RN2483_Status_t expected = engineCommands[engineIndex].expected;
 
-	/* Analyze response */
-	if(StringStartsWith(receiveBuffer, "ok")){
-		return (MAC_OK);
-	} else if(StringStartsWith(receiveBuffer, "invalid_param")){
-		return (INVALID_PARAM);
+	RN2483_Status_t status = RN2483_ParseResponse(RN2483_ReadResponse(engineBuffer, engineBufferSize), engineSecond);
+
+	if(!engineSecond && (status == MAC_OK) && RN2483_HasSecondResponse(expected)){
+		engineSecond = true;
+		TIMER_start(&engineTimeout, ENGINE_TIMEOUT_SECOND_MS, false, RN2483_EngineTimedOut);
+		return; /* The receive ring keeps running, the second response is the next line */
+	}
+
+	/* Stop at the first unexpected response */
+	if(status != expected){
+		RN2483_EngineFinish(status);
+		return;
+	}
+
+	engineIndex++;
+	if(engineIndex == engineCount){
+		RN2483_EngineFinish(status);
+	}else{
+		RN2483_EngineSend();
+	}
+}
+
+void RN2483_RunCommands(const RN2483_Command_t * commands, uint8_t count, char * receiveBuffer, uint8_t bufferSize, void (*callback)(RN2483_Status_t status)){
+	engineCommands = commands;
+	engineCount = count;
+	engineIndex = 0;
+	engineBuffer = receiveBuffer;
+	engineBufferSize = bufferSize;
+	engineCallback = callback;
+	engineDone = false;
+
+	if(count == 0){
+		RN2483_EngineFinish(MAC_OK);
+		return;
+	}
+
+	Leuart_ClearBuffers();
+	Leuart_SetResponseCallback(RN2483_EngineResponse);
+	RN2483_EngineSend();
+}
+
+bool RN2483_CommandsDone(void){
+	return (engineDone);
+}
+
+RN2483_Status_t RN2483_WaitCommands(void){
+	/* Sleep (EM1 with USART1, the HF clock needs to keep running), the engine times out by itself if the module doesn't answer */
+	while(!engineDone){
+		Leuart_WaitForFlag(&engineDone, ENGINE_TIMEOUT_SECOND_MS);
 	}
+	return (engineStatus);
+}
 
-	return (UNKOWN_ERR);
+/* The module only answers a sleep command when it wakes up, that response is read by RN2483_Wake */
+static RN2483_Status_t RN2483_ProcessSleepCommand(char * receiveBuffer, uint8_t bufferSize, volatile bool * wakeUp){
+	(void) wakeUp;
+	Leuart_ClearBuffers();
+	Leuart_SendData(commandBuffer, strlen(commandBuffer));
+	return (MAC_OK);
 }
 
 void RN2483_Init(void){ /* Setup with autobaud */
 	GPIO_PinModeSet(RN2483_TX_PORT, RN2483_TX_PIN, gpioModePushPull, 1);
-	delay(100);
+	PM_WaitReady(PM_RN2483); /* Power-up delay, doesn't wait if the rail was enabled earlier */
 	GPIO_PinModeSet(RN2483_RESET_PORT, RN2483_RESET_PIN, gpioModePushPull, 1);
 	delay(50);
 	GPIO_PinModeSet(RN2483_RESET_PORT, RN2483_RESET_PIN, gpioModePushPull, 0);
@@ -228,6 +370,70 @@ RN2483_Status_t RN2483_EnableAdaptiveDataRate(char * receiveBuffer, uint8_t buff
 	return (RN2483_ProcessMacCommand(receiveBuffer, bufferSize, false));
 }
 
+/* Every "mac tx" after `interval` seconds carries a Link Check request, 0 disables it */
+RN2483_Status_t RN2483_SetLinkCheck(uint16_t interval, char * receiveBuffer, uint8_t bufferSize){
+	sprintf(commandBuffer, "mac set linkchk %u\r\n", interval);
+	return (RN2483_ProcessMacCommand(receiveBuffer, bufferSize, false));
+}
+
+/* Demodulation margin (dB) of the last Link Check answer */
+RN2483_Status_t RN2483_GetMargin(uint8_t * margin, char * receiveBuffer, uint8_t bufferSize){
+	uint32_t value;
+	sprintf(commandBuffer, "mac get mrgn\r\n");
+	RN2483_Status_t status = RN2483_ProcessMacCommand(receiveBuffer, bufferSize, false);
+	if(status != DATA_RETURNED){
+		return (status);
+	}
+	if(!StringToUnsigned(receiveBuffer, &value) || (value > 255)){
+		return (MAC_ERR);
+	}
+	*margin = value;
+	return (MAC_OK);
+}
+
+/* Amount of gateways that received the last Link Check request (0 = no answer yet) */
+RN2483_Status_t RN2483_GetGateways(uint8_t * gateways, char * receiveBuffer, uint8_t bufferSize){
+	uint32_t value;
+	sprintf(commandBuffer, "mac get gwnb\r\n");
+	RN2483_Status_t status = RN2483_ProcessMacCommand(receiveBuffer, bufferSize, false);
+	if(status != DATA_RETURNED){
+		return (status);
+	}
+	if(!StringToUnsigned(receiveBuffer, &value) || (value > 255)){
+		return (MAC_ERR);
+	}
+	*gateways = value;
+	return (MAC_OK);
+}
+
+RN2483_Status_t RN2483_GetDownlinkCounter(uint32_t * counter, char * receiveBuffer, uint8_t bufferSize){
+	sprintf(commandBuffer, "mac get dnctr\r\n");
+	RN2483_Status_t status = RN2483_ProcessMacCommand(receiveBuffer, bufferSize, false);
+	if(status != DATA_RETURNED){
+		return (status);
+	}
+	if(!StringToUnsigned(receiveBuffer, counter)){
+		return (MAC_ERR);
+	}
+	return (MAC_OK);
+}
+
+/* SNR (dB) of the last received packet, "-128" - "127" */
+RN2483_Status_t RN2483_GetSnr(int8_t * snr, char * receiveBuffer, uint8_t bufferSize){
+	uint32_t value;
+	sprintf(commandBuffer, "radio get snr\r\n");
+	RN2483_Status_t status = RN2483_ProcessMacCommand(receiveBuffer, bufferSize, false);
+	if(status != DATA_RETURNED){
+		return (status);
+	}
+	bool negative = (receiveBuffer[0] == '-');
+	if(!StringToUnsigned(receiveBuffer + (negative ? 1 : 0), &value) || (value > 128)){
+		return (MAC_ERR);
+	}
+	*snr = negative ? -(int16_t)value : (int16_t)value;
+	return (MAC_OK);
+}
+
 RN2483_Status_t RN2483_SetBatteryLevel(uint8_t battery, char * receiveBuffer, uint8_t bufferSize){
 	sprintf(commandBuffer, "mac set bat %i\r\n", battery);
 	return (RN2483_ProcessMacCommand(receiveBuffer, bufferSize, false));
@@ -243,121 +449,88 @@ RN2483_Status_t RN2483_JoinABP(char * receiveBuffer, uint8_t bufferSize){
 	return (RN2483_ProcessMacCommand(receiveBuffer, bufferSize, true));
 }
 
-static RN2483_Status_t RN2483_SetDefaultOperation(LoRaSettings_t settings, char * receiveBuffer, uint8_t bufferSize){
-	RN2483_Status_t status = RN2483_SetOutputPower(RN2483_POWER_14DBM, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	status = RN2483_DisableAutomaticReplies(receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	status = RN2483_DisableAdaptiveDataRate(receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
+static uint8_t RN2483_BuildSetup(const LoRaSettings_t * settings){
+	uint8_t n = 0;
+
+	setupCommands[n++] = (RN2483_Command_t){"mac reset", "868", MAC_OK};
+	if(settings->activationMethod == OTAA){
+		setupCommands[n++] = (RN2483_Command_t){"mac set deveui", settings->deviceEUI, MAC_OK};
+		setupCommands[n++] = (RN2483_Command_t){"mac set appeui", settings->applicationEUI, MAC_OK};
+		setupCommands[n++] = (RN2483_Command_t){"mac set appkey", settings->applicationKey, MAC_OK};
+	}else{
+		setupCommands[n++] = (RN2483_Command_t){"mac set devaddr", settings->deviceAddress, MAC_OK};
+		setupCommands[n++] = (RN2483_Command_t){"mac set nwkskey", settings->networkSessionKey, MAC_OK};
+		setupCommands[n++] = (RN2483_Command_t){"mac set appskey", settings->applicationSessionKey, MAC_OK};
 	}
-	status = RN2483_SetDataRate(settings.dataRate, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
+
+	/* Default operation, ADR (if used) can only start from the data rate after it's set */
+	sprintf(powerArgument, "%i", settings->power);
+	sprintf(dataRateArgument, "%i", settings->dataRate);
+	setupCommands[n++] = (RN2483_Command_t){"mac set pwridx", powerArgument, MAC_OK};
+	setupCommands[n++] = (RN2483_Command_t){"mac set ar", "off", MAC_OK};
+	setupCommands[n++] = (RN2483_Command_t){"mac set adr", "off", MAC_OK};
+	setupCommands[n++] = (RN2483_Command_t){"mac set dr", dataRateArgument, MAC_OK};
+	if(settings->adaptiveDataRate){
+		setupCommands[n++] = (RN2483_Command_t){"mac set adr", "on", MAC_OK};
 	}
-	status = RN2483_EnableAdaptiveDataRate(receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
+	setupCommands[n++] = (RN2483_Command_t){"mac set bat", "254", MAC_OK};
+	if(settings->linkCheckInterval > 0){
+		sprintf(linkCheckArgument, "%u", settings->linkCheckInterval);
+		setupCommands[n++] = (RN2483_Command_t){"mac set linkchk", linkCheckArgument, MAC_OK};
 	}
-	return (RN2483_SetBatteryLevel(254, receiveBuffer, bufferSize));
+
+	setupCommands[n++] = (RN2483_Command_t){"mac join", (settings->activationMethod == OTAA) ? "otaa" : "abp", JOIN_ACCEPTED};
+
+	return (n);
+}
+
+/* The settings need to stay in memory until the callback is called */
+void RN2483_SetupAsync(const LoRaSettings_t * settings, char * receiveBuffer, uint8_t bufferSize, void (*callback)(RN2483_Status_t status)){
+	RN2483_RunCommands(setupCommands, RN2483_BuildSetup(settings), receiveBuffer, bufferSize, callback);
 }
 
 RN2483_Status_t RN2483_Setup(LoRaSettings_t settings, char * receiveBuffer, uint8_t bufferSize){
-	if(settings.activationMethod == OTAA){
-		return (RN2483_SetupOTAA(settings, receiveBuffer, bufferSize));
-	}else{
-		return (RN2483_SetupABP(settings, receiveBuffer, bufferSize));
-	}
+	RN2483_SetupAsync(&settings, receiveBuffer, bufferSize, NULL);
+	return (RN2483_WaitCommands());
 }
 
 RN2483_Status_t RN2483_SetupOTAA(LoRaSettings_t settings, char * receiveBuffer, uint8_t bufferSize){
-	RN2483_Status_t status = RN2483_MacReset(receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	if(settings.deviceEUI == NULL){
-		status = RN2483_GetHardwareEUI(receiveBuffer, bufferSize);
-		if(status != DATA_RETURNED){
-			return (status);
-		}
-		char address[16];
-		sprintf(address, "%s", receiveBuffer);
-		status = RN2483_SetDeviceEUI(address, receiveBuffer, bufferSize);
-		if(status != MAC_OK){
-			return (status);
-		}
-	}else{
-		status = RN2483_SetDeviceEUI(settings.deviceEUI, receiveBuffer, bufferSize);
-		if(status != MAC_OK){
-			return (status);
-		}
-	}
-	status = RN2483_SetApplicationEUI(settings.applicationEUI, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	status = RN2483_SetApplicationKey(settings.applicationKey, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	status = RN2483_SetDefaultOperation(settings, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	return (RN2483_JoinOTAA(receiveBuffer, bufferSize));
+	settings.activationMethod = OTAA;
+	return (RN2483_Setup(settings, receiveBuffer, bufferSize));
 }
 
 RN2483_Status_t RN2483_SetupABP(LoRaSettings_t settings, char * receiveBuffer, uint8_t bufferSize){
-	RN2483_Status_t status = RN2483_MacReset(receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	status = RN2483_SetDeviceAddress(settings.deviceAddress, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	status = RN2483_SetNetworkSessionKey(settings.networkSessionKey, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	status = RN2483_SetApplicationSessionKey(settings.applicationSessionKey, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
-	}
-	status = RN2483_SetDefaultOperation(settings, receiveBuffer, bufferSize);
-	if(status != MAC_OK){
-		return (status);
+	settings.activationMethod = ABP;
+	return (RN2483_Setup(settings, receiveBuffer, bufferSize));
+}
+
+/* Writes "mac tx <type> 1 <payload as hex>\r\n" straight into the command buffer, without heap or sprintf */
+static bool RN2483_BuildTransmit(const char * type, uint8_t * data, uint8_t payloadSize){
+	char * end = StringAppend(commandBuffer, "mac tx ");
+	end = StringAppend(end, type);
+	end = StringAppend(end, " 1 ");
+
+	/* Two chars per byte, "\r\n" and the NULL termination */
+	if((end - commandBuffer) + (2 * payloadSize) + 3 > RN2483_COMMANDBUFFER_SIZE){
+		return (false);
 	}
-	return (RN2483_JoinABP(receiveBuffer, bufferSize));
+
+	end = HexAppend(end, data, payloadSize);
+	StringAppend(end, "\r\n");
+	return (true);
 }
 
 RN2483_Status_t RN2483_TransmitUnconfirmed(uint8_t * data, uint8_t payloadSize, char * receiveBuffer, uint8_t bufferSize){
-	char * encodedPayload;
-	if(!HexToString(data, payloadSize, &encodedPayload )){
+	if(!RN2483_BuildTransmit("uncnf", data, payloadSize)){
 		return (MAC_ERR);
 	}
-	//StringToHexString(data, payloadSize/2, &decodedPayload);
-
-	// Sprintf caused a problem where it would overwrite data when using long LoRaWAN packets because the malloc statement
-	//   in HexToString would create a too small buffer (according to RN2483_COMMANDBUFFER_SIZE, was 80 and increased to 160)
-	//   compared to the data of the converted LoRaWAN packet.
-	sprintf(commandBuffer, "mac tx uncnf 1 %s\r\n", encodedPayload);
-	free(encodedPayload);
 	return (RN2483_ProcessMacCommand(receiveBuffer, bufferSize, true));
 }
 
 RN2483_Status_t RN2483_TransmitConfirmed(uint8_t * data, uint8_t payloadSize, char * receiveBuffer, uint8_t bufferSize){
-	char * encodedPayload;
-	if(!HexToString(data, payloadSize, &encodedPayload )){
+	if(!RN2483_BuildTransmit("cnf", data, payloadSize)){
 		return (MAC_ERR);
 	}
-	sprintf(commandBuffer, "mac tx cnf 1 %s\r\n", encodedPayload);
-	free(encodedPayload);
 	return (RN2483_ProcessMacCommand(receiveBuffer, bufferSize, true));
 }
 
@@ -377,15 +550,25 @@ RN2483_Status_t RN2483_Sleep(uint32_t sleepTime, volatile bool * wakeUp, char *
 }
 
 RN2483_Status_t RN2483_Wake(char * receiveBuffer, uint8_t bufferSize){
+	/* Break condition and autobaud character */
 	Leuart_Reinit();
 
 	/* Capture response "ok" from previous sleep command */
-	Leuart_WaitForResponse();
-	/* Read second response */
-	Leuart_ReadResponse(receiveBuffer, bufferSize);
-	if(StringStartsWith(receiveBuffer, "ok")){
+	if(Leuart_WaitForResponse() == RX_TIMEOUT){
+		return (RN_RX_TIMEOUT);
+	}
+	if(RN2483_ParseResponse(RN2483_ReadResponse(receiveBuffer, bufferSize), false) == MAC_OK){
 		return (MAC_OK);
 	}
 
 	return (MAC_ERR);
 }
+
+bool RN2483_GetDownlink(LoRaDownlink_t * data){
+	if(!downlinkPending){
+		return (false);
+	}
+	*data = downlink;
+	downlinkPending = false;
+	return (true);
+}
@@ -42,6 +42,7 @@ typedef enum rn2483_statuses{
 	BUSY,
 	MAC_PAUSED,
 	INVALID_DATA_LEN,
+	KEYS_NOT_INIT,
 	MAC_TX_OK,
 	MAC_RX,
 	MAC_ERR,
@@ -53,6 +54,13 @@ typedef enum rn2483_statuses{
 	DATA_RETURNED
 }RN2483_Status_t;
 
+/* Command for the engine, sent as "command argument\r\n" */
+typedef struct{
+	const char * command;
+	const char * argument;    /* NULL if not used */
+	RN2483_Status_t expected; /* MAC_OK or the second response (JOIN_ACCEPTED, MAC_TX_OK, ...) */
+}RN2483_Command_t;
+
 void RN2483_Init(void);
 RN2483_Status_t RN2483_MacReset(char * receiveBuffer, uint8_t bufferSize);
 
@@ -69,9 +77,20 @@ RN2483_Status_t RN2483_SetOutputPower(uint8_t pwr, char * receiveBuffer, uint8_t
 RN2483_Status_t RN2483_DisableAdaptiveDataRate(char * receiveBuffer, uint8_t bufferSize);
 RN2483_Status_t RN2483_DisableAutomaticReplies(char * receiveBuffer, uint8_t bufferSize);
 RN2483_Status_t RN2483_SetDataRate(uint8_t dr, char * receiveBuffer, uint8_t bufferSize);
+RN2483_Status_t RN2483_GetDataRate(int8_t *dr, char * receiveBuffer, uint8_t bufferSize);
+RN2483_Status_t RN2483_SetLinkCheck(uint16_t interval, char * receiveBuffer, uint8_t bufferSize);
+RN2483_Status_t RN2483_GetMargin(uint8_t * margin, char * receiveBuffer, uint8_t bufferSize);
+RN2483_Status_t RN2483_GetGateways(uint8_t * gateways, char * receiveBuffer, uint8_t bufferSize);
+RN2483_Status_t RN2483_GetDownlinkCounter(uint32_t * counter, char * receiveBuffer, uint8_t bufferSize);
+RN2483_Status_t RN2483_GetSnr(int8_t * snr, char * receiveBuffer, uint8_t bufferSize);
 RN2483_Status_t RN2483_JoinOTAA(char * receiveBuffer, uint8_t bufferSize);
 RN2483_Status_t RN2483_JoinABP(char * receiveBuffer, uint8_t bufferSize);
 
+void RN2483_RunCommands(const RN2483_Command_t * commands, uint8_t count, char * receiveBuffer, uint8_t bufferSize, void (*callback)(RN2483_Status_t status));
+bool RN2483_CommandsDone(void);
+RN2483_Status_t RN2483_WaitCommands(void);
+
+void RN2483_SetupAsync(const LoRaSettings_t * settings, char * receiveBuffer, uint8_t bufferSize, void (*callback)(RN2483_Status_t status));
 RN2483_Status_t RN2483_Setup(LoRaSettings_t settings, char * receiveBuffer, uint8_t bufferSize);
 RN2483_Status_t RN2483_SetupOTAA(LoRaSettings_t settings, char * receiveBuffer, uint8_t bufferSize);
 RN2483_Status_t RN2483_SetupABP(LoRaSettings_t settings, char * receiveBuffer, uint8_t bufferSize);
@@ -84,4 +103,6 @@ RN2483_Status_t RN2483_ResumeMac(char * receiveBuffer, uint8_t bufferSize);
 RN2483_Status_t RN2483_Sleep(uint32_t sleepTime, volatile bool * wakeUp, char * receiveBuffer, uint8_t bufferSize);
 RN2483_Status_t RN2483_Wake(char * receiveBuffer, uint8_t bufferSize);
 
+bool RN2483_GetDownlink(LoRaDownlink_t * data);
+
 #endif /* _RN2483_H_ */
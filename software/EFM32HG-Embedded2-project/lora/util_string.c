@@ -13,7 +13,7 @@
  *         File: util.c
  *      Created: 2018-01-19
  *       Author: Guus Leenders - Modified by Brecht Van Eeckhoudt
- *      Version: 1.1 (1.0 -> 1.1: Added comment about malloc)
+ *      Version: 1.5 (1.4 -> 1.5: Added `StringToUnsigned` for numeric responses)
  *
  *  Description: TODO
  */
@@ -24,7 +24,7 @@
 #include <stdbool.h>
 #include <string.h>
 
-bool StringStartsWith(char * str, char * seq){
+bool StringStartsWith(const char * str, const char * seq){
 	uint8_t i;
 	for(i=0; i<strlen(seq); i++){
 		if(*(str+i) != *(seq+i)){
@@ -34,32 +34,59 @@ bool StringStartsWith(char * str, char * seq){
 	return (true);
 }
 
-bool HexToString(uint8_t * bin, uint8_t binsz, char **result ){
-	char hex_str[] = "0123456789abcdef";
+/* Copies `src` including the NULL termination, returns a pointer to that termination to append more */
+char * StringAppend(char * dst, const char * src){
+	while(*src != '\0'){
+		*dst++ = *src++;
+	}
+	*dst = '\0';
+	return (dst);
+}
+
+/* Writes the hex representation of `bin` (two chars per byte) and a NULL termination, returns a pointer to that termination */
+char * HexAppend(char * dst, const uint8_t * bin, uint8_t binsz){
+	static const char hex_str[] = "0123456789abcdef";
 	uint8_t i;
 
-	// ALLOCATE MEMORY
-	// Hex to string/char array: one value becomes two chars (*2)
-	//   +1 because of NULL termination
-	// "*result =" ~ Value at memory location gets changed
-	if (!(*result = (char *)malloc(binsz * 2 + 1))){
-		return (false); // Returned when NULL
+	for (i = 0; i < binsz; i++){
+	  *dst++ = hex_str[(bin[i] >> 4) & 0x0F];
+	  *dst++ = hex_str[(bin[i]     ) & 0x0F];
 	}
+	*dst = '\0';
+	return (dst);
+}
 
-	// Add NULL termination
-	(*result)[binsz * 2] = 0; // Last memory location, "0" ~ '\0'
+/* Value of a hex character, -1 if it isn't one */
+static int8_t HexValue(char c){
+	if((c >= '0') && (c <= '9')) return (c - '0');
+	if((c >= 'a') && (c <= 'f')) return (c - 'a' + 10);
+	if((c >= 'A') && (c <= 'F')) return (c - 'A' + 10);
+	return (-1);
+}
 
-	// CHECK MEMORY
-	if (!binsz){
-		return (false); // Returned when NULL
-	}
+/* Converts hex characters to bytes until a non-hex character or `binsz` bytes, returns the amount of bytes */
+uint8_t HexToBin(const char * hex, uint8_t * bin, uint8_t binsz){
+	uint8_t i;
 
-	// FILL WITH DATA
 	for (i = 0; i < binsz; i++){
-	  (*result)[i * 2 + 0] = hex_str[(bin[i] >> 4) & 0x0F];
-	  (*result)[i * 2 + 1] = hex_str[(bin[i]     ) & 0x0F];
+	  int8_t high = HexValue(hex[i * 2 + 0]);
+	  if (high < 0) break;
+	  int8_t low = HexValue(hex[i * 2 + 1]);
+	  if (low < 0) break;
+	  bin[i] = (high << 4) | low;
 	}
+	return (i);
+}
 
+/* Converts the decimal characters at the start of `str`, returns false if there aren't any */
+bool StringToUnsigned(const char * str, uint32_t * value){
+	if((*str < '0') || (*str > '9')){
+		return (false);
+	}
+	*value = 0;
+	while((*str >= '0') && (*str <= '9')){
+		*value = (*value * 10) + (*str++ - '0');
+	}
 	return (true);
 }
 
@@ -24,8 +24,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-bool StringStartsWith(char * str, char * seq);
-bool HexToString(uint8_t * bin, uint8_t binsz, char **result );
+bool StringStartsWith(const char * str, const char * seq);
+char * StringAppend(char * dst, const char * src);
+char * HexAppend(char * dst, const uint8_t * bin, uint8_t binsz);
+uint8_t HexToBin(const char * hex, uint8_t * bin, uint8_t binsz);
+bool StringToUnsigned(const char * str, uint32_t * value);
 char * StringToHexString(char * bin, unsigned int binsz, char **result );
 
 #endif /* INC_UTIL_H_ */
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file ADXL362.c
  * @brief All code for the ADXL362 accelerometer.
- * @version 3.1
+ * @version 3.4
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -28,6 +28,9 @@
  *   @li v2.5: Updated ODR enum and changed masking logic for register settings.
  *   @li v3.0: Added functionality to exit methods after `error` call and updated version number.
  *   @li v3.1: Removed `static` before the local variables (not necessary).
+ *   @li v3.2: Moved the VDD pin functionality to the power rails in `pm.c`.
+ *   @li v3.3: The SPI baudrate is recalculated after a HFRCO band change.
+ *   @li v3.4: The SPI pins are switched using precomputed pin profiles.
  *
  * ******************************************************************************
  *
@@ -77,6 +80,7 @@
 #include "debug_dbprint.h" /* Enable or disable printing to UART */
 #include "delay.h"         /* Delay functionality */
 #include "util.h"          /* Utility functionality */
+#include "pm.h"            /* Power rails and HFRCO bands */
 
 
 /* Local definitions - ADXL362 register definitions */
@@ -99,17 +103,35 @@
 #define ADXL_REG_FILTER_CTL 	0x2C /* Write FFxx xxxx (FF = 00 for +-2g, 01 for =-4g, 1x for +- 8g) for measurement range selection */
 #define ADXL_REG_POWER_CTL 		0x2D /* Write xxxx xxMM (MM = 10) to: measurement mode */
 
+/** SPI clock frequency (limited to half of the HFPER clock) */
+#define ADXL_SPI_BAUDRATE 4000000
+
+/** SPI pins while communicating, in the case of `gpioModePushPull` the last argument directly sets the pin state */
+#define ADXL_PINS_ACTIVE(X, p)                                                                \
+	X(p, ADXL_CLK_PORT, ADXL_CLK_PIN, gpioModePushPull, 0)   /* US0_CLK is push pull */       \
+	X(p, ADXL_NCS_PORT, ADXL_NCS_PIN, gpioModePushPull, 1)   /* US0_CS is push pull */        \
+	X(p, ADXL_MOSI_PORT, ADXL_MOSI_PIN, gpioModePushPull, 1) /* US0_TX (MOSI) is push pull */ \
+	X(p, ADXL_MISO_PORT, ADXL_MISO_PIN, gpioModeInput, 1)    /* US0_RX (MISO) is input */
+
+/** SPI pins while parked, `gpioModeDisabled`: pull-up if DOUT is set */
+#define ADXL_PINS_PARKED(X, p)                               \
+	X(p, ADXL_CLK_PORT, ADXL_CLK_PIN, gpioModeDisabled, 0)   \
+	X(p, ADXL_NCS_PORT, ADXL_NCS_PIN, gpioModeDisabled, 1)   \
+	X(p, ADXL_MOSI_PORT, ADXL_MOSI_PIN, gpioModeDisabled, 1) \
+	X(p, ADXL_MISO_PORT, ADXL_MISO_PIN, gpioModeDisabled, 1)
+
 
 /* Local variables */
 volatile bool ADXL_triggered = false; /* Volatile because it's modified by an interrupt service routine */
 volatile uint16_t ADXL_triggercounter = 0; /* Volatile because it's modified by an interrupt service routine */
 int8_t XYZDATA[3] = { 0x00, 0x00, 0x00 };
 ADXL_Range_t range;
-bool ADXL_VDD_initialized = false;
+bool ADXL_SPI_enabled = false;
+const PinProfile_t ADXL_spiActive = PIN_PROFILE(ADXL_PINS_ACTIVE);
+const PinProfile_t ADXL_spiParked = PIN_PROFILE(ADXL_PINS_PARKED);
 
 
 /* Local prototypes */
-static void powerADXL (bool enabled);
 static void initADXL_SPI (void);
 static void softResetADXL (void);
 static void resetHandlerADXL (void);
@@ -118,6 +140,7 @@ static void writeADXL (uint8_t address, uint8_t data);
 static void readADXL_XYZDATA (void);
 static bool checkID_ADXL (void);
 static int32_t convertGRangeToGValue (int8_t sensorValue);
+static void updateSPIclock (void);
 
 
 /**************************************************************************//**
@@ -131,15 +154,11 @@ static int32_t convertGRangeToGValue (int8_t sensorValue);
  *****************************************************************************/
 void initADXL (void)
 {
-	/* Enable necessary clocks (just in case) */
-	CMU_ClockEnable(cmuClock_HFPER, true); /* GPIO and USART0/1 are High Frequency Peripherals */
-	CMU_ClockEnable(cmuClock_GPIO, true);
-
-	/* Initialize and power VDD pin */
-	powerADXL(true);
+	/* Power VDD pin, the rail also holds the GPIO and HFPER clocks (USART0/1 are High Frequency Peripherals) */
+	PM_Enable(PM_ADXL);
 
 	/* Power-up delay of 40 ms */
-	delay(40);
+	PM_WaitReady(PM_ADXL);
 
 	/* Enable necessary clock (just in case) */
 	if (ADXL_SPI == USART0) CMU_ClockEnable(cmuClock_USART0, true);
@@ -152,7 +171,7 @@ void initADXL (void)
 #endif /* DEBUG_DBPRINT */
 
 		/* Disable power to the VDD pin */
-		powerADXL(false);
+		PM_Disable(PM_ADXL);
 
 		error(21);
 
@@ -263,12 +282,9 @@ void ADXL_enableSPI (bool enabled)
 		}
 
 		USART_Enable(ADXL_SPI, usartEnable);
+		ADXL_SPI_enabled = true;
 
-		/* In the case of gpioModePushPull", the last argument directly sets the pin state */
-		GPIO_PinModeSet(ADXL_CLK_PORT, ADXL_CLK_PIN, gpioModePushPull, 0);   /* US0_CLK is push pull */
-		GPIO_PinModeSet(ADXL_NCS_PORT, ADXL_NCS_PIN, gpioModePushPull, 1);   /* US0_CS is push pull */
-		GPIO_PinModeSet(ADXL_MOSI_PORT, ADXL_MOSI_PIN, gpioModePushPull, 1); /* US0_TX (MOSI) is push pull */
-		GPIO_PinModeSet(ADXL_MISO_PORT, ADXL_MISO_PIN, gpioModeInput, 1);    /* US0_RX (MISO) is input */
+		applyPinProfile(&ADXL_spiActive);
 	}
 	else
 	{
@@ -289,12 +305,9 @@ void ADXL_enableSPI (bool enabled)
 		}
 
 		USART_Enable(ADXL_SPI, usartDisable);
+		ADXL_SPI_enabled = false;
 
-		/* gpioModeDisabled: Pull-up if DOUT is set. */
-		GPIO_PinModeSet(ADXL_CLK_PORT, ADXL_CLK_PIN, gpioModeDisabled, 0);
-		GPIO_PinModeSet(ADXL_NCS_PORT, ADXL_NCS_PIN, gpioModeDisabled, 1);
-		GPIO_PinModeSet(ADXL_MOSI_PORT, ADXL_MOSI_PIN, gpioModeDisabled, 1);
-		GPIO_PinModeSet(ADXL_MISO_PORT, ADXL_MISO_PIN, gpioModeDisabled, 1);
+		applyPinProfile(&ADXL_spiParked);
 	}
 }
 
@@ -647,11 +660,7 @@ void testADXL (void)
 static void initADXL_SPI (void)
 {
 	/* Configure GPIO */
-	/* In the case of gpioModePushPull", the last argument directly sets the pin state */
-	GPIO_PinModeSet(ADXL_CLK_PORT, ADXL_CLK_PIN, gpioModePushPull, 0);   /* US0_CLK is push pull */
-	GPIO_PinModeSet(ADXL_NCS_PORT, ADXL_NCS_PIN, gpioModePushPull, 1);   /* US0_CS is push pull */
-	GPIO_PinModeSet(ADXL_MOSI_PORT, ADXL_MOSI_PIN, gpioModePushPull, 1); /* US0_TX (MOSI) is push pull */
-	GPIO_PinModeSet(ADXL_MISO_PORT, ADXL_MISO_PIN, gpioModeInput, 1);    /* US0_RX (MISO) is input */
+	applyPinProfile(&ADXL_spiActive);
 
 	/* Start with default config */
 	USART_InitSync_TypeDef config = USART_INITSYNC_DEFAULT;
@@ -659,7 +668,7 @@ static void initADXL_SPI (void)
 	/* Modify some settings */
 	config.enable       = false;           	/* making sure to keep USART disabled until we've set everything up */
 	config.refFreq      = 0;			 	/* USART/UART reference clock assumed when configuring baud rate setup. Set to 0 to use the currently configured reference clock. */
-	config.baudrate     = 4000000;         	/* CLK freq is 1 MHz (1000000) */
+	config.baudrate     = ADXL_SPI_BAUDRATE;
 	config.databits     = usartDatabits8;	/* master mode */
 	config.master       = true;            	/* master mode */
 	config.msbf         = true;            	/* send MSB first */
@@ -676,6 +685,10 @@ static void initADXL_SPI (void)
 
 	/* Enable USART0/1 */
 	USART_Enable(ADXL_SPI, usartEnable);
+	ADXL_SPI_enabled = true;
+
+	/* Recalculate the baudrate when the HFPER clock changes */
+	PM_AddBandListener(updateSPIclock);
 
 	/* Set CS high (active low!) */
 	GPIO_PinOutSet(gpioPortE, 13);
@@ -727,12 +740,12 @@ static void resetHandlerADXL (void)
 			{
 				retries++;
 
-				powerADXL(false);
+				PM_Disable(PM_ADXL);
 				ADXL_enableSPI(false); /* Make sure the accelerometer doesn't get power through the SPI pins */
 
 				delay(1000);
 
-				powerADXL(true);
+				PM_Enable(PM_ADXL);
 				ADXL_enableSPI(true);
 
 				delay(1000);
@@ -856,40 +869,6 @@ static void readADXL_XYZDATA (void)
 }
 
 
-/**************************************************************************//**
- * @brief
- *   Enable or disable the power to the accelerometer.
- *
- * @details
- *   This method also initializes the pin-mode if necessary.
- *   Necessary clocks are enabled in a previous method.
- *
- * @note
- *   This is a static method because it's only internally used in this file
- *   and called by other methods if necessary.
- *
- * @param[in] enabled
- *   @li `true` - Enable the GPIO pin connected to the VDD pin of the accelerometer.
- *   @li `false` - Disable the GPIO pin connected to the VDD pin of the accelerometer.
- *****************************************************************************/
-static void powerADXL (bool enabled)
-{
-	/* Initialize VDD pin if not already the case */
-	if (!ADXL_VDD_initialized)
-	{
-		/* In the case of gpioModePushPull", the last argument directly sets the pin state */
-		GPIO_PinModeSet(ADXL_VDD_PORT, ADXL_VDD_PIN, gpioModePushPull, enabled);
-
-		ADXL_VDD_initialized = true;
-	}
-	else
-	{
-		if (enabled) GPIO_PinOutSet(ADXL_VDD_PORT, ADXL_VDD_PIN); /* Enable VDD pin */
-		else GPIO_PinOutClear(ADXL_VDD_PORT, ADXL_VDD_PIN); /* Disable VDD pin */
-	}
-}
-
-
 /**************************************************************************//**
  * @brief
  *   Soft reset accelerometer.
@@ -959,3 +938,27 @@ static int32_t convertGRangeToGValue (int8_t sensorValue)
 		return (0);
 	}
 }
+
+
+/**************************************************************************//**
+ * @brief
+ *   Recalculate the SPI baudrate for the current HFPER clock.
+ *
+ * @details
+ *   This method is called by `pm.c` after a HFRCO band change. The clock of
+ *   USART0/1 is temporarily enabled if necessary to access the registers.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void updateSPIclock (void)
+{
+	CMU_Clock_TypeDef clock = (ADXL_SPI == USART0) ? cmuClock_USART0 : cmuClock_USART1;
+
+	if (!ADXL_SPI_enabled) CMU_ClockEnable(clock, true);
+
+	USART_BaudrateSyncSet(ADXL_SPI, 0, ADXL_SPI_BAUDRATE); /* "0" - Use the current HFPER clock */
+
+	if (!ADXL_SPI_enabled) CMU_ClockEnable(clock, false);
+}
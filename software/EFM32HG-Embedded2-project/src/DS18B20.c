@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file DS18B20.c
  * @brief All code for the DS18B20 temperature sensor.
- * @version 3.1
+ * @version 3.6
  * @author
  *   Alec Vanderhaegen & Sarah Goossens@n
  *   Modified by Brecht Van Eeckhoudt
@@ -32,6 +32,12 @@
  *   @li v3.0: Disabled initialized functionality before entering an `error` function, added
  *             functionality to exit methods after `error` call and updated version number.
  *   @li v3.1: Removed `static` before the local variable (not necessary).
+ *   @li v3.2: Replaced USTIMER functionality with `delayUs`.
+ *   @li v3.3: Started sleeping between the conversion checks, which are now limited in time instead of count.
+ *   @li v3.4: Moved the VDD pin functionality to the power rails in `pm.c`.
+ *   @li v3.5: The data pin mode is changed with a single register write (`PIN_MODE_SET`) instead of `GPIO_PinModeSet`
+ *             and parked using a precomputed pin profile.
+ *   @li v3.6: The start of a read slot is kept low for at least 1 µs (tINIT).
  *
  * ******************************************************************************
  *
@@ -72,24 +78,35 @@
 #include "debug_dbprint.h" /* Enable or disable printing to UART */
 #include "delay.h"         /* Delay functionality */
 #include "util.h"    	   /* Utility functionality */
-#include "ustimer.h"       /* Timer functionality */
+#include "pm.h"            /* Power rails */
 
 
 /* Local definitions */
 /** Enable (1) or disable (0) printing the timeout counter value using DBPRINT */
 #define DBPRINT_TIMEOUT 0
 
-/* Maximum values for the counters before exiting a `while` loop */
-#define TIMEOUT_INIT       20
-#define TIMEOUT_CONVERSION 500 /* 12 bit resolution (reset default) = 750 ms max resolving time */
+/** Maximum value for the counter before exiting the *presence* `while` loop */
+#define TIMEOUT_INIT          20
 
+/** Maximum time in milliseconds to wait on a conversion, 12 bit resolution (reset default) = 750 ms max resolving time */
+#define TIMEOUT_CONVERSION_MS 1000
 
-/* Local variable */
-bool DS18B20_VDD_initialized = false;
+/** Time in milliseconds to sleep between checking if the conversion is completed */
+#define CONVERSION_POLL_MS    10
+
+/** Minimum low time in microseconds to start a read slot (tINIT) */
+#define READ_SLOT_LOW_US      1
+
+/** Data pin while the sensor isn't used */
+#define DS18B20_PINS_OFF(X, p) \
+	X(p, TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModeDisabled, 0)
+
+
+/* Local variables */
+const PinProfile_t dataPinOff = PIN_PROFILE(DS18B20_PINS_OFF);
 
 
 /* Local prototypes */
-static void powerDS18B20 (bool enabled);
 static bool init_DS18B20 (void);
 static void writeByteToDS18B20 (uint8_t data);
 static uint8_t readByteFromDS18B20 (void);
@@ -101,10 +118,10 @@ static int32_t convertTempData (uint8_t tempLS, uint8_t tempMS);
  *   Get a temperature value from the DS18B20.
  *
  * @details
- *   USTimer gets initialized, the sensor gets powered, the data-transmission
- *   takes place, the timer gets de-initialized to disable the clocks and interrupts,
- *   the data and power pin get disabled and finally the read values are converted
- *   to an `int32_t` value.@n
+ *   The sensor gets powered, the data-transmission takes place (timed with
+ *   `delayUs`, which only enables its clocks while waiting), the data and power
+ *   pin get disabled and finally the read values are converted to an `int32_t`
+ *   value.@n
  *   **Negative temperatures work fine.**
  *
  * @return
@@ -112,8 +129,8 @@ static int32_t convertTempData (uint8_t tempLS, uint8_t tempMS);
  *****************************************************************************/
 int32_t readTempDS18B20 (void)
 {
-	/* Timeout counter */
-	uint16_t counter = 0;
+	/* Timer to limit the waiting time on a conversion */
+	Timer_t timeout;
 
 	/* Variable to indicate if a conversion has been completed */
 	bool conversionCompleted = false;
@@ -121,15 +138,9 @@ int32_t readTempDS18B20 (void)
 	/* Variable to hold raw data bytes */
 	uint8_t rawDataFromDS18B20Arr[9] = {0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
 
-	/* Initialize timer
-	 * Initializing and disabling the timer again adds about 40 µs active time but should conserve sleep energy... */
-	USTIMER_Init();
-
-	/* Initialize and power VDD pin */
-	powerDS18B20(true);
-
-	/* Power-up delay of 5 ms */
-	delay(5);
+	/* Power VDD pin, this returns immediately if the rail was already enabled for at least 5 ms */
+	PM_Enable(PM_DS18B20);
+	PM_WaitReady(PM_DS18B20);
 
 	/* Initialize communication and only continue if successful */
 	if (init_DS18B20())
@@ -141,30 +152,30 @@ int32_t readTempDS18B20 (void)
 		 *   The datasheet gives the following directions for time slots, but reading bytes also seems to work...
 		 *     - Read time slots have a 60 µs duration and 1 µs recovery between slots
 		 *     - After the master pulls the line low for 1 µs, the data is valid for up to 15 µs */
-		while ((counter < TIMEOUT_CONVERSION) && !conversionCompleted)
+		TIMER_start(&timeout, TIMEOUT_CONVERSION_MS, false, NULL);
+
+		while (!conversionCompleted && !TIMER_isExpired(&timeout))
 		{
 			uint8_t testByte = readByteFromDS18B20();
 			if (testByte > 0) conversionCompleted = true;
-
-			counter++;
+			else delay(CONVERSION_POLL_MS); /* Sleep instead of keeping the MCU busy */
 		}
 
+		TIMER_stop(&timeout);
+
 		/* Exit the function if the maximum waiting time was reached */
-		if (counter == TIMEOUT_CONVERSION)
+		if (!conversionCompleted)
 		{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
 			dbcrit("Waiting time for DS18B20 conversion reached!");
 #endif /* DEBUG_DBPRINT */
 
-			/* Disable interrupts and turn off the clock to the underlying hardware timer. */
-			USTIMER_DeInit();
-
 			/* Disable data pin (otherwise we got a "sleep" current of about 330 µA due to the on-board 10k pull-up) */
-			GPIO_PinModeSet(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModeDisabled, 0);
+			applyPinProfile(&dataPinOff);
 
-			/* Disable the VDD pin */
-			powerDS18B20(false);
+			/* Release the VDD pin */
+			PM_Disable(PM_DS18B20);
 
 			error(29);
 
@@ -172,16 +183,6 @@ int32_t readTempDS18B20 (void)
 			return (0);
 
 		}
-#if DBPRINT_TIMEOUT == 1 /* DBPRINT_TIMEOUT */
-		else
-		{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-			dbwarnInt("DS18B20 conversion (", counter, ")");
-#endif /* DEBUG_DBPRINT */
-
-		}
-#endif /* DBPRINT_TIMEOUT */
 
 		init_DS18B20();           /* Initialize communication */
 		writeByteToDS18B20(0xCC); /* 0xCC = "Skip Rom" */
@@ -190,28 +191,22 @@ int32_t readTempDS18B20 (void)
 		/* Read the bytes */
 		for (uint8_t i = 0; i < 9; i++) rawDataFromDS18B20Arr[i] = readByteFromDS18B20();
 
-		/* Disable interrupts and turn off the clock to the underlying hardware timer. */
-		USTIMER_DeInit();
-
 		/* Disable data pin (otherwise we got a "sleep" current of about 330 µA due to the on-board 10k pull-up) */
-		GPIO_PinModeSet(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModeDisabled, 0);
+		applyPinProfile(&dataPinOff);
 
-		/* Disable the VDD pin */
-		powerDS18B20(false);
+		/* Release the VDD pin */
+		PM_Disable(PM_DS18B20);
 
 		/* Return the converted byte */
 		return (convertTempData(rawDataFromDS18B20Arr[0], rawDataFromDS18B20Arr[1]));
 	}
 	else
 	{
-		/* Disable interrupts and turn off the clock to the underlying hardware timer. */
-		USTIMER_DeInit();
-
 		/* Disable data pin (otherwise we got a "sleep" current of about 330 µA due to the on-board 10k pull-up) */
-		GPIO_PinModeSet(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModeDisabled, 0);
+		applyPinProfile(&dataPinOff);
 
-		/* Disable the VDD pin */
-		powerDS18B20(false);
+		/* Release the VDD pin */
+		PM_Disable(PM_DS18B20);
 
 		/* Exit function */
 		return (0);
@@ -219,43 +214,6 @@ int32_t readTempDS18B20 (void)
 }
 
 
-/**************************************************************************//**
- * @brief
- *   Enable or disable the power to the temperature sensor.
- *
- * @details
- *   This method also initializes the pin-mode if necessary.
- *
- * @note
- *   This is a static method because it's only internally used in this file
- *   and called by other methods if necessary.
- *
- * @param[in] enabled
- *   @li `true` - Enable the GPIO pin connected to the VDD pin of the temperature sensor.
- *   @li `talse` - Disable the GPIO pin connected to the VDD pin of the temperature sensor.
- *****************************************************************************/
-static void powerDS18B20 (bool enabled)
-{
-	/* Enable necessary clocks (just in case) */
-	CMU_ClockEnable(cmuClock_HFPER, true); /* GPIO is a High Frequency Peripheral */
-	CMU_ClockEnable(cmuClock_GPIO, true);
-
-	/* Initialize VDD pin if not already the case */
-	if (!DS18B20_VDD_initialized)
-	{
-		/* In the case of gpioModePushPull", the last argument directly sets the pin state */
-		GPIO_PinModeSet(TEMP_VDD_PORT, TEMP_VDD_PIN, gpioModePushPull, enabled);
-
-		DS18B20_VDD_initialized = true;
-	}
-	else
-	{
-		if (enabled) GPIO_PinOutSet(TEMP_VDD_PORT, TEMP_VDD_PIN); /* Enable VDD pin */
-		else GPIO_PinOutClear(TEMP_VDD_PORT, TEMP_VDD_PIN); /* Disable VDD pin */
-	}
-}
-
-
 /**************************************************************************//**
  * @brief
  *   Initialize communication to the DS18B20.
@@ -274,11 +232,12 @@ static bool init_DS18B20 (void)
 	uint32_t counter = 0;
 
 	/* MASTER RESET: Pull data line LOW for at least 480 µs (Master TX) */
-	GPIO_PinModeSet(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModePushPull, 0); /* gpioModePushPull: Last argument directly sets the pin state */
-	USTIMER_DelayIntSafe(480);
+	GPIO_PinOutClear(TEMP_DATA_PORT, TEMP_DATA_PIN);
+	PIN_MODE_SET(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModePushPull);
+	delayUs(480);
 
 	/* Change pin-mode to input - External pull-up resistor pulls data line back HIGH */
-	GPIO_PinModeSet(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModeInput, 0);
+	PIN_MODE_SET(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModeInput);
 
 	/* Check if the line becomes LOW (~ wait while it stays high) during the maximum waiting time
 	 *   The DS18B20 should detect the data line rising due to the pull-up resistor, waits 15 - 50 µs
@@ -309,7 +268,7 @@ static bool init_DS18B20 (void)
 #endif /* DBPRINT_TIMEOUT */
 
 	/* Master RX should be at least 480 µs */
-	USTIMER_DelayIntSafe(480);
+	delayUs(480);
 
 	return (true);
 }
@@ -328,8 +287,9 @@ static bool init_DS18B20 (void)
  *****************************************************************************/
 static void writeByteToDS18B20 (uint8_t data)
 {
-	/* In the case of gpioModePushPull", the last argument directly sets the pin state */
-	GPIO_PinModeSet(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModePushPull, 0);
+	/* Drive the data line low (DOUT is set first so the pin doesn't glitch) */
+	GPIO_PinOutClear(TEMP_DATA_PORT, TEMP_DATA_PIN);
+	PIN_MODE_SET(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModePushPull);
 
 	/* Write the byte, bit by bit */
 	for (uint8_t i = 0; i < 8; i++)
@@ -343,13 +303,13 @@ static void writeByteToDS18B20 (uint8_t data)
 			for (uint8_t i=0; i<5; i++);
 
 			GPIO_PinOutSet(TEMP_DATA_PORT, TEMP_DATA_PIN);
-			USTIMER_DelayIntSafe(60);
+			delayUs(60);
 		}
 		/* If not, write a "0" */
 		else
 		{
 			GPIO_PinOutClear(TEMP_DATA_PORT, TEMP_DATA_PIN);
-			USTIMER_DelayIntSafe(60);
+			delayUs(60);
 			GPIO_PinOutSet(TEMP_DATA_PORT, TEMP_DATA_PIN);
 
 			/* 5 µs delay should be called here but this loop works fine too... */
@@ -380,11 +340,19 @@ static uint8_t readByteFromDS18B20 (void)
 	/* Data to eventually return */
 	uint8_t data = 0x0;
 
+	/* Loops of at least one cycle each for the read slot start, calculated here since
+	 * `delayUs` takes too long (the bit needs to be sampled within 15 µs) */
+	uint32_t lowLoops = ((CMU_ClockFreqGet(cmuClock_CORE) / 1000000) * READ_SLOT_LOW_US) + 1;
+
 	/* Read the byte, bit by bit */
 	for (uint8_t i = 0; i < 8; i++)
 	{
-		/* Change pin-mode to input */
-		GPIO_PinModeSet(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModeInput, 0);
+		/* Pull the line low for at least `READ_SLOT_LOW_US` to start the read slot */
+		GPIO_PinOutClear(TEMP_DATA_PORT, TEMP_DATA_PIN);
+		for (uint32_t n = 0; n < lowLoops; n++) __NOP();
+
+		/* Change pin-mode to input, the sensor keeps the line low for a "0" */
+		PIN_MODE_SET(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModeInput);
 
 		/* Right shift bits once */
 		data >>= 1;
@@ -393,11 +361,12 @@ static uint8_t readByteFromDS18B20 (void)
 		 * 0x80 = 1000 0000 */
 		if (GPIO_PinInGet(TEMP_DATA_PORT, TEMP_DATA_PIN)) data |= 0x80;
 
-		/* In the case of gpioModePushPull", the last argument directly sets the pin state */
-		GPIO_PinModeSet(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModePushPull, 1);
+		/* Drive the data line high again */
+		GPIO_PinOutSet(TEMP_DATA_PORT, TEMP_DATA_PIN);
+		PIN_MODE_SET(TEMP_DATA_PORT, TEMP_DATA_PIN, gpioModePushPull);
 
 		/* Wait some time before going into next loop */
-		USTIMER_DelayIntSafe(70);
+		delayUs(70);
 	}
 	return (data);
 }
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file adc.c
  * @brief ADC functionality for reading the (battery) voltage and internal temperature.
- * @version 2.1
+ * @version 2.5
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -17,6 +17,10 @@
  *   @li v2.0: Disabled peripheral clock before entering an `error` function, added
  *             functionality to exit methods after `error` call and updated version number.
  *   @li v2.1: Removed `static` before the local variables (not necessary).
+ *   @li v2.2: Started adding an event with the sample to the ring in `interrupt.c`.
+ *   @li v2.3: Started sleeping in EM1 with a timeout in milliseconds while waiting on the conversion.
+ *   @li v2.4: Started requesting the HFPER clock in `pm.c`.
+ *   @li v2.5: The timebase and prescaler are recalculated after a HFRCO band change.
  *
  * ******************************************************************************
  *
@@ -56,14 +60,17 @@
 #include "adc.h"           /* Corresponding header file */
 #include "debug_dbprint.h" /* Enable or disable printing to UART for debugging */
 #include "util.h"          /* Utility functionality */
+#include "interrupt.h"     /* Event ring */
+#include "delay.h"         /* Delay functionality */
+#include "pm.h"            /* Shared clocks and HFRCO bands */
 
 
 /* Local definitions */
-/** Enable (1) or disable (0) printing the timeout counter value using DBPRINT */
-#define DBPRINT_TIMEOUT 0
+/** Maximum time in milliseconds to wait on a conversion (it takes some tens of µs) */
+#define TIMEOUT_CONVERSION_MS 5
 
-/** Maximum value for the counter before exiting a `while` loop */
-#define TIMEOUT_CONVERSION 50
+/** ADC clock frequency */
+#define ADC_FREQUENCY 400000
 
 
 /* Local variables */
@@ -74,6 +81,7 @@ ADC_InitSingle_TypeDef initSingle = ADC_INITSINGLE_DEFAULT;
 
 /* Local prototype */
 static float32_t convertToCelsius (int32_t adcSample);
+static void updateADCclock (void);
 
 
 /**************************************************************************//**
@@ -85,8 +93,8 @@ static float32_t convertToCelsius (int32_t adcSample);
  *****************************************************************************/
 void initADC (ADC_Measurement_t peripheral)
 {
-	/* Enable necessary clocks (just in case) */
-	CMU_ClockEnable(cmuClock_HFPER, true); /* ADC0 is a High Frequency Peripheral */
+	/* Enable necessary clocks, HFPER stays requested for the next conversions */
+	PM_ClockRequest(PM_CLOCK_HFPER); /* ADC0 is a High Frequency Peripheral */
 	CMU_ClockEnable(cmuClock_ADC0, true);
 
 	/* Set a timebase providing at least 1 us.
@@ -95,7 +103,7 @@ void initADC (ADC_Measurement_t peripheral)
 
 	/* Set a prescale value according to the ADC frequency (400 000 Hz) wanted.
 	 * If the last argument is "0" the currently defined HFPER clock setting is for the calculation used. */
-	init.prescale = ADC_PrescaleCalc(400000, 0);
+	init.prescale = ADC_PrescaleCalc(ADC_FREQUENCY, 0);
 
 	/* Initialize ADC peripheral */
 	ADC_Init(ADC0, &init);
@@ -139,6 +147,9 @@ void initADC (ADC_Measurement_t peripheral)
 	/* Disable used clock */
 	CMU_ClockEnable(cmuClock_ADC0, false);
 
+	/* Recalculate the timebase and prescaler when the HFPER clock changes */
+	PM_AddBandListener(updateADCclock);
+
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
 	if (peripheral == INTERNAL_TEMPERATURE) dbinfo("ADC0 initialized for internal temperature");
 	else if (peripheral == BATTERY_VOLTAGE) dbinfo("ADC0 initialized for VBAT");
@@ -163,7 +174,6 @@ void initADC (ADC_Measurement_t peripheral)
  *****************************************************************************/
 int32_t readADC (ADC_Measurement_t peripheral)
 {
-	uint16_t counter = 0; /* Timeout counter */
 	int32_t value = 0; /* Value to eventually return */
 
 	/* Enable necessary clock */
@@ -208,11 +218,8 @@ int32_t readADC (ADC_Measurement_t peripheral)
 	/* Start single ADC conversion */
 	ADC_Start(ADC0, adcStartSingle);
 
-	/* Wait until the conversion is completed */
-	while ((counter < TIMEOUT_CONVERSION) && !adcConversionComplete) counter++;
-
-	/* Exit the function if the maximum waiting time was reached */
-	if (counter == TIMEOUT_CONVERSION)
+	/* Wait in EM1 until the conversion is completed, exit the function if the maximum waiting time was reached */
+	if (!waitForFlag(&adcConversionComplete, TIMEOUT_CONVERSION_MS, false))
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
@@ -227,16 +234,6 @@ int32_t readADC (ADC_Measurement_t peripheral)
 		/* Exit function */
 		return (0);
 	}
-#if DBPRINT_TIMEOUT == 1 /* DBPRINT_TIMEOUT */
-	else
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbwarnInt("ADC conversion (", counter, ")");
-#endif /* DEBUG_DBPRINT */
-
-	}
-#endif /* DBPRINT_TIMEOUT */
 
 	/* Get the ADC value */
 	value = ADC_DataSingleGet(ADC0);
@@ -295,6 +292,30 @@ static float32_t convertToCelsius (int32_t adcSample)
 }
 
 
+/**************************************************************************//**
+ * @brief
+ *   Recalculate the ADC timebase and prescaler for the current HFPER clock.
+ *
+ * @details
+ *   This method is called by `pm.c` after a HFRCO band change.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void updateADCclock (void)
+{
+	CMU_ClockEnable(cmuClock_ADC0, true);
+
+	init.timebase = ADC_TimebaseCalc(0);
+	init.prescale = ADC_PrescaleCalc(ADC_FREQUENCY, 0);
+
+	ADC_Init(ADC0, &init);
+
+	CMU_ClockEnable(cmuClock_ADC0, false);
+}
+
+
 /**************************************************************************//**
  * @brief
  *   Interrupt Service Routine for ADC0.
@@ -307,6 +328,9 @@ void ADC0_IRQHandler (void)
 	/* Clear the ADC0 interrupt flags */
 	ADC_IntClear(ADC0, flags);
 
+	/* Add the sample to the event ring (`readADC` can still read the data register afterwards) */
+	EVENT_push(EVENT_ADC, ADC_DataSingleGet(ADC0));
+
 	/* Indicate that an ADC conversion has been completed */
 	adcConversionComplete = true;
 }
@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file cable.c
  * @brief Cable checking functionality.
- * @version 2.1
+ * @version 3.0
  * @author
  *   Matthias Alleman@n
  *   Modified by Brecht Van Eeckhoudt
@@ -19,6 +19,17 @@
  *   @li v2.0: Added functionality to also send taken measurements when a cable break is
  *             detected and updated version number.
  *   @li v2.1: Updated documentation.
+ *   @li v2.2: Added interrupt-driven cable monitoring with a debounce window and
+ *             replaced the four-message cap with a rate limit.
+ *   @li v2.3: Added analog loop measurement using the ACMP and a slowly updated
+ *             baseline to report a degrading cable.
+ *   @li v2.4: Removed `CABLE_triggered`, the interrupt now adds an event to the ring in `interrupt.c`.
+ *   @li v2.5: Replaced USTIMER functionality with `delayUs`.
+ *   @li v2.6: Started requesting and releasing the GPIO and HFPER clocks in `pm.c`.
+ *   @li v2.7: The cable pins are switched using precomputed pin profiles.
+ *   @li v2.8: Polling is the default, warning when the monitor uses the internal pull-up.
+ *   @li v2.9: Documented the resolution of the loop level (no corrosion trend).
+ *   @li v3.0: The ACMP warm-up wait is bounded by the RTC instead of a loop count.
  *
  * ******************************************************************************
  *
@@ -56,32 +67,118 @@
  ******************************************************************************/
 
 
+
+
 #include <stdint.h>        /* (u)intXX_t */
 #include <stdbool.h>       /* "bool", "true", "false" */
 #include "em_device.h"     /* Include necessary MCU-specific header file */
 #include "em_cmu.h"        /* Clock management unit */
 #include "em_gpio.h"       /* General Purpose IO */
+#include "em_acmp.h"       /* Analog comparator */
 
 #include "cable.h"         /* Corresponding header file */
 #include "pin_mapping.h"   /* PORT and PIN definitions */
 #include "debug_dbprint.h" /* Enable or disable printing to UART for debugging */
 #include "lora_wrappers.h" /* LoRaWAN functionality */
 #include "datatypes.h"     /* Definitions of the custom data-types */
+#include "util.h"          /* Utility functionality */
+#include "delay.h"         /* Delay functionality */
+#include "pm.h"            /* Shared clocks */
+
+
+/* Local definitions */
+/** Maximum amount of cable-broken messages that can be send back-to-back */
+#define ALARM_BURST           2
+
+/** Amount of `checkCable` calls (measurement cycles) it takes to earn back one cable-broken message */
+#define ALARM_REFILL_CYCLES   20
+
+/** Amount of samples which all need to read "broken" before a monitor interrupt is accepted */
+#define DEBOUNCE_SAMPLES      4
+
+/** Time between two debounce samples in microseconds */
+#define DEBOUNCE_INTERVAL_US  5000
+
+/** Maximum time in milliseconds to wait on the ACMP warm-up (512 HFPERCLK cycles, at least one RTC tick more) */
+#define TIMEOUT_WARMUP_MS     2
+
+/** Time for the ACMP output to settle after changing the reference level in microseconds */
+#define ACMP_SETTLE_US        10
+
+/** Amount of measurements used to learn the initial baseline (averaged) */
+#define BASELINE_LEARN        8
+
+/** After learning, the baseline follows the measured level with a weight of 1/2^BASELINE_SHIFT */
+#define BASELINE_SHIFT        8
+
+/** Amount of levels (1/63 VDD each, about `Rpullup / 63` of loop resistance) above the baseline for the cable to be considered degrading */
+#define DRIFT_LEVELS          4
+
+#if (CABLE_MONITOR == 1) && (CABLE_EXTERNAL_PULLUP == 0)
+#warning "The cable monitor with the internal pull-up draws about 80 uA continuously, fit a high-value pull-up (CABLE_EXTERNAL_PULLUP)."
+#endif
+
+#if CABLE_EXTERNAL_PULLUP == 1 /* External pull-up resistor */
+/** Mode of the first pin, a set DOUT enables the filter */
+#define BREAK1_MODE           gpioModeInput
+#else /* Internal pull-up resistor */
+/** Mode of the first pin, a set DOUT selects the pull-up */
+#define BREAK1_MODE           gpioModeInputPullFilter
+#endif /* Pull-up resistor selection */
+
+/** Cable pins while checking, the second pin is set low */
+#define CABLE_PINS_ON(X, p)                       \
+	X(p, BREAK1_PORT, BREAK1_PIN, BREAK1_MODE, 1) \
+	X(p, BREAK2_PORT, BREAK2_PIN, gpioModePushPull, 0)
+
+/** Cable pins while not checking */
+#define CABLE_PINS_OFF(X, p)                           \
+	X(p, BREAK1_PORT, BREAK1_PIN, gpioModeDisabled, 0) \
+	X(p, BREAK2_PORT, BREAK2_PIN, gpioModeDisabled, 0)
+
+
+/* Local variables */
+/** Amount of cable-broken messages which can still be send right now */
+uint8_t alarmTokens = ALARM_BURST;
+
+/** Amount of `checkCable` calls since the last earned back message */
+uint8_t alarmRefillCycles = 0;
+
+/** Baseline of the loop level, multiplied by 256 to keep some decimals */
+int32_t baseline = 0;
+
+/** Amount of measurements already used for the baseline (stops counting at `BASELINE_LEARN`) */
+uint8_t baselineSamples = 0;
 
+/** Keep if the last measured level drifted `DRIFT_LEVELS` above the baseline */
+bool cableDegraded = false;
 
-/* Local variable */
-/** Keep the amount of times a message has been send to indicate the cable is broken (only send 4 messages in total) */
-uint8_t cableBrokenSendTimes = 0;
+/** Keep if a *degrading* message has already been send (only one per episode) */
+bool degradedReported = false;
 
+/** Precomputed pin profiles for `configCablePins` */
+const PinProfile_t cablePinsOn = PIN_PROFILE(CABLE_PINS_ON);
+const PinProfile_t cablePinsOff = PIN_PROFILE(CABLE_PINS_OFF);
 
-/* Local prototype */
+
+/* Local prototypes */
 static bool checkCable_internal (void);
+static void configCablePins (bool enabled);
 
 
 /**************************************************************************//**
  * @brief
  *   Method to check if the wire is broken.
  *
+ * @details
+ *   Cable-broken messages are rate limited: at most `ALARM_BURST` of them can
+ *   be send back-to-back and one more is earned back every `ALARM_REFILL_CYCLES`
+ *   calls of this method.
+ *
+ *   If the cable is still intact but `readCableLevel` saw the loop drift above
+ *   its baseline, a *degrading* message is send instead. This happens only
+ *   once until the level drops back towards the baseline.
+ *
  * @param[in] data
  *   The struct which contains the measurements to send using LoRaWAN.
  *
@@ -91,11 +188,23 @@ static bool checkCable_internal (void);
  *****************************************************************************/
 bool checkCable (MeasurementData_t data)
 {
+	/* Earn back one message if necessary */
+	if (alarmTokens < ALARM_BURST)
+	{
+		alarmRefillCycles++;
+
+		if (alarmRefillCycles >= ALARM_REFILL_CYCLES)
+		{
+			alarmTokens++;
+			alarmRefillCycles = 0;
+		}
+	}
+
 	/* Check if the cable is broken */
 	if (!checkCable_internal())
 	{
-		/* Only send a message 4 times */
-		if (cableBrokenSendTimes < 4)
+		/* Only send a message if the rate limit allows it */
+		if (alarmTokens > 0)
 		{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
@@ -104,12 +213,12 @@ bool checkCable (MeasurementData_t data)
 
 			initLoRaWAN(); /* Initialize LoRaWAN functionality */
 
-			sendCableBroken(true);  /* Send the LoRaWAN message */
-			sendMeasurements(data); /* Send the measurements */
+			sendCableBroken(CABLE_BROKEN); /* Send the LoRaWAN message */
+			sendMeasurements(data);        /* Send the measurements */
 
 			disableLoRaWAN(); /* Disable RN2483 */
 
-			cableBrokenSendTimes++; /* Increment the counter */
+			alarmTokens--; /* Use up one message */
 
 			return (true);
 		}
@@ -117,21 +226,265 @@ bool checkCable (MeasurementData_t data)
 		{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-			dbcrit("Cable broken but no longer sending the data");
+			dbcrit("Cable broken but rate limit reached, not sending the data");
 #endif /* DEBUG_DBPRINT */
 
 			return (false);
 		}
 	}
+
+#if CABLE_MONITOR == 1 /* CABLE_MONITOR */
+	/* Re-arm the monitor interrupt in case it was disabled after a detected break */
+	GPIO_IntClear(1 << BREAK1_PIN);
+	GPIO_IntEnable(1 << BREAK1_PIN);
+#endif /* CABLE_MONITOR */
+
+	/* Check if the cable is degrading, only send one message for each episode */
+	if (cableDegraded && !degradedReported)
+	{
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbwarn("Cable degrading! Sending the data ...");
+#endif /* DEBUG_DBPRINT */
+
+		initLoRaWAN(); /* Initialize LoRaWAN functionality */
+
+		sendCableBroken(CABLE_DEGRADED); /* Send the LoRaWAN message */
+		sendMeasurements(data);          /* Send the measurements */
+
+		disableLoRaWAN(); /* Disable RN2483 */
+
+		degradedReported = true;
+
+		return (true);
+	}
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbinfo("Cable still intact");
+#endif /* DEBUG_DBPRINT */
+
+	return (false);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Method to measure the resistance of the loop as a fraction of VDD.
+ *
+ * @details
+ *   `BREAK_2` is low and `BREAK_1` is pulled high, so the voltage on `BREAK_1`
+ *   is `VDD * Rloop / (Rloop + Rpullup)`. This voltage is compared by ACMP0
+ *   against its internal VDD divider (`VDD * level / 63`) with a 6-step
+ *   successive approximation. Because both sides scale with VDD, the result
+ *   doesn't depend on the battery voltage.
+ *
+ *   The ACMP (and the loop if `CABLE_MONITOR` is `0`) is only powered for the
+ *   warm-up time and the six comparisons (about 100 µs).
+ *
+ *   The pull-up is the top of the divider, so near a healthy (low) loop one
+ *   level is about `Rpullup / 63`: 650 Ohm with the internal pull-up (~40 kOhm)
+ *   and 16 kOhm with a 1 MOhm external one. `DRIFT_LEVELS` therefore needs kOhms
+ *   of extra loop resistance: this is a coarse second break or leak detector,
+ *   the slow resistance change of corrosion stays below one level.
+ *
+ *   The result also updates the baseline. The first `BASELINE_LEARN` results
+ *   are averaged, after that the baseline follows with a weight of
+ *   1/2^`BASELINE_SHIFT` (a few days when waking up every 30 minutes). Results
+ *   which are considered degrading are kept out of the baseline.
+ *
+ * @return
+ *   The loop level (`0` = short, `63` = open). Divide by 63 to get the fraction of VDD.
+ *****************************************************************************/
+uint8_t readCableLevel (void)
+{
+	uint8_t level = 0; /* Value to eventually return */
+
+	ACMP_Init_TypeDef acmpInit = ACMP_INIT_DEFAULT;
+	acmpInit.vddLevel = 0;
+	acmpInit.enable = false;
+
+	/* Enable necessary clocks (ACMP0 is a High Frequency Peripheral, GPIO also requests HFPER) */
+	PM_ClockRequest(PM_CLOCK_GPIO);
+	CMU_ClockEnable(cmuClock_ACMP0, true);
+
+#if CABLE_MONITOR == 0 /* CABLE_MONITOR */
+	/* Power the loop */
+	configCablePins(true);
+#endif /* CABLE_MONITOR */
+
+	/* Initialize ACMP0, negative input = scaled VDD, positive input = BREAK_1 */
+	ACMP_Init(ACMP0, &acmpInit);
+	ACMP_ChannelSet(ACMP0, acmpChannelVDD, BREAK1_ACMP_CHANNEL);
+	ACMP_Enable(ACMP0);
+
+	/* Wait until the warm-up time has passed (too short to sleep, so it's a busy wait bounded by the RTC) */
+	uint32_t start = RTC_getTicks();
+	uint32_t ticks = RTC_secondsToTicks(1) / (1000 / TIMEOUT_WARMUP_MS);
+	while (!(ACMP0->STATUS & ACMP_STATUS_ACMPACT) && ((RTC_getTicks() - start) < ticks));
+
+	/* Exit the function if the maximum waiting time was reached */
+	if (!(ACMP0->STATUS & ACMP_STATUS_ACMPACT))
+	{
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbcrit("Waiting time for ACMP warm-up reached!");
+#endif /* DEBUG_DBPRINT */
+
+		/* Disable the ACMP and used clocks */
+		ACMP_Reset(ACMP0);
+		CMU_ClockEnable(cmuClock_ACMP0, false);
+		PM_ClockRelease(PM_CLOCK_GPIO);
+
+#if CABLE_MONITOR == 0 /* CABLE_MONITOR */
+		configCablePins(false);
+#endif /* CABLE_MONITOR */
+
+		error(56);
+
+		/* Exit function */
+		return (0);
+	}
+
+	/* Successive approximation, the output is high if BREAK_1 is above the reference */
+	for (int8_t bit = 5; bit >= 0; bit--)
+	{
+		uint8_t trial = level | (1 << bit);
+
+		ACMP0->INPUTSEL = (ACMP0->INPUTSEL & ~_ACMP_INPUTSEL_VDDLEVEL_MASK) | (trial << _ACMP_INPUTSEL_VDDLEVEL_SHIFT);
+
+		delayUs(ACMP_SETTLE_US);
+
+		if (ACMP0->STATUS & ACMP_STATUS_ACMPOUT) level = trial;
+	}
+
+	/* Disable the ACMP and used clocks */
+	ACMP_Reset(ACMP0);
+	CMU_ClockEnable(cmuClock_ACMP0, false);
+	PM_ClockRelease(PM_CLOCK_GPIO);
+
+#if CABLE_MONITOR == 0 /* CABLE_MONITOR */
+	/* Disable the loop */
+	configCablePins(false);
+#endif /* CABLE_MONITOR */
+
+	/* Update the baseline and check the drift */
+	int32_t scaledLevel = ((int32_t) level) << 8;
+
+	if (baselineSamples < BASELINE_LEARN)
+	{
+		/* Running average while learning */
+		baselineSamples++;
+		baseline += (scaledLevel - baseline) / baselineSamples;
+		cableDegraded = false;
+	}
+	else
+	{
+		cableDegraded = (scaledLevel >= (baseline + (DRIFT_LEVELS << 8)));
+
+		/* Only let the baseline follow "healthy" results */
+		if (!cableDegraded) baseline += (scaledLevel - baseline) / (1 << BASELINE_SHIFT);
+
+		/* Allow a new degrading message once the level is back below half the drift threshold */
+		if (scaledLevel < (baseline + (DRIFT_LEVELS << 7))) degradedReported = false;
+	}
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbinfoInt("Cable level: ", level, "/63");
+	dbinfoInt("Cable baseline: ", (baseline >> 8), "/63");
+#endif /* DEBUG_DBPRINT */
+
+	return (level);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Initialize the interrupt-driven cable monitor.
+ *
+ * @details
+ *   `BREAK_2` is kept low and `BREAK_1` is pulled high, so a broken loop
+ *   makes `BREAK_1` rise. A rising-edge interrupt on `BREAK_1` wakes the MCU
+ *   from EM2/EM3. Check the section @ref CABLE "Cable monitoring" in
+ *   `documentation.h` for the current this draws while the loop is intact.
+ *
+ * @note
+ *   If `CABLE_MONITOR` is `0` this method doesn't do anything and the cable
+ *   only gets checked once every measurement cycle.
+ *****************************************************************************/
+void initCableMonitor (void)
+{
+
+#if CABLE_MONITOR == 1 /* CABLE_MONITOR */
+
+	/* The GPIO clock stays requested while the loop is monitored */
+	PM_ClockRequest(PM_CLOCK_GPIO);
+
+	/* Keep the loop powered */
+	configCablePins(true);
+
+	/* Clear the interrupt flag of BREAK_1 (just in case) */
+	GPIO_IntClear(1 << BREAK1_PIN);
+
+	/* Enable rising-edge interrupts for BREAK_1, the IRQs themselves are enabled in `initGPIOwakeup` */
+	GPIO_ExtIntConfig(BREAK1_PORT, BREAK1_PIN, BREAK1_PIN, true, false, true);
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbinfo("Cable monitor initialized");
+#endif /* DEBUG_DBPRINT */
+
+#endif /* CABLE_MONITOR */
+
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Method to check if a monitor interrupt was caused by a real cable break.
+ *
+ * @details
+ *   `BREAK_1` gets sampled `DEBOUNCE_SAMPLES` times, `DEBOUNCE_INTERVAL_US`
+ *   apart.
+ *
+ *   If the break is confirmed, the monitor interrupt gets disabled so a wire
+ *   flapping in the water can't keep waking up the MCU. It's enabled again
+ *   by `checkCable` once the cable reads intact.
+ *
+ * @return
+ *   @li `true` - The cable is broken.
+ *   @li `false` - The interrupt was caused by a glitch.
+ *****************************************************************************/
+bool CABLE_confirmBreak (void)
+{
+	/* Value to eventually return */
+	bool broken = true;
+
+	for (uint8_t i = 0; i < DEBOUNCE_SAMPLES; i++)
+	{
+		delayUs(DEBOUNCE_INTERVAL_US);
+
+		if (checkCable_internal()) broken = false;
+	}
+
+	if (broken)
+	{
+		/* Disable the monitor interrupt until the cable reads intact again */
+		GPIO_IntDisable(1 << BREAK1_PIN);
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbcrit("Cable break detected by the monitor");
+#endif /* DEBUG_DBPRINT */
+
+	}
 	else
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbinfo("Cable still intact");
+		dbwarn("Cable monitor glitch ignored");
 #endif /* DEBUG_DBPRINT */
 
-		return (false);
 	}
+
+	return (broken);
 }
 
 
@@ -140,8 +493,10 @@ bool checkCable (MeasurementData_t data)
  *   Method to check if the wire is broken.
  *
  * @details
- *   This method enables the necessary GPIO clocks, sets the mode of the pins,
- *   checks the connection between them and also disables them at the end.
+ *   If `CABLE_MONITOR` is `0` this method enables the necessary GPIO clocks,
+ *   sets the mode of the pins, checks the connection between them and also
+ *   disables them at the end. If `CABLE_MONITOR` is `1` the pins are always
+ *   configured so only the input gets read.
  *
  * @note
  *   This is a static method because it's only internally used in this file
@@ -156,22 +511,53 @@ static bool checkCable_internal (void)
 	/* Value to eventually return */
 	bool check = false;
 
-	/* Enable necessary clocks (just in case) */
-	CMU_ClockEnable(cmuClock_HFPER, true); /* GPIO is a High Frequency Peripheral */
-	CMU_ClockEnable(cmuClock_GPIO, true);
+#if CABLE_MONITOR == 0 /* CABLE_MONITOR */
+
+	/* Request the necessary clock */
+	PM_ClockRequest(PM_CLOCK_GPIO);
 
-	/* Change mode of first pin */
-	GPIO_PinModeSet(BREAK1_PORT, BREAK1_PIN, gpioModeInput, 0);
+	/* Enable the pins */
+	configCablePins(true);
 
-	/* Change mode of second pin and also set it low with the last argument */
-	GPIO_PinModeSet(BREAK2_PORT, BREAK2_PIN, gpioModePushPull, 0);
+#endif /* CABLE_MONITOR */
 
 	/* Check the connection */
-	if (!GPIO_PinInGet(BREAK1_PORT,BREAK1_PIN)) check = true;
+	if (!GPIO_PinInGet(BREAK1_PORT, BREAK1_PIN)) check = true;
+
+#if CABLE_MONITOR == 0 /* CABLE_MONITOR */
 
 	/* Disable the pins */
-	GPIO_PinModeSet(BREAK1_PORT, BREAK1_PIN, gpioModeDisabled, 0);
-	GPIO_PinModeSet(BREAK2_PORT, BREAK2_PIN, gpioModeDisabled, 0);
+	configCablePins(false);
+
+	PM_ClockRelease(PM_CLOCK_GPIO);
+
+#endif /* CABLE_MONITOR */
 
 	return (check);
 }
+
+
+/**************************************************************************//**
+ * @brief
+ *   Method to enable or disable the cable checking pins.
+ *
+ * @details
+ *   `BREAK_2` is set low and `BREAK_1` becomes an input. There is no pull-up
+ *   resistor on the board so, unless `CABLE_EXTERNAL_PULLUP` is `1`, the
+ *   internal pull-up of `BREAK_1` is used. Without any pull-up the input
+ *   would float when the cable is broken.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] enabled
+ *   @li `true` - Enable the pins.
+ *   @li `false` - Disable the pins.
+ *****************************************************************************/
+static void configCablePins (bool enabled)
+{
+	/* Both pins are on the same port so this is one write per register */
+	if (enabled) applyPinProfile(&cablePinsOn);
+	else applyPinProfile(&cablePinsOff);
+}
@@ -0,0 +1,374 @@
+/***************************************************************************//**
+ * @file config.c
+ * @brief Runtime settings which can be changed with a downlink.
+ * @version 1.1
+ * @author Brecht Van Eeckhoudt
+ *
+ * ******************************************************************************
+ *
+ * @section Versions
+ *
+ *   @li v1.0: Moved the sampling settings from `main.c` to this file, they can be
+ *             changed with a downlink and are kept in the user data page.
+ *   @li v1.1: Added the output power and `CONFIG_setLink` for the link manager.
+ *
+ * ******************************************************************************
+ *
+ * @section DOWNLINK Configuration downlinks
+ *
+ *   A downlink on port `CONFIG_DOWNLINK_PORT` contains one or more commands, each
+ *   a command code followed by its value (multi-byte values MSB first):
+ *     - **0x01 + 2 bytes:** Wake-up period in seconds (`60 - 65 535`)
+ *     - **0x02 + 1 byte:** Storm interrupts (`1 - 255`)
+ *     - **0x03 + 1 byte:** Accelerometer threshold [g] (`1 - 8`)
+ *     - **0x04 + 1 byte:** Accelerometer ODR (`ADXL_ODR_t`, `0 - 5`)
+ *     - **0x05 + 1 byte:** Measurements per uplink (`1 - 6`)
+ *     - **0x06 + 1 byte:** Data rate (`LoRaDataRate_t`, `0 = SF12` - `5 = SF7`)
+ *     - **0x07 + 1 byte:** Output power (`1 = 14 dBm` - `5 = 2 dBm`)
+ *
+ *   The downlink is checked completely before anything is changed, so either all
+ *   of its commands are applied or none of them. The result is sent back with the
+ *   next uplink (`LPP_CONFIG_ACK_CHANNEL`): `CONFIG_ACK_OK`, the code of the first
+ *   command with a value out of range or `CONFIG_ACK_MALFORMED` (unknown command,
+ *   missing value). Example: `01 07 08 05 03` = wake up every 1800 s, send every 3
+ *   measurements.
+ *
+ *   The data rate and output power are used after a (new) join and applied right
+ *   away. Afterwards they're changed by ADR or the link manager (see `link.c`),
+ *   which also stores its choice here with `CONFIG_setLink`.
+ *
+ * ******************************************************************************
+ *
+ * @section FLASH User data page
+ *
+ *   The settings are written to the user data page (`USERDATA_BASE`, 1 kB) which
+ *   isn't touched when the MCU gets flashed again. The page is only erased when a
+ *   downlink really changes something, and the copy is only used at startup if its
+ *   magic value and check value match.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#include <stdint.h>        /* (u)intXX_t */
+#include <stdbool.h>       /* "bool", "true", "false" */
+#include <string.h>        /* memcmp */
+#include "em_device.h"     /* Include necessary MCU-specific header file */
+#include "em_msc.h"        /* Memory System Controller (flash writes) */
+
+#include "config.h"        /* Corresponding header file */
+#include "ADXL362.h"       /* Functions related to the accelerometer */
+#include "lora.h"          /* LoRaDataRate_t */
+#include "lora_settings.h" /* DEFAULT_DATA_RATE, DEFAULT_TX_POWER */
+#include "debug_dbprint.h" /* Enable or disable printing to UART */
+#include "util.h"          /* Utility functionality */
+
+
+/* Local definitions */
+/** Value to indicate valid settings in the user data page */
+#define CONFIG_MAGIC 0xC0F16002
+
+/** Command codes in a configuration downlink */
+#define CONFIG_CMD_WAKE_UP_PERIOD  0x01
+#define CONFIG_CMD_STORM           0x02
+#define CONFIG_CMD_ADXL_THRESHOLD  0x03
+#define CONFIG_CMD_ADXL_ODR        0x04
+#define CONFIG_CMD_MEASUREMENTS    0x05
+#define CONFIG_CMD_DATA_RATE       0x06
+#define CONFIG_CMD_TX_POWER        0x07
+
+/** Settings as they are kept in the user data page */
+typedef struct
+{
+	uint32_t magic;
+	Settings_t settings;
+	uint32_t check;
+} SettingsRecord_t;
+
+
+/* Local variables */
+/** The settings in use */
+static Settings_t settings;
+
+
+/* Local prototypes */
+static uint32_t calculateCheck (const Settings_t *values);
+static void storeSettings (void);
+static void applyADXL (void);
+
+
+/**************************************************************************//**
+ * @brief
+ *   Load the settings.
+ *
+ * @details
+ *   The settings in the user data page are used if they are valid, otherwise
+ *   the default values (`WAKE_UP_PERIOD_S`, ...) are used.
+ *
+ * @note
+ *   This needs to be called before the accelerometer gets configured.
+ *****************************************************************************/
+void initConfig (void)
+{
+	const SettingsRecord_t *record = (const SettingsRecord_t *) USERDATA_BASE;
+
+	if ((record->magic == CONFIG_MAGIC) && (record->check == calculateCheck(&record->settings)))
+	{
+		settings = record->settings;
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbinfoInt("Settings loaded, wake-up period: ", settings.wakeUpPeriod, " s");
+#endif /* DEBUG_DBPRINT */
+
+	}
+	else
+	{
+		settings.wakeUpPeriod = WAKE_UP_PERIOD_S;
+		settings.stormInterrupts = STORM_INTERRUPTS;
+		settings.adxlThreshold = ADXL_THRESHOLD;
+		settings.adxlODR = ADXL_ODR;
+		settings.measurements = MEASUREMENTS_PER_UPLINK;
+		settings.dataRate = DEFAULT_DATA_RATE;
+		settings.txPower = DEFAULT_TX_POWER;
+	}
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Get the settings in use.
+ *
+ * @return
+ *   The pointer to the settings.
+ *****************************************************************************/
+const Settings_t * CONFIG_get (void)
+{
+	return (&settings);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Keep the data rate and output power chosen by the link manager.
+ *
+ * @details
+ *   The user data page is only written if one of them changed, the hysteresis
+ *   of the link manager keeps this rare.
+ *
+ * @param[in] dataRate
+ *   The `LoRaDataRate_t` value in use.
+ *
+ * @param[in] txPower
+ *   The output power index in use.
+ *****************************************************************************/
+void CONFIG_setLink (uint8_t dataRate, uint8_t txPower)
+{
+	if ((settings.dataRate == dataRate) && (settings.txPower == txPower)) return; /* Exit function */
+
+	settings.dataRate = dataRate;
+	settings.txPower = txPower;
+
+	storeSettings();
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Check and apply a configuration downlink.
+ *
+ * @details
+ *   The commands are described in `config.c`. If the accelerometer settings
+ *   change it's configured again, the data rate and output power need to be
+ *   applied by the caller.
+ *
+ * @param[in] port
+ *   The port the downlink was received on.
+ *
+ * @param[in] data
+ *   The downlink payload.
+ *
+ * @param[in] length
+ *   The length of the payload.
+ *
+ * @return
+ *   The value to acknowledge the downlink with (`CONFIG_ACK_xxx` or the code
+ *   of the rejected command).
+ *****************************************************************************/
+uint8_t CONFIG_handleDownlink (uint8_t port, const uint8_t *data, uint8_t length)
+{
+	if ((port != CONFIG_DOWNLINK_PORT) || (length == 0)) return (CONFIG_ACK_MALFORMED);
+
+	/* Work on a copy, nothing changes if one of the commands is wrong */
+	Settings_t updated = settings;
+
+	uint8_t i = 0;
+	while (i < length)
+	{
+		uint8_t command = data[i++];
+
+		if (command == CONFIG_CMD_WAKE_UP_PERIOD)
+		{
+			if ((length - i) < 2) return (CONFIG_ACK_MALFORMED);
+
+			uint16_t period = (data[i] << 8) | data[i + 1];
+			i += 2;
+
+			if (period < 60) return (command);
+			updated.wakeUpPeriod = period;
+		}
+		else if ((command >= CONFIG_CMD_STORM) && (command <= CONFIG_CMD_TX_POWER))
+		{
+			if ((length - i) < 1) return (CONFIG_ACK_MALFORMED);
+
+			uint8_t value = data[i++];
+
+			if (command == CONFIG_CMD_STORM)
+			{
+				if (value < 1) return (command);
+				updated.stormInterrupts = value;
+			}
+			else if (command == CONFIG_CMD_ADXL_THRESHOLD)
+			{
+				if ((value < 1) || (value > 8)) return (command);
+				updated.adxlThreshold = value;
+			}
+			else if (command == CONFIG_CMD_ADXL_ODR)
+			{
+				if (value > ADXL_ODR_400_HZ) return (command);
+				updated.adxlODR = value;
+			}
+			else if (command == CONFIG_CMD_MEASUREMENTS)
+			{
+				if ((value < 1) || (value > MEASUREMENTS_PER_UPLINK)) return (command);
+				updated.measurements = value;
+			}
+			else if (command == CONFIG_CMD_DATA_RATE)
+			{
+				if (value > SF7_BW125) return (command);
+				updated.dataRate = value;
+			}
+			else
+			{
+				if ((value < 1) || (value > 5)) return (command);
+				updated.txPower = value;
+			}
+		}
+		else return (CONFIG_ACK_MALFORMED);
+	}
+
+	/* Nothing to do if the values didn't change */
+	if (memcmp(&updated, &settings, sizeof(Settings_t)) == 0) return (CONFIG_ACK_OK);
+
+	bool adxlChanged = (updated.adxlThreshold != settings.adxlThreshold) || (updated.adxlODR != settings.adxlODR);
+
+	settings = updated;
+
+	storeSettings();
+
+	if (adxlChanged) applyADXL();
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbwarnInt("Settings changed, wake-up period: ", settings.wakeUpPeriod, " s");
+#endif /* DEBUG_DBPRINT */
+
+	return (CONFIG_ACK_OK);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Calculate the check value of the settings.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] values
+ *   The settings to calculate the check value of.
+ *
+ * @return
+ *   The check value.
+ *****************************************************************************/
+static uint32_t calculateCheck (const Settings_t *values)
+{
+	return (~(values->wakeUpPeriod ^
+			 (values->stormInterrupts | (values->adxlThreshold << 8) | (values->adxlODR << 16) | (values->measurements << 24)) ^
+			 (values->dataRate << 4) ^ (values->txPower << 12)));
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Write the settings to the user data page.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void storeSettings (void)
+{
+	SettingsRecord_t record;
+
+	record.magic = CONFIG_MAGIC;
+	record.settings = settings;
+	record.check = calculateCheck(&settings);
+
+	MSC_Init();
+
+	if ((MSC_ErasePage((uint32_t *) USERDATA_BASE) != mscReturnOk) ||
+		(MSC_WriteWord((uint32_t *) USERDATA_BASE, &record, sizeof(SettingsRecord_t)) != mscReturnOk))
+	{
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbcrit("Settings couldn't be written to flash!");
+#endif /* DEBUG_DBPRINT */
+
+		error(60); /* The new settings are still used until the next reset */
+	}
+
+	MSC_Deinit();
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Configure the accelerometer again with the threshold and ODR in use.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void applyADXL (void)
+{
+	ADXL_enableSPI(true);
+
+	ADXL_enableMeasure(false); /* Standby while changing the settings */
+
+	ADXL_configODR((ADXL_ODR_t) settings.adxlODR);
+
+	ADXL_configActivity(settings.adxlThreshold);
+
+	ADXL_enableMeasure(true);
+
+	ADXL_ackInterrupt(); /* Acknowledge an interrupt caused by reconfiguring */
+
+	ADXL_enableSPI(false);
+}
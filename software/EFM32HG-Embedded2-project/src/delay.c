@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file delay.c
  * @brief Delay functionality.
- * @version 3.2
+ * @version 4.8
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -29,6 +29,19 @@
  *             functionality to exit methods after `error` call and updated version number.
  *   @li v3.1: Removed `static` before some local variables (not necessary).
  *   @li v3.2: Moved `msTicks` variable and systick handler in `#if` check.
+ *   @li v3.3: Replaced `RTC_sleep_wakeup` with an event added to the ring in `interrupt.c`.
+ *   @li v3.4: Started feeding the watchdog using RTC compare channel 1 during delays and sleeps.
+ *   @li v4.0: Replaced the single RTC compare delay/sleep logic with a free-running RTC timebase
+ *             and a sorted queue of (one-shot and periodic) software timers.
+ *   @li v4.1: Added `sleepUntil` (absolute deadlines) and a monotonic uptime, removed `RTC_getPassedSleeptime`.
+ *   @li v4.2: Removed the 24-bit limit on delays, sleeps and timers.
+ *   @li v4.3: Added ULFRCO calibration (with a table per temperature range) used in all tick/time conversions.
+ *   @li v4.4: Added `LFXO_request` and `LFXO_release` to only run the LFXO when necessary.
+ *   @li v4.5: Replaced the SysTick/RTC delay selection with a choice per call between a busy wait,
+ *             an EM1 wait (TIMER1) and an EM2/3 wait (RTC), added `delayUs` and statistics.
+ *   @li v4.6: Added `waitForFlag` to sleep until an interrupt handler sets a flag (with a timeout).
+ *   @li v4.7: Started requesting the HFPER clock for EM1 delays in `pm.c`.
+ *   @li v4.8: The uptime isn't rescaled when the ULFRCO frequency changes, `measureULFRCO` restores SysTick.
  *
  * ******************************************************************************
  *
@@ -37,7 +50,72 @@
  *     - Split definition to use the `ULFRCO` for the *delay* and *sleep* method separately.
  *         - This isn't that easy because of the common INIT method.
  *         - Don't forget to update `documentation.h` if this functionality is changed.
- *     - Enable/disable clock functionality? (see comments using `//`)
+ *
+ * ******************************************************************************
+ *
+ * @section TIMERS Software timers
+ *
+ *   The RTC isn't started and stopped for every delay anymore, it keeps counting
+ *   from the first use. Its 24-bit counter is extended to 32 bits by counting the
+ *   overflows (`RTC_getTicks`), this is the timebase for all of the timers.
+ *
+ *   Each `Timer_t` is kept in a queue sorted on its deadline, compare channel 0
+ *   is always programmed with the earliest one. If this deadline is more than
+ *   one RTC overflow away, the compare interrupt is disabled and only the
+ *   overflow interrupt wakes the MCU (shortly) until the deadline is close
+ *   enough. This way timers can be longer than the 24-bit counter (up to 2^31
+ *   ticks, about 24 days with the ULFRCO and 18 hours with the LFXO). Any amount
+ *   of timers can be running at the same time (the `delay` and `sleep` methods
+ *   also use one).
+ *   Periodic timers get their next deadline by adding the period to the previous
+ *   deadline so they don't drift.
+ *
+ *   While waiting on a timer the MCU goes to EM3 (ULFRCO) or EM2 (LFXO) until
+ *   something happens. Interrupts which don't finish the wait (for example another
+ *   timer or the periodic watchdog feed) only wake the MCU up for a short time.
+ *
+ * ******************************************************************************
+ *
+ * @section HYBRID Delay mechanisms
+ *
+ *   `delay` and `delayUs` choose the mechanism with the lowest energy usage
+ *   which is still precise enough for the requested time:
+ *     - Below `DELAY_EM1_MIN_US` a busy wait in EM0 is used (SysTick counts the core
+ *       clock cycles). Setting up a timer and entering EM1 would take longer than this.
+ *     - Below `DELAY_RTC_MIN_TICKS` RTC ticks TIMER1 wakes the MCU from EM1. One RTC
+ *       tick is a large part of these delays, especially when using the ULFRCO.
+ *     - Otherwise the MCU waits in EM2/3 on an RTC timer.
+ *
+ *   The EM1 wake-up latency is measured after each EM1 delay (TIMER1 keeps counting)
+ *   and subtracted from the next one. `DELAY_getStats` gives the amount of calls, the
+ *   time spent and the measured overshoot for each mechanism. Combined with the current
+ *   in each energy mode this gives the energy used by the delays.
+ *
+ * ******************************************************************************
+ *
+ * @section CALIBRATION ULFRCO calibration
+ *
+ *   The ULFRCO can be quite far from 1 kHz and also changes with the temperature.
+ *   `RTC_calibrate` counts the core clock cycles (HFRCO, using SysTick) during a
+ *   fixed amount of RTC ticks to calculate the actual frequency. The HFRCO is
+ *   factory calibrated and a lot more stable, so this gets the timing close to
+ *   the one of the LFXO while still being able to use EM3.
+ *
+ *   The measured frequencies are kept in a table per `CAL_TEMP_STEP` range of the
+ *   internal temperature. A range is only measured again every `CAL_INTERVAL` calls,
+ *   otherwise the value from the table is used. Timers which are already running
+ *   keep their deadline (in ticks) if the frequency changes.
+ *
+ * ******************************************************************************
+ *
+ * @section LFXO LFXO on request
+ *
+ *   If the RTC runs on the ULFRCO, the LFXO is only started for the modules that
+ *   need it (the LEUART for the RN2483) using `LFXO_request`. It's started without
+ *   waiting on it, so it can become stable while the caller does other work (for
+ *   example resetting the RN2483). While it's requested, waiting is done in EM2
+ *   instead of EM3 so it keeps running. After the last `LFXO_release` it's disabled
+ *   again. The RTC itself always stays on the ULFRCO so the timebase isn't affected.
  *
  * ******************************************************************************
  *
@@ -70,196 +148,243 @@
 
 #include <stdint.h>        /* (u)intXX_t */
 #include <stdbool.h>       /* "bool", "true", "false" */
+#include <stddef.h>        /* NULL */
 #include "em_device.h"     /* Include necessary MCU-specific header file */
 #include "em_cmu.h"        /* Clock management unit */
 #include "em_emu.h"        /* Energy Management Unit */
-#include "em_gpio.h"       /* General Purpose IO */
 #include "em_rtc.h"        /* Real Time Counter (RTC) */
+#include "em_core.h"       /* Core interrupt handling */
+#include "em_timer.h"      /* Timers (EM1 delays) */
 
 #include "delay.h"         /* Corresponding header file */
-#include "pin_mapping.h"   /* PORT and PIN definitions */
 #include "debug_dbprint.h" /* Enable or disable printing to UART */
 #include "util.h"    	   /* Utility functionality */
+#include "interrupt.h"     /* Event ring */
+#include "fault.h"         /* Watchdog functionality */
+#include "pm.h"            /* Shared clocks */
 
 
 /* Local definitions (for RTC compare interrupts) */
 #define ULFRCOFREQ    1000
-#define ULFRCOFREQ_MS 1.000
 #define LFXOFREQ      32768
-#define LFXOFREQ_MS   32.768
 
+#if ULFRCO == 1 /* ULFRCO selected */
+#define RTC_FREQ      ULFRCOFREQ
+#else /* LFXO selected */
+#define RTC_FREQ      LFXOFREQ
+#endif /* ULFRCO/LFXO selection */
 
-/* Local variables */
-/*   -> Volatile because it's modified by an interrupt service routine (@RAM)
- *   -> Static so it's always kept in memory (@data segment, space provided during compile time) */
-static volatile bool RTC_sleep_wakeup = false;
-
-#if SYSTICKDELAY == 1 /* SysTick delay selected */
-static volatile uint32_t msTicks;
-#endif /* SysTick/RTC selection */
+/** Mask of the 24-bit RTC counter and compare channel */
+#define RTC_COUNTER_MASK 0x00ffffff
 
+/** Maximum amount of ticks for one timer (deadlines are compared using their signed difference) */
+#define TIMER_MAX_TICKS  0x7fffffff
 
-bool sleeping = false;
-bool RTC_initialized = false;
+/** Minimum amount of ticks in the future to program the compare channel with (synchronization to the LF domain) */
+#define RTC_MIN_TICKS 3
 
-#if SYSTICKDELAY == 1 /* SysTick delay selected */
-bool SysTick_initialized = false;
-#endif /* SysTick/RTC selection */
+/** Delays shorter than this (in µs) use a busy wait */
+#define DELAY_EM1_MIN_US    50
 
+/** Delays shorter than this amount of RTC ticks use an EM1 wait */
+#define DELAY_RTC_MIN_TICKS 10
 
-/* Local prototype */
-static void initRTC (void);
+/** Prescaler of TIMER1 for EM1 delays (16-bit counter: about 75 ms with a 14 MHz HFPERCLK) */
+#define DELAY_TIMER_PRESCALE timerPrescale16
+#define DELAY_TIMER_DIV      16
 
+#if ULFRCO == 1 /* ULFRCO selected */
+/** Amount of RTC ticks to count the core clock cycles during (ULFRCO calibration) */
+#define CAL_TICKS     128
 
-/**************************************************************************//**
- * @brief
- *   Wait for a certain amount of milliseconds in EM2/3.
- *
- * @details
- *   This method also initializes SysTick/RTC if necessary.
- *
- * @param[in] msDelay
- *   The delay time in **milliseconds**.
- *****************************************************************************/
-void delay (uint32_t msDelay)
-{
+/** Temperature ranges of the calibration table (in m°C) */
+#define CAL_TEMP_MIN  -40000
+#define CAL_TEMP_STEP 5000
+#define CAL_ENTRIES   26
 
-#if SYSTICKDELAY == 1 /* SysTick delay selected */
+/** Amount of `RTC_calibrate` calls before a temperature range is measured again */
+#define CAL_INTERVAL  48
 
-	/* Initialize SysTick if not already the case */
-	if (!SysTick_initialized)
-	{
-		/* Initialize and start SysTick
-		 * Number of ticks between interrupt = cmuClock_CORE/1000 */
-		if (SysTick_Config(CMU_ClockFreqGet(cmuClock_CORE) / 1000)) while (1);
+/** Valid range of a measured ULFRCO frequency (in mHz) */
+#define CAL_FREQ_MIN  500000
+#define CAL_FREQ_MAX  2000000
+#endif /* ULFRCO selected */
 
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-	dbinfo("SysTick initialized");
-#endif /* DEBUG_DBPRINT */
 
-		SysTick_initialized = true;
-	}
-	else
-	{
-		/* Enable SysTick interrupt and counter by setting their bits. */
-		SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
-	}
+/* Local variables */
+bool RTC_initialized = false;
 
-	/* Wait a certain amount of ticks */
-	uint32_t curTicks = msTicks;
-	while ((msTicks - curTicks) < msDelay);
+/** Upper bits of the timebase (modified by the RTC interrupt handler) */
+volatile uint32_t RTC_overflows = 0;
 
-	/* Disable SysTick interrupt and counter (needs to be done before entering EM2/3) by clearing their bits. */
-	SysTick->CTRL &= ~SysTick_CTRL_TICKINT_Msk & ~SysTick_CTRL_ENABLE_Msk;
+/** Queue of running timers, sorted on deadline (modified by the RTC interrupt handler) */
+Timer_t * volatile timerQueue = NULL;
 
-#else /* EM2/3 RTC delay selected */
+Timer_t delayTimer;    /* Timer used by `delay` */
+Timer_t sleepTimer;    /* Timer used by `sleep` */
+Timer_t watchdogTimer; /* Feeds the watchdog while waiting on a timer */
+Timer_t flagTimer;     /* Timeout of `waitForFlag` */
 
+/** Frequency used to convert time to ticks (in mHz), updated by `RTC_calibrate` */
+uint32_t rtcFrequency = RTC_FREQ * 1000;
 
-	/* Initialize RTC if not already the case */
-	if (!RTC_initialized) initRTC();
-	else
-	{
-		/* Enable necessary oscillator and clocks */
+/** Uptime in seconds at `uptimeTicks`, moved forward before `rtcFrequency` changes so past time isn't converted again */
+uint32_t uptimeSeconds = 0;
+uint64_t uptimeTicks = 0;
 
 #if ULFRCO == 1 /* ULFRCO selected */
+/** Measured ULFRCO frequencies (in mHz) per temperature range, `0` if not measured yet */
+uint32_t calibrationTable[CAL_ENTRIES];
 
-		/* No specific code here */
-
-#else /* LFXO selected */
-
-		/* Enable the low-frequency crystal oscillator for the RTC */
-		//CMU_OscillatorEnable(cmuOsc_LFXO, true, true);
+/** Amount of `RTC_calibrate` calls since the last measurement */
+uint8_t calibrationCalls = 0;
+#endif /* ULFRCO selected */
 
-#endif /* ULFRCO/LFXO selection */
+/** Amount of active `LFXO_request` calls */
+uint8_t lfxoRequests = 0;
 
-		/* Enable the clock to the interface of the low energy modules
-		 * cmuClock_CORELE = cmuClock_HFLE (deprecated) */
-		//CMU_ClockEnable(cmuClock_HFLE, true);
+/** Set by the TIMER1 interrupt handler when an EM1 delay is over */
+volatile bool timerExpired = false;
 
-		/* Turn on the RTC clock */
-		CMU_ClockEnable(cmuClock_RTC, true);
-	}
+/** Measured EM1 wake-up latency (in TIMER1 ticks) */
+uint32_t em1Latency = 0;
 
-	/* Set RTC compare value for RTC compare register 0 depending on ULFRCO/LFXO selection */
+/** Statistics of each delay mechanism */
+DelayStats_t delayStats[DELAY_MODES];
 
+/* Local prototypes */
+static void initRTC (void);
+static uint64_t getTicks64 (void);
+static void startTimer (Timer_t *timer, uint32_t ticks, uint32_t period, void (*callback)(void));
+static void startTimerAt (Timer_t *timer, uint32_t deadline, uint32_t period, void (*callback)(void));
+static void insertTimer (Timer_t *timer);
+static void removeTimer (Timer_t *timer);
+static void programCompare (void);
+static void waitOnTimer (Timer_t *timer, bool wakeOnEvent, volatile bool *flag, bool allowEM2);
+static void sleepExpired (void);
+static uint32_t msToTicks (uint32_t ms);
+static void waitBusy (uint32_t usDelay);
+static void waitEM1 (uint32_t usDelay);
+static void waitRTC (uint32_t ticks);
+static void addStats (DelayMode_t mode, uint32_t usTime, uint32_t usLate);
 #if ULFRCO == 1 /* ULFRCO selected */
+static uint32_t measureULFRCO (void);
+#endif /* ULFRCO selected */
 
-	if ((ULFRCOFREQ_MS * msDelay) <= 0x00ffffff) RTC_CompareSet(0, (ULFRCOFREQ_MS * msDelay));
-	else
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbcrit("Delay too long, can't fit in the field!");
-#endif /* DEBUG_DBPRINT */
-
-		/* Turn off the RTC clock */
-		CMU_ClockEnable(cmuClock_RTC, false);
-
-		error(14);
-
-		/* Exit function */
-		return;
-	}
-
-#else /* LFXO selected */
-
-	if ((LFXOFREQ_MS * msDelay) <= 0x00ffffff) RTC_CompareSet(0, (LFXOFREQ_MS * msDelay));
-	else
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbcrit("Delay too long, can't fit in the field!");
-#endif /* DEBUG_DBPRINT */
-
-		/* Turn off the RTC clock */
-		CMU_ClockEnable(cmuClock_RTC, false);
-
-		error(15);
-
-		/* Exit function */
-		return;
-	}
-
-#endif /* ULFRCO/LFXO selection */
 
+/**************************************************************************//**
+ * @brief
+ *   Wait for a certain amount of milliseconds.
+ *
+ * @details
+ *   The mechanism is chosen depending on the time (see `delayUs`). This method
+ *   also initializes the RTC if necessary. Other interrupts don't end the delay
+ *   early.
+ *
+ * @param[in] msDelay
+ *   The delay time in **milliseconds**.
+ *****************************************************************************/
+void delay (uint32_t msDelay)
+{
+	/* Longer delays can't be expressed in µs but always use the RTC */
+	if (msDelay > (UINT32_MAX / 1000)) waitRTC(msToTicks(msDelay));
+	else delayUs(msDelay * 1000);
+}
 
-	/* Start the RTC */
-	RTC_Enable(true);
 
-	/* Enter EM2/3 depending on ULFRCO/LFXO selection */
+/**************************************************************************//**
+ * @brief
+ *   Wait for a certain amount of microseconds.
+ *
+ * @details
+ *   Very short delays use a busy wait, delays shorter than `DELAY_RTC_MIN_TICKS`
+ *   RTC ticks wait in EM1 and longer delays wait in EM2/3. Other interrupts
+ *   don't end the delay early.
+ *
+ * @param[in] usDelay
+ *   The delay time in **microseconds**.
+ *****************************************************************************/
+void delayUs (uint32_t usDelay)
+{
+	/* Shortest delay which can use the RTC, depends on the (calibrated) frequency */
+	uint32_t rtcMinUs = (uint32_t)(((uint64_t)DELAY_RTC_MIN_TICKS * 1000000000) / rtcFrequency);
 
-#if ULFRCO == 1 /* ULFRCO selected */
-	/* In EM3, high and low frequency clocks are disabled. No oscillator (except the ULFRCO) is running.
-	 * Furthermore, all unwanted oscillators are disabled in EM3. This means that nothing needs to be
-	 * manually disabled before the statement EMU_EnterEM3(true); */
-	EMU_EnterEM3(true); /* "true" - Save and restore oscillators, clocks and voltage scaling */
-#else /* LFXO selected */
-	EMU_EnterEM2(true); /* "true" - Save and restore oscillators, clocks and voltage scaling */
-#endif /* ULFRCO/LFXO selection */
+	if (usDelay < DELAY_EM1_MIN_US) waitBusy(usDelay);
+	else if (usDelay < rtcMinUs) waitEM1(usDelay);
+	else waitRTC((uint32_t)(((uint64_t)usDelay * rtcFrequency) / 1000000000));
+}
 
 
-	/* Disable used oscillator and clocks after wake-up */
+/**************************************************************************//**
+ * @brief
+ *   Wait until an interrupt handler sets a flag, or until a timeout.
+ *
+ * @details
+ *   The MCU sleeps while waiting, the interrupt setting the flag wakes it up.
+ *   This method also initializes the RTC if necessary.
+ *
+ * @param[in] flag
+ *   The flag to wait on.
+ *
+ * @param[in] msTimeout
+ *   The maximum time to wait in **milliseconds**.
+ *
+ * @param[in] allowEM2
+ *   @li `true` - The peripheral setting the flag keeps working in EM2 (for
+ *       example the LEUART with DMA wake-up), EM2/3 is used.
+ *   @li `false` - The peripheral needs a high frequency clock (for example
+ *       the ADC), EM1 is used.
+ *
+ * @return
+ *   @li `true` - The flag was set.
+ *   @li `false` - The timeout was reached.
+ *****************************************************************************/
+bool waitForFlag (volatile bool *flag, uint32_t msTimeout, bool allowEM2)
+{
+	/* Exit function if the flag is already set */
+	if (*flag) return (true);
 
-#if ULFRCO == 1 /* ULFRCO selected */
+	startTimer(&flagTimer, msToTicks(msTimeout), 0, NULL);
 
-	/* No specific code here */
+	waitOnTimer(&flagTimer, false, flag, allowEM2);
 
-#else /* LFXO selected */
+	TIMER_stop(&flagTimer);
 
-	/* Disable the low-frequency crystal oscillator for the RTC */
-	//CMU_OscillatorEnable(cmuOsc_LFXO, false, true);
+	return (*flag);
+}
 
-#endif /* ULFRCO/LFXO selection */
 
-	/* Disable the clock to the interface of the low energy modules
-	 * cmuClock_CORELE = cmuClock_HFLE (deprecated) */
-	//CMU_ClockEnable(cmuClock_HFLE, false);
+/**************************************************************************//**
+ * @brief
+ *   Get the statistics of a delay mechanism.
+ *
+ * @param[in] mode
+ *   The delay mechanism.
+ *
+ * @param[out] stats
+ *   The pointer to put the statistics in.
+ *****************************************************************************/
+void DELAY_getStats (DelayMode_t mode, DelayStats_t *stats)
+{
+	if (mode >= DELAY_MODES) return; /* Exit function */
 
-	/* Turn off the RTC clock */
-	CMU_ClockEnable(cmuClock_RTC, false);
+	*stats = delayStats[mode];
+}
 
-#endif /* SysTick/RTC selection */
 
+/**************************************************************************//**
+ * @brief
+ *   Clear the statistics of all of the delay mechanisms.
+ *****************************************************************************/
+void DELAY_clearStats (void)
+{
+	for (uint8_t i = 0; i < DELAY_MODES; i++)
+	{
+		delayStats[i].calls = 0;
+		delayStats[i].usTotal = 0;
+		delayStats[i].usLate = 0;
+		delayStats[i].usLateMax = 0;
+	}
 }
 
 
@@ -268,229 +393,364 @@ void delay (uint32_t msDelay)
  *   Sleep for a certain amount of seconds in EM2/3.
  *
  * @details
- *   This method also initializes the RTC if necessary.
+ *   This method also initializes the RTC if necessary. The sleep ends early
+ *   if an interrupt handler adds an event to the ring in `interrupt.c` (for
+ *   example on a button press). When the time has passed an `EVENT_RTC`
+ *   event is added.
  *
  * @param[in] sSleep
  *   The sleep time in **seconds**.
  *****************************************************************************/
 void sleep (uint32_t sSleep)
 {
-	/* Initialize RTC if not already the case */
-	if (!RTC_initialized) initRTC();
-	else
-	{
-		/* Enable necessary oscillator and clocks */
-
-#if ULFRCO == 1 /* ULFRCO selected */
-
-		/* No specific code here */
-
-#else /* LFXO selected */
-
-		/* Enable the low-frequency crystal oscillator for the RTC */
-		//CMU_OscillatorEnable(cmuOsc_LFXO, true, true);
+	uint32_t ticks = RTC_secondsToTicks(sSleep);
 
-#endif /* ULFRCO/LFXO selection */
-
-		/* Enable the clock to the interface of the low energy modules
-		 * cmuClock_CORELE = cmuClock_HFLE (deprecated) */
-		//CMU_ClockEnable(cmuClock_HFLE, true);
-
-		/* Turn on the RTC clock */
-		CMU_ClockEnable(cmuClock_RTC, true);
-	}
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-#if ULFRCO == 1 /* ULFRCO selected */
-	dbwarnInt("Sleeping in EM3 for ", sSleep, " s\n\r");
-#else /* LFXO selected */
-	dbwarnInt("Sleeping in EM2 for ", sSleep, " s\n\r");
-#endif /* ULFRCO/LFXO selection */
-#endif /* DEBUG_DBPRINT */
-
-	/* Set RTC compare value for RTC compare register 0 depending on ULFRCO/LFXO selection */
-
-#if ULFRCO == 1 /* ULFRCO selected */
-
-	if ((ULFRCOFREQ * sSleep) <= 0x00ffffff) RTC_CompareSet(0, (ULFRCOFREQ * sSleep));
-	else
+	if (ticks > TIMER_MAX_TICKS)
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbcrit("Delay too long, can't fit in the field!");
+		dbcrit("Sleep too long!");
 #endif /* DEBUG_DBPRINT */
 
-		/* Turn off the RTC clock */
-		CMU_ClockEnable(cmuClock_RTC, false);
-
+#if ULFRCO == 1 /* ULFRCO selected */
 		error(16);
-
-		/* Exit function */
-		return;
-	}
-
 #else /* LFXO selected */
-
-	if ((LFXOFREQ * sSleep) <= 0x00ffffff) RTC_CompareSet(0, (LFXOFREQ * sSleep));
-	else
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbcrit("Delay too long, can't fit in the field!");
-#endif /* DEBUG_DBPRINT */
-
-		/* Turn off the RTC clock */
-		CMU_ClockEnable(cmuClock_RTC, false);
-
 		error(17);
+#endif /* ULFRCO/LFXO selection */
 
 		/* Exit function */
 		return;
 	}
 
-#endif /* ULFRCO/LFXO selection */
-
-	/* Indicate that we're using the sleep method */
-	sleeping = true;
-
+	sleepUntil(RTC_getTicks() + ticks);
+}
 
-	/* Start the RTC */
-	RTC_Enable(true);
 
-	/* Enter EM2/3 depending on ULFRCO/LFXO selection */
+/**************************************************************************//**
+ * @brief
+ *   Sleep in EM2/3 until the RTC timebase reaches a certain value.
+ *
+ * @details
+ *   This method behaves like `sleep` but uses an absolute deadline. Calling
+ *   it again with the same deadline after an early wake-up resumes the sleep
+ *   without any rounding errors. If the deadline already passed, the
+ *   `EVENT_RTC` event is added immediately.
+ *
+ * @param[in] deadline
+ *   The value of `RTC_getTicks` to wake up on (at most 2^31 ticks away,
+ *   otherwise it's seen as a deadline in the past).
+ *****************************************************************************/
+void sleepUntil (uint32_t deadline)
+{
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	uint32_t now = RTC_getTicks();
 
+	if ((int32_t)(deadline - now) > 0)
+	{
 #if ULFRCO == 1 /* ULFRCO selected */
-	/* In EM3, high and low frequency clocks are disabled. No oscillator (except the ULFRCO) is running.
-	 * Furthermore, all unwanted oscillators are disabled in EM3. This means that nothing needs to be
-	 * manually disabled before the statement EMU_EnterEM3(true); */
-	EMU_EnterEM3(true); /* "true" - Save and restore oscillators, clocks and voltage scaling */
+		dbwarnInt("Sleeping in EM3 for ", (uint32_t)(((uint64_t)(deadline - now) * 1000) / rtcFrequency), " s\n\r");
 #else /* LFXO selected */
-	EMU_EnterEM2(true); /* "true" - Save and restore oscillators, clocks and voltage scaling */
+		dbwarnInt("Sleeping in EM2 for ", (uint32_t)(((uint64_t)(deadline - now) * 1000) / rtcFrequency), " s\n\r");
 #endif /* ULFRCO/LFXO selection */
+	}
+#endif /* DEBUG_DBPRINT */
 
+	startTimerAt(&sleepTimer, deadline, 0, sleepExpired);
 
-	/* Indicate that we're no longer sleeping */
-	sleeping = false;
-
-	/* Disable used oscillator and clocks after wake-up */
+	waitOnTimer(&sleepTimer, true, NULL, true);
 
-#if ULFRCO == 1 /* ULFRCO selected */
+	/* Woken up by something else, the timer isn't necessary anymore */
+	TIMER_stop(&sleepTimer);
+}
 
-	/* No specific code here */
 
-#else /* LFXO selected */
+/**************************************************************************//**
+ * @brief
+ *   Convert seconds to RTC ticks (to calculate deadlines for `sleepUntil`).
+ *
+ * @param[in] seconds
+ *   The time in seconds.
+ *
+ * @return
+ *   The amount of ticks (saturates at `UINT32_MAX`).
+ *****************************************************************************/
+uint32_t RTC_secondsToTicks (uint32_t seconds)
+{
+	uint64_t ticks = ((uint64_t)seconds * rtcFrequency) / 1000;
 
-	/* Disable the low-frequency crystal oscillator for the RTC */
-	//CMU_OscillatorEnable(cmuOsc_LFXO, false, true);
+	if (ticks > UINT32_MAX) return (UINT32_MAX);
 
-#endif /* ULFRCO/LFXO selection */
+	return ((uint32_t)ticks);
+}
 
-	/* Disable the clock to the interface of the low energy modules
-	 * cmuClock_CORELE = cmuClock_HFLE (deprecated) */
-	//CMU_ClockEnable(cmuClock_HFLE, false);
 
-	/* Turn off the RTC clock */
-	CMU_ClockEnable(cmuClock_RTC, false);
+/**************************************************************************//**
+ * @brief
+ *   Get the value of the free-running RTC timebase.
+ *
+ * @details
+ *   This value overflows back to zero after 2^32 ticks, compare values using
+ *   their (signed) difference. Use `RTC_getUptime` for a monotonic value.
+ *
+ * @return
+ *   The amount of ticks since the RTC has been initialized (lower 32 bits).
+ *****************************************************************************/
+uint32_t RTC_getTicks (void)
+{
+	return ((uint32_t)getTicks64());
 }
 
 
 /**************************************************************************//**
  * @brief
- *   Method to check if the wakeup was caused by the RTC.
+ *   Get the time since the RTC has been initialized.
+ *
+ * @details
+ *   Unlike `RTC_getTicks` this value doesn't wrap around in the lifetime
+ *   of the device (the overflow counter extends the RTC to 56 bits). Only
+ *   the ticks since the last frequency change are converted with the
+ *   current frequency, so a calibration can't make it jump backwards.
  *
  * @return
- *   The value of `RTC_sleep_wakeup`.
+ *   The uptime in **seconds**.
  *****************************************************************************/
-bool RTC_checkWakeup (void)
+uint32_t RTC_getUptime (void)
 {
-	return (RTC_sleep_wakeup);
+	uint64_t ticks = getTicks64() - uptimeTicks;
+
+	/* Split the division so the multiplication can't overflow */
+	return (uptimeSeconds + (uint32_t)(((ticks / rtcFrequency) * 1000) + (((ticks % rtcFrequency) * 1000) / rtcFrequency)));
 }
 
 
 /**************************************************************************//**
  * @brief
- *   Method to clear `RTC_sleep_wakeup`.
+ *   Request the LFXO to be running.
+ *
+ * @details
+ *   The LFXO is started (without waiting on it) on the first request. Every
+ *   call should be followed by a call to `LFXO_release` later on.
  *****************************************************************************/
-void RTC_clearWakeup (void)
+void LFXO_request (void)
 {
-	RTC_sleep_wakeup = false;
+	/* Start the LFXO but don't wait on it, the method selecting it as a clock source does this */
+	if (lfxoRequests == 0) CMU_OscillatorEnable(cmuOsc_LFXO, true, false);
+
+	lfxoRequests++;
 }
 
 
 /**************************************************************************//**
  * @brief
- *   Method to get the time spend sleeping (in seconds) in the case
- *   of GPIO wake-up.
+ *   Release a request made with `LFXO_request`.
  *
- * @return
- *   The time spend sleeping in **seconds**.
+ * @details
+ *   If it was the last request (and the RTC doesn't use it) the LFXO is
+ *   disabled. The modules using it should be disabled before this call.
  *****************************************************************************/
-uint32_t RTC_getPassedSleeptime (void)
+void LFXO_release (void)
 {
-	uint32_t sSleep = RTC_CounterGet();
+	if (lfxoRequests == 0) return; /* Exit function */
 
-	/* Disable the counter */
-	RTC_Enable(false);
+	lfxoRequests--;
 
 #if ULFRCO == 1 /* ULFRCO selected */
-		sSleep /= ULFRCOFREQ;
-#else /* LFXO selected */
-		sSleep /= LFXOFREQ;
-#endif /* ULFRCO/LFXO selection */
+	if (lfxoRequests == 0) CMU_OscillatorEnable(cmuOsc_LFXO, false, false);
+#endif /* ULFRCO selected */
 
-	return (sSleep);
 }
 
 
+#if ULFRCO == 1 /* ULFRCO selected */
 /**************************************************************************//**
  * @brief
- *   RTC initialization.
+ *   Update the ULFRCO frequency used for the tick/time conversions.
  *
- * @note
- *   This is a static method because it's only internally used in this file
- *   and called by other methods if necessary.
+ * @details
+ *   If the temperature range wasn't measured yet (or every `CAL_INTERVAL`
+ *   calls) the ULFRCO is measured against the core clock, this takes about
+ *   `CAL_TICKS` milliseconds in EM0 with interrupts disabled. Otherwise the
+ *   value from the table is used.
+ *
+ * @param[in] temperature
+ *   The internal temperature in m°C (`readADC(INTERNAL_TEMPERATURE)`).
  *****************************************************************************/
-static void initRTC (void)
+void RTC_calibrate (int32_t temperature)
 {
+	uint8_t index;
 
-#if ULFRCO == 1 /* ULFRCO selected */
+	/* Select the temperature range */
+	if (temperature < CAL_TEMP_MIN) index = 0;
+	else if (temperature >= (CAL_TEMP_MIN + (CAL_ENTRIES * CAL_TEMP_STEP))) index = CAL_ENTRIES - 1;
+	else index = (temperature - CAL_TEMP_MIN) / CAL_TEMP_STEP;
 
-	/* Enable the ultra low-frequency RC oscillator for the RTC */
-	//CMU_OscillatorEnable(cmuOsc_ULFRCO, true, true); /* The ULFRCO is always on */
+	calibrationCalls++;
 
-	/* Enable the clock to the interface of the low energy modules
-	 * cmuClock_CORELE = cmuClock_HFLE (deprecated) */
-	CMU_ClockEnable(cmuClock_HFLE, true);
+	if ((calibrationTable[index] == 0) || (calibrationCalls >= CAL_INTERVAL))
+	{
+		uint32_t measured = measureULFRCO();
 
-	/* Route the ULFRCO clock to the RTC */
-	CMU_ClockSelectSet(cmuClock_LFA, cmuSelect_ULFRCO);
+		calibrationCalls = 0;
 
-#else /* LFXO selected */
+		/* Ignore faulty measurements */
+		if ((measured > CAL_FREQ_MIN) && (measured < CAL_FREQ_MAX)) calibrationTable[index] = measured;
 
-	/* Enable the low-frequency crystal oscillator for the RTC */
-	CMU_OscillatorEnable(cmuOsc_LFXO, true, true);
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbinfoInt("ULFRCO measured (mHz): ", measured, "");
+#endif /* DEBUG_DBPRINT */
 
-	/* Enable the clock to the interface of the low energy modules
-	 * cmuClock_CORELE = cmuClock_HFLE (deprecated) */
-	CMU_ClockEnable(cmuClock_HFLE, true);
+	}
 
-	/* Route the LFXO clock to the RTC */
-	CMU_ClockSelectSet(cmuClock_LFA, cmuSelect_LFXO);
+	if ((calibrationTable[index] != 0) && (calibrationTable[index] != rtcFrequency))
+	{
+		/* Count the time until now with the old frequency, the uptime keeps increasing */
+		uint32_t seconds = RTC_getUptime() - uptimeSeconds;
+		uptimeTicks += ((uint64_t)seconds * rtcFrequency) / 1000;
+		uptimeSeconds += seconds;
 
-#endif /* ULFRCO/LFXO selection */
+		rtcFrequency = calibrationTable[index];
+	}
+}
+#endif /* ULFRCO selected */
 
-	/* Turn on the RTC clock */
-	CMU_ClockEnable(cmuClock_RTC, true);
 
-	/* Allow channel 0 to cause an interrupt */
-	RTC_IntEnable(RTC_IEN_COMP0);
-	RTC_IntClear(RTC_IFC_COMP0); /* This statement was in the ULFRCO but not in the LFXO example. It's kept here just in case. */
-	NVIC_ClearPendingIRQ(RTC_IRQn);
+/**************************************************************************//**
+ * @brief
+ *   Start (or restart) a software timer.
+ *
+ * @details
+ *   This method also initializes the RTC if necessary. The timer can be
+ *   checked using `TIMER_isExpired` or a callback can be used.
+ *
+ * @param[in] timer
+ *   The timer to start, needs to stay in memory while it's running.
+ *
+ * @param[in] msTime
+ *   The time until the timer expires in **milliseconds**.
+ *
+ * @param[in] periodic
+ *   @li `true` - Restart the timer automatically each time it expires.
+ *   @li `false` - One-shot timer.
+ *
+ * @param[in] callback
+ *   Method to call (from the RTC interrupt handler, so keep it short) when
+ *   the timer expires, can be `NULL`.
+ *****************************************************************************/
+void TIMER_start (Timer_t *timer, uint32_t msTime, bool periodic, void (*callback)(void))
+{
+	uint32_t ticks = msToTicks(msTime);
+
+	if (ticks > TIMER_MAX_TICKS)
+	{
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbcrit("Timer too long!");
+#endif /* DEBUG_DBPRINT */
+
+#if ULFRCO == 1 /* ULFRCO selected */
+		error(14);
+#else /* LFXO selected */
+		error(15);
+#endif /* ULFRCO/LFXO selection */
+
+		/* Exit function */
+		return;
+	}
+
+	startTimer(timer, ticks, periodic ? ticks : 0, callback);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Stop a software timer (nothing happens if it isn't running).
+ *
+ * @param[in] timer
+ *   The timer to stop.
+ *****************************************************************************/
+void TIMER_stop (Timer_t *timer)
+{
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+
+	removeTimer(timer);
+	programCompare();
+
+	CORE_EXIT_ATOMIC();
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Check if a software timer has expired since it was started.
+ *
+ * @param[in] timer
+ *   The timer to check.
+ *
+ * @return
+ *   @li `true` - The timer has expired (at least once if it's periodic).
+ *   @li `false` - The timer hasn't expired yet.
+ *****************************************************************************/
+bool TIMER_isExpired (Timer_t *timer)
+{
+	return (timer->expired);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   RTC initialization.
+ *
+ * @details
+ *   The RTC keeps counting from now on (compare channel 0 doesn't reset the
+ *   counter), its clock stays enabled.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void initRTC (void)
+{
+
+#if ULFRCO == 1 /* ULFRCO selected */
+
+	/* Enable the ultra low-frequency RC oscillator for the RTC */
+	//CMU_OscillatorEnable(cmuOsc_ULFRCO, true, true); /* The ULFRCO is always on */
+
+	/* Enable the clock to the interface of the low energy modules
+	 * cmuClock_CORELE = cmuClock_HFLE (deprecated) */
+	CMU_ClockEnable(cmuClock_HFLE, true);
+
+	/* Route the ULFRCO clock to the RTC */
+	CMU_ClockSelectSet(cmuClock_LFA, cmuSelect_ULFRCO);
+
+#else /* LFXO selected */
+
+	/* Enable the low-frequency crystal oscillator for the RTC */
+	CMU_OscillatorEnable(cmuOsc_LFXO, true, true);
+
+	/* Enable the clock to the interface of the low energy modules
+	 * cmuClock_CORELE = cmuClock_HFLE (deprecated) */
+	CMU_ClockEnable(cmuClock_HFLE, true);
+
+	/* Route the LFXO clock to the RTC */
+	CMU_ClockSelectSet(cmuClock_LFA, cmuSelect_LFXO);
+
+#endif /* ULFRCO/LFXO selection */
+
+	/* Turn on the RTC clock */
+	CMU_ClockEnable(cmuClock_RTC, true);
+
+	/* Allow overflows (timebase) to cause an interrupt, channel 0 (earliest timer) is enabled when necessary */
+	RTC_IntEnable(RTC_IEN_OF);
+	RTC_IntClear(RTC_IFC_COMP0 | RTC_IFC_OF); /* This statement was in the ULFRCO but not in the LFXO example. It's kept here just in case. */
+	NVIC_ClearPendingIRQ(RTC_IRQn);
 	NVIC_EnableIRQ(RTC_IRQn);
 
 	/* Configure the RTC settings */
 	RTC_Init_TypeDef rtc = RTC_INIT_DEFAULT;
-	rtc.enable = false; /* Don't start counting when initialization is done */
+	rtc.enable = true;     /* Start counting when initialization is done */
+	rtc.comp0Top = false;  /* Count through the full 24 bits (free-running) */
 
 	/* Initialize RTC with pre-defined settings */
 	RTC_Init(&rtc);
@@ -507,33 +767,622 @@ static void initRTC (void)
 }
 
 
-#if SYSTICKDELAY == 1 /* SysTick delay selected */
 /**************************************************************************//**
  * @brief
- *   Interrupt Service Routine for system tick counter.
+ *   Read the extended RTC counter.
+ *
+ * @details
+ *   This method also initializes the RTC if necessary. The 24-bit RTC counter
+ *   is extended with the amount of overflows. An overflow which hasn't been
+ *   handled yet by the interrupt handler (because interrupts are disabled or
+ *   we're already in it) is also taken into account.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @return
+ *   The amount of ticks since the RTC has been initialized.
+ *****************************************************************************/
+static uint64_t getTicks64 (void)
+{
+	uint32_t overflows;
+	uint32_t counter;
+
+	/* Initialize RTC if not already the case */
+	if (!RTC_initialized) initRTC();
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+
+	overflows = RTC_overflows;
+	counter = RTC_CounterGet();
+
+	/* Check if an overflow is pending but not handled yet */
+	if ((RTC_IntGet() & RTC_IF_OF) && (counter < (RTC_COUNTER_MASK / 2))) overflows++;
+
+	CORE_EXIT_ATOMIC();
+
+	return (((uint64_t)overflows << 24) | counter);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Start (or restart) a software timer using an amount of ticks.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] timer
+ *   The timer to start.
+ *
+ * @param[in] ticks
+ *   The amount of ticks until the timer expires.
+ *
+ * @param[in] period
+ *   The period in ticks, `0` for a one-shot timer.
+ *
+ * @param[in] callback
+ *   Method to call when the timer expires, can be `NULL`.
+ *****************************************************************************/
+static void startTimer (Timer_t *timer, uint32_t ticks, uint32_t period, void (*callback)(void))
+{
+	startTimerAt(timer, RTC_getTicks() + ticks, period, callback);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Start (or restart) a software timer using an absolute deadline.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] timer
+ *   The timer to start.
+ *
+ * @param[in] deadline
+ *   The value of `RTC_getTicks` when the timer expires (a passed deadline
+ *   makes it expire immediately).
+ *
+ * @param[in] period
+ *   The period in ticks, `0` for a one-shot timer.
+ *
+ * @param[in] callback
+ *   Method to call when the timer expires, can be `NULL`.
+ *****************************************************************************/
+static void startTimerAt (Timer_t *timer, uint32_t deadline, uint32_t period, void (*callback)(void))
+{
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+
+	removeTimer(timer); /* In case it's still running */
+
+	timer->deadline = deadline;
+	timer->period = period;
+	timer->callback = callback;
+	timer->expired = false;
+
+	insertTimer(timer);
+	programCompare();
+
+	CORE_EXIT_ATOMIC();
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Add a timer to the queue, sorted on its deadline.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary. Only call it with interrupts
+ *   disabled or from the RTC interrupt handler.
+ *
+ * @param[in] timer
+ *   The timer to add.
  *****************************************************************************/
-void SysTick_Handler (void)
+static void insertTimer (Timer_t *timer)
 {
-	msTicks++; /* Increment counter necessary by SysTick delay functionality */
+	Timer_t * volatile *place = &timerQueue;
+
+	/* Find the first timer with a later deadline (wrap-around safe) */
+	while ((*place != NULL) && ((int32_t)((*place)->deadline - timer->deadline) <= 0)) place = &((*place)->next);
+
+	timer->next = *place;
+	*place = timer;
+	timer->running = true;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Remove a timer from the queue (if it's in it).
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary. Only call it with interrupts
+ *   disabled or from the RTC interrupt handler.
+ *
+ * @param[in] timer
+ *   The timer to remove.
+ *****************************************************************************/
+static void removeTimer (Timer_t *timer)
+{
+	if (!timer->running) return; /* Exit function */
+
+	Timer_t * volatile *place = &timerQueue;
+
+	while ((*place != NULL) && (*place != timer)) place = &((*place)->next);
+
+	if (*place == timer) *place = timer->next;
+
+	timer->running = false;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Program compare channel 0 with the deadline of the earliest timer.
+ *
+ * @details
+ *   If the deadline is (almost) reached already, the interrupt is triggered
+ *   by software so it can't be missed. If it's too far away for the 24-bit
+ *   compare channel (or there are no timers), the compare interrupt is
+ *   disabled. The overflow interrupt calls this method again later.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary. Only call it with interrupts
+ *   disabled or from the RTC interrupt handler.
+ *****************************************************************************/
+static void programCompare (void)
+{
+	/* Disable the compare interrupt, a match before it's programmed again would be too early */
+	RTC_IntDisable(RTC_IEN_COMP0);
+
+	if (timerQueue == NULL) return; /* Exit function */
+
+	uint32_t now = RTC_getTicks();
+	uint32_t target = timerQueue->deadline;
+
+	if ((int32_t)(target - now) < RTC_MIN_TICKS) target = now + RTC_MIN_TICKS;
+
+	/* The counter overflows before the compare channel can match, wait on the overflow interrupt */
+	if ((target - now) > RTC_COUNTER_MASK) return; /* Exit function */
+
+	RTC_CompareSet(0, target & RTC_COUNTER_MASK);
+
+	/* Forget matches of the previous value */
+	RTC_IntClear(RTC_IFC_COMP0);
+	RTC_IntEnable(RTC_IEN_COMP0);
+
+	/* Check if the deadline already passed while programming it */
+	if ((int32_t)(target - RTC_getTicks()) <= 0) RTC_IntSet(RTC_IFS_COMP0);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Wait in EM1/2/3 until a timer expires.
+ *
+ * @details
+ *   The check and entering the energy mode is done with interrupts disabled,
+ *   a pending interrupt still wakes the MCU but can't be missed this way.
+ *   If the LFXO is requested, EM2 is used instead of EM3. For long waits,
+ *   the watchdog is fed every `WDOG_FEED_S` seconds.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] timer
+ *   The timer to wait on.
+ *
+ * @param[in] wakeOnEvent
+ *   @li `true` - Also stop waiting if an event is added to the ring in `interrupt.c`.
+ *   @li `false` - Only stop waiting when the timer expires.
+ *
+ * @param[in] flag
+ *   Also stop waiting if this flag is set (can be `NULL`).
+ *
+ * @param[in] allowEM2
+ *   @li `true` - Wait in EM2/3.
+ *   @li `false` - Wait in EM1.
+ *****************************************************************************/
+static void waitOnTimer (Timer_t *timer, bool wakeOnEvent, volatile bool *flag, bool allowEM2)
+{
+	uint16_t events = EVENT_getCount();
+	bool done = false;
+
+	feedWatchdog();
+
+	/* Only keep feeding the watchdog if the wait takes long enough */
+	uint32_t feedTicks = RTC_secondsToTicks(WDOG_FEED_S);
+	if ((int32_t)(timer->deadline - RTC_getTicks()) > (int32_t)feedTicks) startTimer(&watchdogTimer, feedTicks, feedTicks, feedWatchdog);
+
+	CORE_DECLARE_IRQ_STATE;
+
+	while (!done)
+	{
+		CORE_ENTER_ATOMIC();
+
+		done = timer->expired || ((flag != NULL) && *flag) || (wakeOnEvent && (EVENT_getCount() != events));
+
+		if (!done && !allowEM2)
+		{
+			EMU_EnterEM1(); /* The peripheral needs the high frequency clocks */
+
+			CORE_EXIT_ATOMIC(); /* Pending interrupts are handled here */
+
+			continue;
+		}
+
+#if ULFRCO == 1 /* ULFRCO selected */
+		/* In EM3, high and low frequency clocks are disabled. No oscillator (except the ULFRCO) is running.
+		 * Furthermore, all unwanted oscillators are disabled in EM3. This means that nothing needs to be
+		 * manually disabled before the statement EMU_EnterEM3(true); */
+		if (!done)
+		{
+			if (lfxoRequests > 0) EMU_EnterEM2(true); /* Keep the LFXO running for the modules which requested it */
+			else EMU_EnterEM3(true); /* "true" - Save and restore oscillators, clocks and voltage scaling */
+		}
+#else /* LFXO selected */
+		if (!done) EMU_EnterEM2(true); /* "true" - Save and restore oscillators, clocks and voltage scaling */
+#endif /* ULFRCO/LFXO selection */
+
+		CORE_EXIT_ATOMIC(); /* Pending interrupts are handled here */
+	}
+
+	if (watchdogTimer.running) TIMER_stop(&watchdogTimer);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Callback for the timer used by `sleep`.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void sleepExpired (void)
+{
+	EVENT_push(EVENT_RTC, sleepTimer.deadline);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Convert milliseconds to RTC ticks.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] ms
+ *   The time in milliseconds.
+ *
+ * @return
+ *   The amount of ticks (saturates at `UINT32_MAX`).
+ *****************************************************************************/
+static uint32_t msToTicks (uint32_t ms)
+{
+	uint64_t ticks = ((uint64_t)ms * rtcFrequency) / 1000000;
+
+	if (ticks > UINT32_MAX) return (UINT32_MAX);
+
+	return ((uint32_t)ticks);
+}
+
+
+#if ULFRCO == 1 /* ULFRCO selected */
+/**************************************************************************//**
+ * @brief
+ *   Measure the ULFRCO frequency using the core clock.
+ *
+ * @details
+ *   SysTick counts the core clock cycles during `CAL_TICKS` RTC ticks, its
+ *   settings are restored afterwards.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @return
+ *   The ULFRCO frequency in mHz (`0` if the measurement failed).
+ *****************************************************************************/
+static uint32_t measureULFRCO (void)
+{
+	uint32_t start;
+	uint32_t end;
+	uint32_t counter;
+
+	/* Initialize RTC if not already the case */
+	if (!RTC_initialized) initRTC();
+
+	/* Keep the SysTick settings to restore them afterwards */
+	uint32_t sysTickLoad = SysTick->LOAD;
+	uint32_t sysTickCtrl = SysTick->CTRL;
+
+	/* Let SysTick count down from its maximum value on the core clock (without interrupts) */
+	SysTick->LOAD = 0x00ffffff;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+
+	/* Start on an edge of the RTC counter */
+	counter = RTC_CounterGet();
+	while (RTC_CounterGet() == counter);
+	start = SysTick->VAL;
+
+	counter = RTC_CounterGet();
+	while (((RTC_CounterGet() - counter) & RTC_COUNTER_MASK) < CAL_TICKS);
+	end = SysTick->VAL;
+
+	CORE_EXIT_ATOMIC();
+
+	/* Restore SysTick, writing VAL clears it so the counter restarts from LOAD */
+	SysTick->CTRL = 0;
+	SysTick->LOAD = sysTickLoad;
+	SysTick->VAL = 0;
+	SysTick->CTRL = sysTickCtrl;
+
+	uint32_t cycles = (start - end) & 0x00ffffff;
+
+	if (cycles == 0) return (0);
+
+	return ((uint32_t)(((uint64_t)CAL_TICKS * CMU_ClockFreqGet(cmuClock_CORE) * 1000) / cycles));
+}
+#endif /* ULFRCO selected */
+
+
+/**************************************************************************//**
+ * @brief
+ *   Busy wait (EM0) for a certain amount of microseconds.
+ *
+ * @details
+ *   SysTick counts the core clock cycles, this is only used for short delays.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] usDelay
+ *   The delay time in **microseconds**.
+ *****************************************************************************/
+static void waitBusy (uint32_t usDelay)
+{
+	uint32_t frequency = CMU_ClockFreqGet(cmuClock_CORE);
+	uint32_t cycles = (uint32_t)(((uint64_t)usDelay * frequency) / 1000000);
+	uint32_t passed;
+
+	/* Let SysTick count down from its maximum value on the core clock (without interrupts) */
+	SysTick->LOAD = 0x00ffffff;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+
+	uint32_t start = SysTick->VAL;
+
+	do passed = (start - SysTick->VAL) & 0x00ffffff;
+	while (passed < cycles);
+
+	SysTick->CTRL = 0; /* Disable SysTick */
+
+	addStats(DELAY_BUSY, usDelay, (uint32_t)(((uint64_t)(passed - cycles) * 1000000) / frequency));
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Wait in EM1 for a certain amount of microseconds.
+ *
+ * @details
+ *   TIMER1 overflows after the requested time minus the measured wake-up
+ *   latency. After waking up it keeps counting from zero so the latency of
+ *   this wake-up can be measured. Longer delays are split in multiple parts.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] usDelay
+ *   The delay time in **microseconds**.
+ *****************************************************************************/
+static void waitEM1 (uint32_t usDelay)
+{
+	uint32_t late = 0;
+
+	PM_ClockRequest(PM_CLOCK_HFPER); /* TIMER1 is a High Frequency Peripheral */
+	CMU_ClockEnable(cmuClock_TIMER1, true);
+
+	uint32_t frequency = CMU_ClockFreqGet(cmuClock_TIMER1) / DELAY_TIMER_DIV;
+	uint32_t ticks = (uint32_t)(((uint64_t)usDelay * frequency) / 1000000);
+
+	TIMER_Init_TypeDef init = TIMER_INIT_DEFAULT;
+	init.enable = false;                   /* Start counting after the top value is set */
+	init.prescale = DELAY_TIMER_PRESCALE;
+
+	TIMER_Init(TIMER1, &init);
+
+	TIMER_IntClear(TIMER1, TIMER_IF_OF);
+	TIMER_IntEnable(TIMER1, TIMER_IEN_OF);
+	NVIC_ClearPendingIRQ(TIMER1_IRQn);
+	NVIC_EnableIRQ(TIMER1_IRQn);
+
+	CORE_DECLARE_IRQ_STATE;
+
+	while (ticks > 0)
+	{
+		uint32_t part = (ticks > 0xffff) ? 0xffff : ticks;
+		ticks -= part;
+
+		/* Compensate for the wake-up latency on the last part */
+		uint32_t top = part;
+		if ((ticks == 0) && (top > em1Latency + 1)) top -= em1Latency;
+
+		timerExpired = false;
+		TIMER_TopSet(TIMER1, top);
+		TIMER_CounterSet(TIMER1, 0);
+		TIMER_Enable(TIMER1, true);
+
+		CORE_ENTER_ATOMIC();
+		while (!timerExpired)
+		{
+			EMU_EnterEM1(); /* A pending interrupt still wakes the MCU */
+			CORE_EXIT_ATOMIC();
+			CORE_ENTER_ATOMIC();
+		}
+		CORE_EXIT_ATOMIC();
+
+		/* The counter continued from zero after the overflow */
+		late = TIMER_CounterGet(TIMER1);
+
+		TIMER_Enable(TIMER1, false);
+	}
+
+	/* Average the measured latency */
+	em1Latency = (em1Latency * 3 + late) / 4;
+
+	NVIC_DisableIRQ(TIMER1_IRQn);
+	TIMER_IntDisable(TIMER1, TIMER_IEN_OF);
+	CMU_ClockEnable(cmuClock_TIMER1, false);
+	PM_ClockRelease(PM_CLOCK_HFPER);
+
+	addStats(DELAY_EM1, usDelay, (uint32_t)(((uint64_t)late * 1000000) / frequency));
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Wait in EM2/3 on the RTC for a certain amount of ticks.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] ticks
+ *   The delay time in RTC ticks.
+ *****************************************************************************/
+static void waitRTC (uint32_t ticks)
+{
+	if (ticks > TIMER_MAX_TICKS)
+	{
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbcrit("Delay too long!");
+#endif /* DEBUG_DBPRINT */
+
+#if ULFRCO == 1 /* ULFRCO selected */
+		error(14);
+#else /* LFXO selected */
+		error(15);
+#endif /* ULFRCO/LFXO selection */
+
+		/* Exit function */
+		return;
+	}
+
+	startTimer(&delayTimer, ticks, 0, NULL);
+
+	waitOnTimer(&delayTimer, false, NULL, true);
+
+	uint32_t late = RTC_getTicks() - delayTimer.deadline;
+
+	addStats(DELAY_RTC, (uint32_t)(((uint64_t)ticks * 1000000000) / rtcFrequency),
+			(uint32_t)(((uint64_t)late * 1000000000) / rtcFrequency));
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Update the statistics of a delay mechanism.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] mode
+ *   The used delay mechanism.
+ *
+ * @param[in] usTime
+ *   The requested delay time in µs.
+ *
+ * @param[in] usLate
+ *   The measured overshoot in µs.
+ *****************************************************************************/
+static void addStats (DelayMode_t mode, uint32_t usTime, uint32_t usLate)
+{
+	delayStats[mode].calls++;
+	delayStats[mode].usTotal += usTime + usLate;
+	delayStats[mode].usLate += usLate;
+	if (usLate > delayStats[mode].usLateMax) delayStats[mode].usLateMax = usLate;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Interrupt Service Routine for TIMER1 (EM1 delays).
+ *
+ * @note
+ *   The *weak* definition for this method is located in `system_efm32hg.h`.
+ *****************************************************************************/
+void TIMER1_IRQHandler (void)
+{
+	TIMER_IntClear(TIMER1, TIMER_IF_OF);
+
+	timerExpired = true;
 }
-#endif /* SysTick/RTC selection */
 
 
 /**************************************************************************//**
  * @brief
  *   Interrupt Service Routine for the RTC.
  *
+ * @details
+ *   On an overflow the upper bits of the timebase get incremented. On a
+ *   compare match all of the expired timers are taken out of the queue,
+ *   periodic ones get added again with their next deadline. After this,
+ *   compare channel 0 is programmed with the new earliest deadline.
+ *
  * @note
  *   The *weak* definition for this method is located in `system_efm32hg.h`.
  *****************************************************************************/
 void RTC_IRQHandler (void)
 {
-	/* Disable the counter */
-	RTC_Enable(false);
+	/* Read (enabled) interrupt flags */
+	uint32_t flags = RTC_IntGetEnabled();
 
-	/* Clear the interrupt source */
-	RTC_IntClear(RTC_IFC_COMP0);
+	/* Clear the interrupt sources */
+	RTC_IntClear(flags);
+
+	if (flags & RTC_IF_OF) RTC_overflows++;
+
+	uint32_t now = RTC_getTicks();
+
+	/* Take all of the expired timers out of the queue */
+	while ((timerQueue != NULL) && ((int32_t)(timerQueue->deadline - now) <= 0))
+	{
+		Timer_t *timer = timerQueue;
+
+		timerQueue = timer->next;
+		timer->running = false;
+		timer->expired = true;
+
+		/* Periodic timers: base the next deadline on the previous one so they don't drift */
+		if (timer->period != 0)
+		{
+			timer->deadline += timer->period;
+			insertTimer(timer);
+		}
+
+		if (timer->callback != NULL) timer->callback();
+	}
 
-	/* If the wakeup was caused by "sleeping" (not a delay), act accordingly */
-	if (sleeping) RTC_sleep_wakeup = true;
+	programCompare();
 }
@@ -0,0 +1,358 @@
+/***************************************************************************//**
+ * @file fault.c
+ * @brief Watchdog and fault capture functionality.
+ * @version 1.2
+ * @author Brecht Van Eeckhoudt
+ *
+ * ******************************************************************************
+ *
+ * @section Versions
+ *
+ *   @li v1.0: Moved the fault handlers from `main.c` to this file, started saving a crash
+ *             record in RAM which survives a reset and added watchdog functionality.
+ *   @li v1.1: Updated documentation (the watchdog is fed by a software timer while waiting).
+ *   @li v1.2: The `.noinit` section is defined in the project's linker script.
+ *
+ * ******************************************************************************
+ *
+ * @section RETAINED Retained RAM
+ *
+ *   The crash record is put in the `.noinit` section so the startup code doesn't
+ *   clear it on a (soft) reset. The project's linker script (`efm32hg322f64.ld`)
+ *   places this section as `NOLOAD` after `.bss`, outside of the ranges the startup
+ *   code copies (`.data`) and clears (`.bss`). After a power-on reset the content
+ *   is random, that's why the record is only used if its magic value and check
+ *   value match.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#include <stdint.h>        /* (u)intXX_t */
+#include <stdbool.h>       /* "bool", "true", "false" */
+#include <stddef.h>        /* NULL */
+#include "em_device.h"     /* Include necessary MCU-specific header file */
+#include "em_cmu.h"        /* Clock management unit */
+#include "em_wdog.h"       /* Watchdog */
+#include "em_rmu.h"        /* Reset Management Unit */
+
+#include "fault.h"         /* Corresponding header file */
+#include "debug_dbprint.h" /* Enable or disable printing to UART */
+
+
+/* Local definitions */
+/** Value to indicate a valid crash record */
+#define CRASH_MAGIC 0xC0DEFA17
+
+/** Make a string of a definition */
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+
+/** Assembly for the fault handlers: get the used stack pointer (bit 2 of EXC_RETURN) and call `saveFault` with it and the type */
+#define CAPTURE_FAULT(type)        \
+	__asm volatile (               \
+		"movs r0, #4          \n"  \
+		"mov r1, lr           \n"  \
+		"tst r0, r1           \n"  \
+		"bne 1f               \n"  \
+		"mrs r0, msp          \n"  \
+		"b 2f                 \n"  \
+		"1:                   \n"  \
+		"mrs r0, psp          \n"  \
+		"2:                   \n"  \
+		"movs r1, #" TO_STRING(type) " \n" \
+		"ldr r2, =saveFault   \n"  \
+		"bx r2                \n"  \
+	)
+
+
+/* Local variables */
+/* Kept in the `.noinit` section so they survive a (soft) reset */
+__attribute__((section(".noinit"))) uint32_t crashMagic;
+__attribute__((section(".noinit"))) uint32_t crashCheck;
+__attribute__((section(".noinit"))) CrashRecord_t crashRecord;
+__attribute__((section(".noinit"))) uint8_t lastState;
+
+
+/* Local prototypes */
+static void storeCrashRecord (uint8_t type, uint8_t number, uint32_t *stack);
+static uint32_t calculateCheck (void);
+__attribute__((used)) static void saveFault (uint32_t *stack, uint8_t type);
+
+
+/**************************************************************************//**
+ * @brief
+ *   Initialize and start the watchdog.
+ *
+ * @details
+ *   The watchdog runs on the ULFRCO so it keeps counting in EM2 and EM3. While
+ *   waiting in `delay` or `sleep` a periodic software timer feeds it every
+ *   `WDOG_FEED_S` seconds (see `delay.c`), otherwise `feedWatchdog` should be called often enough in `main`.
+ *
+ *   This method also checks the reset cause. If the MCU was reset by the
+ *   watchdog (or a lockup) and no crash record was saved, one is made with
+ *   the last known state so it can also be reported.
+ *****************************************************************************/
+void initWatchdog (void)
+{
+	uint32_t cause = RMU_ResetCauseGet();
+	RMU_ResetCauseClear();
+
+	/* Check if the record in RAM is still valid, forget it otherwise (power-on reset) */
+	if ((crashMagic != CRASH_MAGIC) || (crashCheck != calculateCheck()))
+	{
+		crashMagic = 0;
+
+		if (cause & RMU_RSTCAUSE_WDOGRST) storeCrashRecord(FAULT_WATCHDOG, 0, NULL);
+		else if (cause & RMU_RSTCAUSE_LOCKUPRST) storeCrashRecord(FAULT_LOCKUP, 0, NULL);
+	}
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	if (crashMagic == CRASH_MAGIC)
+	{
+		dbcritInt("Recovered from a crash of type ", crashRecord.type, "");
+		dbcritInt("State: ", crashRecord.state, "");
+		dbcritInt_hex("PC: ", crashRecord.pc, "");
+		dbcritInt_hex("LR: ", crashRecord.lr, "");
+	}
+#endif /* DEBUG_DBPRINT */
+
+	/* The watchdog needs the low energy interface clock */
+	CMU_ClockEnable(cmuClock_HFLE, true);
+
+	WDOG_Init_TypeDef wdog = WDOG_INIT_DEFAULT;
+	wdog.debugRun = false;              /* Don't reset while halted by the debugger */
+	wdog.em2Run = true;                 /* Keep running in EM2 */
+	wdog.em3Run = true;                 /* Keep running in EM3 */
+	wdog.clkSel = wdogClkSelULFRCO;     /* 1 kHz, runs in EM3 */
+	wdog.perSel = wdogPeriod_256k;      /* ~256 seconds */
+
+	WDOG_Init(&wdog);
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbinfo("Watchdog initialized");
+#endif /* DEBUG_DBPRINT */
+
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Feed the watchdog.
+ *****************************************************************************/
+void feedWatchdog (void)
+{
+	WDOG_Feed();
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Remember the current state of the state machine for the crash record.
+ *
+ * @param[in] state
+ *   The current state.
+ *****************************************************************************/
+void FAULT_setState (MCU_State_t state)
+{
+	lastState = state;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Save a crash record for an error number and reset the MCU.
+ *
+ * @param[in] number
+ *   The number to indicate where in the code the error was thrown.
+ *****************************************************************************/
+void FAULT_reset (uint8_t number)
+{
+	storeCrashRecord(FAULT_ERROR, number, NULL);
+
+	NVIC_SystemReset();
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Get the crash record saved before the last reset.
+ *
+ * @param[out] record
+ *   The pointer to put the record in.
+ *
+ * @return
+ *   @li `true` - A crash record is available.
+ *   @li `false` - No crash happened (or it has already been cleared).
+ *****************************************************************************/
+bool FAULT_getCrashRecord (CrashRecord_t *record)
+{
+	if (crashMagic != CRASH_MAGIC) return (false);
+
+	*record = crashRecord;
+
+	return (true);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Clear the crash record after it has been reported.
+ *****************************************************************************/
+void FAULT_clearCrashRecord (void)
+{
+	crashMagic = 0;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Save the crash information in the `.noinit` section.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] type
+ *   The `FAULT_xxx` type.
+ *
+ * @param[in] number
+ *   The error number (only used with `FAULT_ERROR`).
+ *
+ * @param[in] stack
+ *   The stacked exception frame (`NULL` if not available).
+ *****************************************************************************/
+static void storeCrashRecord (uint8_t type, uint8_t number, uint32_t *stack)
+{
+	crashRecord.type = type;
+	crashRecord.state = lastState;
+	crashRecord.number = number;
+
+	if (stack != NULL)
+	{
+		/* Exception frame: R0, R1, R2, R3, R12, LR, PC, xPSR */
+		crashRecord.lr = stack[5];
+		crashRecord.pc = stack[6];
+		crashRecord.xpsr = stack[7];
+	}
+	else
+	{
+		crashRecord.lr = 0;
+		crashRecord.pc = 0;
+		crashRecord.xpsr = 0;
+	}
+
+	crashCheck = calculateCheck();
+	crashMagic = CRASH_MAGIC;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Calculate the check value of the crash record.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @return
+ *   The check value.
+ *****************************************************************************/
+static uint32_t calculateCheck (void)
+{
+	return (~(crashRecord.pc ^ crashRecord.lr ^ crashRecord.xpsr ^
+			 (crashRecord.type | (crashRecord.state << 8) | (crashRecord.number << 16))));
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Save the crash record for a fault handler and reset the MCU.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary. It's marked `used` since it's
+ *   only called from assembly.
+ *
+ * @param[in] stack
+ *   The stack pointer with the exception frame.
+ *
+ * @param[in] type
+ *   The `FAULT_xxx` type.
+ *****************************************************************************/
+static void saveFault (uint32_t *stack, uint8_t type)
+{
+	storeCrashRecord(type, 0, stack);
+
+	NVIC_SystemReset();
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   NMI interrupt service routine.
+ *
+ * @note
+ *   The *weak* definition for this method is located in `startup_gcc_efm32hg.h`.
+ *****************************************************************************/
+__attribute__((naked)) void NMI_Handler (void)
+{
+	CAPTURE_FAULT(FAULT_NMI);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   HardFault interrupt service routine.
+ *
+ * @note
+ *   The *weak* definition for this method is located in `startup_gcc_efm32hg.h`.
+ *****************************************************************************/
+__attribute__((naked)) void HardFault_Handler (void)
+{
+	CAPTURE_FAULT(FAULT_HARDFAULT);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   SVC interrupt service routine.
+ *
+ * @note
+ *   The *weak* definition for this method is located in `startup_gcc_efm32hg.h`.
+ *****************************************************************************/
+__attribute__((naked)) void SVC_Handler (void)
+{
+	CAPTURE_FAULT(FAULT_SVC);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   PendSV interrupt service routine.
+ *
+ * @note
+ *   The *weak* definition for this method is located in `startup_gcc_efm32hg.h`.
+ *****************************************************************************/
+__attribute__((naked)) void PendSV_Handler (void)
+{
+	CAPTURE_FAULT(FAULT_PENDSV);
+}
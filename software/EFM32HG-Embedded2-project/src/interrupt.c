@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file interrupt.c
  * @brief Interrupt functionality.
- * @version 3.1
+ * @version 3.6
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -26,11 +26,18 @@
  *   @li v2.2: Changed error numbering.
  *   @li v3.0: Updated version number.
  *   @li v3.1: Removed `static` before the local variables (not necessary).
+ *   @li v3.2: Added flag checks for the cable monitor on `BREAK_1`.
+ *   @li v3.3: Replaced the `triggered` variables with a lock-free event ring filled by
+ *             all interrupt handlers and started checking the flags of each pin separately.
+ *   @li v3.4: Added a counter for the amount of added events.
+ *   @li v3.5: Events are timestamped with the RTC timebase, the counter isn't stopped anymore on a button press.
+ *   @li v3.6: Started requesting the GPIO clock in `pm.c`.
  *
  * ******************************************************************************
  *
  * @note
- *   Other interrupt handlers can be found in `delay.c` and `adc.c`.
+ *   Other interrupt handlers can be found in `delay.c` and `adc.c`. They
+ *   also add their events to the ring in this file.
  *
  * ******************************************************************************
  *
@@ -66,18 +73,32 @@
 #include "em_device.h"     /* Include necessary MCU-specific header file */
 #include "em_cmu.h"        /* Clock management unit */
 #include "em_gpio.h"       /* General Purpose IO */
-#include "em_rtc.h"        /* Real Time Counter (RTC) */
 
 #include "interrupt.h"     /* Corresponding header file */
 #include "pin_mapping.h"   /* PORT and PIN definitions */
 #include "debug_dbprint.h" /* Enable or disable printing to UART */
 #include "util.h"     	   /* Utility functionality */
-#include "ADXL362.h"       /* Functions related to the accelerometer */
+#include "delay.h"         /* RTC timebase */
+#include "pm.h"            /* Shared clocks */
+
+
+/* Local definition */
+/** Amount of events the ring can hold (needs to be a power of two, one place is always kept empty) */
+#define EVENT_BUFFER_SIZE 16
 
 
 /* Local variables */
-volatile bool PB0_triggered = false; /* Volatile because it's modified by an interrupt service routine */
-volatile bool PB1_triggered = false; /* Volatile because it's modified by an interrupt service routine */
+/* Volatile because they're modified by interrupt service routines */
+volatile Event_t eventBuffer[EVENT_BUFFER_SIZE];
+volatile uint8_t eventHead = 0;    /* Only written by the interrupt handlers (producer) */
+volatile uint8_t eventTail = 0;    /* Only written by `EVENT_get` (consumer) */
+volatile uint16_t eventsDropped = 0; /* Only written by the interrupt handlers (producer) */
+uint16_t eventsDroppedReported = 0;  /* Only written by `EVENT_get` (consumer) */
+volatile uint16_t eventsPushed = 0;  /* Only written by the interrupt handlers (producer) */
+
+
+/* Local prototype */
+static void handleGPIOinterrupts (uint32_t flags);
 
 
 /**************************************************************************//**
@@ -90,9 +111,8 @@ volatile bool PB1_triggered = false; /* Volatile because it's modified by an int
  *****************************************************************************/
 void initGPIOwakeup (void)
 {
-	/* Enable necessary clocks (just in case) */
-	CMU_ClockEnable(cmuClock_HFPER, true); /* GPIO is a High Frequency Peripheral */
-	CMU_ClockEnable(cmuClock_GPIO, true);
+	/* The GPIO clock stays requested for the pin interrupts */
+	PM_ClockRequest(PM_CLOCK_GPIO);
 
 	/* Configure PB0 and PB1 as input with glitch filter enabled, last argument sets pull direction */
 	GPIO_PinModeSet(PB0_PORT, PB0_PIN, gpioModeInputPullFilter, 1);
@@ -133,86 +153,131 @@ void initGPIOwakeup (void)
 
 /**************************************************************************//**
  * @brief
- *   Getter for the `PB0_triggered` and `PB1_triggered` variables.
+ *   Add an event to the ring, only call this method from an interrupt handler.
  *
- * @param[in] number
- *   @li `0` - `PB0_triggered` selected.
- *   @li `1` - `PB1_triggered` selected.
+ * @details
+ *   The ring is a single-producer/single-consumer queue without locks: only
+ *   the interrupt handlers write `eventHead` and only `EVENT_get` writes
+ *   `eventTail`. The event is written completely before `eventHead` is moved,
+ *   so `EVENT_get` never sees half an event.
  *
- * @return
- *   The value of `PB0_triggered` or `PB1_triggered`.
+ *   If the ring is full the event is dropped (older events are never
+ *   overwritten) and `eventsDropped` gets incremented.
+ *
+ * @warning
+ *   All of the interrupt handlers calling this method together act as *one*
+ *   producer. This is only true because they all have the same (default)
+ *   priority so they can't interrupt each other. Don't change one of
+ *   their priorities without also changing this logic!
+ *
+ * @param[in] source
+ *   The source of the event.
+ *
+ * @param[in] payload
+ *   Extra data belonging to the event (see `Event_Source_t`).
  *****************************************************************************/
-bool BTN_getTriggered (uint8_t number)
+void EVENT_push (Event_Source_t source, uint32_t payload)
 {
-	if (number == 0) return (PB0_triggered);
-	else if (number == 1) return (PB1_triggered);
-	else
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbcrit("Non-existing button selected!");
-#endif /* DEBUG_DBPRINT */
+	uint8_t next = (eventHead + 1) & (EVENT_BUFFER_SIZE - 1);
 
-		error(18);
+	eventsPushed++;
 
-		return (false);
+	/* Drop the event if the ring is full */
+	if (next == eventTail)
+	{
+		eventsDropped++;
+		return;
 	}
+
+	eventBuffer[eventHead].source = source;
+	eventBuffer[eventHead].tick = RTC_getTicks();
+	eventBuffer[eventHead].payload = payload;
+
+	/* Publish the event only after it has been written completely */
+	eventHead = next;
 }
 
 
 /**************************************************************************//**
  * @brief
- *   Setter for the `PB0_triggered` and `PB1_triggered` variable.
+ *   Get the oldest event out of the ring, only call this method from `main`.
  *
- * @param[in] number
- *   @li `0` - `PB0_triggered selected`.
- *   @li `1` - `PB1_triggered selected`.
+ * @details
+ *   Call this method in a loop until it returns `false` to handle all of the
+ *   gathered events in one pass. If events have been dropped since the last
+ *   call, `error(18)` is called once (outside of an interrupt handler).
+ *
+ * @param[out] event
+ *   The pointer to put the event in.
  *
- * @param[in] value
- *   The boolean value to set to the selected variable.
+ * @return
+ *   @li `true` - An event has been put in `event`.
+ *   @li `false` - The ring is empty.
  *****************************************************************************/
-void BTN_setTriggered (uint8_t number, bool value)
+bool EVENT_get (Event_t *event)
 {
-	if (number == 0) PB0_triggered = value;
-	else if (number == 1) PB1_triggered = value;
-	else
+	/* Report dropped events (the counter itself is only written by the producer) */
+	uint16_t dropped = eventsDropped;
+
+	if (dropped != eventsDroppedReported)
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbcrit("Non-existing button selected!");
+		dbcritInt("Event ring full, dropped ", (uint16_t)(dropped - eventsDroppedReported), " event(s)!");
 #endif /* DEBUG_DBPRINT */
 
-		error(19);
+		eventsDroppedReported = dropped;
+
+		error(18);
 	}
+
+	/* Check if the ring is empty */
+	if (eventTail == eventHead) return (false);
+
+	event->source = eventBuffer[eventTail].source;
+	event->tick = eventBuffer[eventTail].tick;
+	event->payload = eventBuffer[eventTail].payload;
+
+	/* Free the place only after the event has been read completely */
+	eventTail = (eventTail + 1) & (EVENT_BUFFER_SIZE - 1);
+
+	return (true);
 }
 
 
 /**************************************************************************//**
  * @brief
- *   GPIO Even IRQ for pushbuttons on even-numbered pins.
+ *   Get the amount of events added since boot (including the dropped ones).
  *
  * @details
- *   The RTC is also disabled on a button press (*manual wake-up*)
+ *   This can be used to check if an interrupt handler added an event in
+ *   between two moments without taking events out of the ring.
+ *
+ * @return
+ *   The amount of added events (overflows back to zero).
+ *****************************************************************************/
+uint16_t EVENT_getCount (void)
+{
+	return (eventsPushed);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   GPIO Even IRQ for pushbuttons on even-numbered pins.
  *
  * @note
  *   The *weak* definition for this method is located in `system_efm32hg.h`.
  *****************************************************************************/
 void GPIO_EVEN_IRQHandler (void)
 {
-	/* Read interrupt flags */
-	uint32_t flags = GPIO_IntGet();
-
-	/* Check if PB1 is pushed */
-	if (flags == 0x400)
-	{
-		/* Disable the counter (manual wakeup) */
-		RTC_Enable(false);
-
-		PB1_triggered = true;
-	}
+	/* Read (enabled) interrupt flags */
+	uint32_t flags = GPIO_IntGetEnabled() & 0x5555;
 
 	/* Clear all even pin interrupt flags */
 	GPIO_IntClear(0x5555);
+
+	handleGPIOinterrupts(flags);
 }
 
 
@@ -220,33 +285,57 @@ void GPIO_EVEN_IRQHandler (void)
  * @brief
  *   GPIO Odd IRQ for pushbuttons on odd-numbered pins.
  *
- * @details
- *   The RTC is also disabled on a button press (*manual wakeup*).
- *
  * @note
  *   The *weak* definition for this method is located in `system_efm32hg.h`.
  *****************************************************************************/
 void GPIO_ODD_IRQHandler (void)
 {
-	/* Read interrupt flags */
-	uint32_t flags = GPIO_IntGet();
+	/* Read (enabled) interrupt flags */
+	uint32_t flags = GPIO_IntGetEnabled() & 0xAAAA;
+
+	/* Clear all odd pin interrupt flags */
+	GPIO_IntClear(0xAAAA);
+
+	handleGPIOinterrupts(flags);
+}
 
+
+/**************************************************************************//**
+ * @brief
+ *   Add an event to the ring for each pin which caused an interrupt.
+ *
+ * @details
+ *   Every flag is checked on its own so simultaneous edges don't get lost.
+ *   The interrupt numbers are the same as the pin numbers so the same checks
+ *   work for both the even and odd IRQ and for both board pinouts.
+ *
+ *   A button press (*manual wake-up*) only adds its event, the RTC keeps
+ *   running since all timers use it as timebase.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] flags
+ *   The (enabled) interrupt flags.
+ *****************************************************************************/
+static void handleGPIOinterrupts (uint32_t flags)
+{
 	/* Check if PB0 is pushed */
-	if (flags == 0x200)
+	if (flags & (1 << PB0_PIN))
 	{
-		/* Disable the counter (manual wake-up) */
-		RTC_Enable(false);
+		EVENT_push(EVENT_PB0, 0);
+	}
 
-		PB0_triggered = true;
+	/* Check if PB1 is pushed */
+	if (flags & (1 << PB1_PIN))
+	{
+		EVENT_push(EVENT_PB1, 0);
 	}
 
 	/* Check if INT1 is triggered */
-#if CUSTOM_BOARD == 1 /* Custom Happy Gecko pinout */
-	if (flags == 0x8) ADXL_setTriggered(true);
-#else /* Regular Happy Gecko pinout */
-	if (flags == 0x80) ADXL_setTriggered(true);
-#endif /* Board pinout selection */
+	if (flags & (1 << ADXL_INT1_PIN)) EVENT_push(EVENT_ADXL, 0);
 
-	/* Clear all odd pin interrupt flags */
-	GPIO_IntClear(0xAAAA);
+	/* Check if the cable monitor is triggered */
+	if (flags & (1 << BREAK1_PIN)) EVENT_push(EVENT_CABLE, 0);
 }
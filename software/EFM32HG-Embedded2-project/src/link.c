@@ -0,0 +1,362 @@
+/***************************************************************************//**
+ * @file link.c
+ * @brief Choose the data rate and output power from the LoRaWAN link margin.
+ * @version 1.1
+ * @author Brecht Van Eeckhoudt
+ *
+ * ******************************************************************************
+ *
+ * @section Versions
+ *
+ *   @li v1.0: Started with the link manager (Link Check answers, margin estimate,
+ *             cheapest setting with enough margin, fallback when answers stop).
+ *   @li v1.1: Only accept answers while requests are added, normalise them with
+ *             the setting of the uplinks which carried the requests.
+ *
+ * ******************************************************************************
+ *
+ * @section LINK Link manager
+ *
+ *   If `LINK_MANAGER` is `1` (`lora_settings.h`) ADR is disabled and this file
+ *   chooses the data rate and output power:
+ *     - Every `LINK_CHECK_UPLINKS` uplinks the RN2483 adds a *Link Check* request
+ *       to the next uplinks until an answer arrives. The answer contains the
+ *       demodulation margin at the best gateway. The modem keeps returning the
+ *       last answer, so only a downlink while requests are added counts.
+ *     - The output power and the required SNR of the data rate of the uplinks
+ *       with the requests are taken out of the margin, which gives the margin
+ *       of a 0 dBm uplink with a 0 dB required SNR. This is averaged, so the
+ *       answers stay comparable when the setting changes.
+ *     - The cheapest setting which is expected to reach `LINK_TARGET_MARGIN_DB`
+ *       is used. One SF step about doubles the airtime, which costs more than
+ *       the current difference between 2 and 14 dBm, so the lowest SF wins
+ *       and the output power is only lowered within that SF.
+ *     - If `LINK_LOST_UPLINKS` uplinks with a request didn't get an answer, the
+ *       output power goes to 14 dBm first and the SF goes up one step after that.
+ *
+ *   The choice is kept with `CONFIG_setLink` and used for a (new) join. If
+ *   `LINK_MANAGER` is `0` the data rate chosen by ADR is kept the same way.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#include <stdint.h>        /* (u)intXX_t */
+#include <stdbool.h>       /* "bool", "true", "false" */
+
+#include "link.h"          /* Corresponding header file */
+#include "lora.h"          /* LoRaWAN functionality */
+#include "lora_settings.h" /* LINK_MANAGER */
+#include "config.h"        /* Settings which are kept in the user data page */
+#include "debug_dbprint.h" /* Enable or disable printing to UART */
+#include "util.h"          /* Utility functionality */
+
+
+/* Local definitions */
+/** The margin estimate is kept in 1/16 dB, each new answer weighs 1/4 */
+#define LINK_SCALE          16
+#define LINK_WEIGHT         4
+
+/** Output power indexes (`1 = 14 dBm` - `5 = 2 dBm`) */
+#define LINK_POWER_MAX      1
+#define LINK_POWER_MIN      5
+
+/** Link Check interval [s] while an answer is wanted, every uplink after it carries a request */
+#define LINK_CHECK_INTERVAL 1
+
+
+/* Local variables */
+/** Uplink count (`LoRa_GetAirtime`) at the last update */
+static uint16_t lastUplinks = 0;
+
+#if LINK_MANAGER == 1 /* LINK_MANAGER */
+/** Required SNR to demodulate in 0.5 dB per data rate (SF12 - SF7) */
+static const int8_t requiredSNR[] = {-40, -35, -30, -25, -20, -15};
+
+/** Output power in dBm per index (`1 - 5`) */
+static const int8_t powerDBM[] = {14, 11, 8, 5, 2};
+
+/** Average margin at 0 dBm and a 0 dB required SNR in 1/16 dB */
+static int32_t estimate;
+static bool estimated = false;
+
+/** Link Check requests are being added to the uplinks, with this data rate and output power index */
+static bool requesting = false;
+static uint8_t checkDataRate;
+static uint8_t checkPower;
+
+/** Uplinks since the last answer or since the requests started */
+static uint16_t uplinksSince = 0;
+#endif /* LINK_MANAGER */
+
+
+/* Local prototypes */
+#if LINK_MANAGER == 1 /* LINK_MANAGER */
+static int32_t predictMargin (uint8_t dataRate, uint8_t power);
+static void chooseSetting (uint8_t *dataRate, uint8_t *power);
+static void applySetting (uint8_t dataRate, uint8_t power);
+static void requestLinkCheck (bool enable);
+#endif /* LINK_MANAGER */
+
+
+/**************************************************************************//**
+ * @brief
+ *   Fill in the link settings used for a (new) join.
+ *
+ * @details
+ *   The data rate and output power come from `CONFIG_get`, Link Check
+ *   requests continue if an answer was still wanted.
+ *
+ * @param[out] settings
+ *   The settings passed to `LoRa_Init`.
+ *****************************************************************************/
+void LINK_configure (LoRaSettings_t *settings)
+{
+	settings->dataRate = (LoRaDataRate_t) CONFIG_get()->dataRate;
+	settings->power = CONFIG_get()->txPower;
+
+#if LINK_MANAGER == 1 /* LINK_MANAGER */
+	settings->linkCheckInterval = requesting ? LINK_CHECK_INTERVAL : 0;
+#else /* LINK_MANAGER */
+	settings->linkCheckInterval = 0;
+#endif /* LINK_MANAGER */
+
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Update the link after the uplinks of a wake-up were sent.
+ *
+ * @details
+ *   Nothing happens if there weren't any uplinks. Otherwise a Link Check
+ *   answer updates the margin estimate and the setting is chosen again (see
+ *   `link.c`), or a missing answer can cause a more robust setting.
+ *
+ * @note
+ *   The module needs to be joined.
+ *****************************************************************************/
+void LINK_update (void)
+{
+	LoRaAirtime_t airtime;
+	LoRa_GetAirtime(&airtime);
+
+	uint16_t uplinks = airtime.uplinks - lastUplinks;
+	lastUplinks = airtime.uplinks;
+
+	if (uplinks == 0) return; /* Exit function */
+
+#if LINK_MANAGER == 1 /* LINK_MANAGER */
+
+	uint8_t dataRate = CONFIG_get()->dataRate;
+	uint8_t power = CONFIG_get()->txPower;
+	LoRaLink_t link;
+
+	/* Without requests a downlink doesn't carry a new answer */
+	if (requesting && LoRa_GetLinkCheck(&link))
+	{
+		int32_t sample = (link.margin * LINK_SCALE) + (requiredSNR[checkDataRate] * (LINK_SCALE / 2)) - (powerDBM[checkPower - 1] * LINK_SCALE);
+
+		if (estimated) estimate += (sample - estimate) / LINK_WEIGHT;
+		else estimate = sample;
+		estimated = true;
+
+		uplinksSince = 0;
+		requestLinkCheck(false);
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbinfoInt("Link margin: ", link.margin, " dB");
+		dbinfoInt("Gateways: ", link.gateways, "");
+		dbinfoInt("Downlink SNR: ", link.snr, " dB");
+#endif /* DEBUG_DBPRINT */
+
+		chooseSetting(&dataRate, &power);
+		applySetting(dataRate, power);
+		return; /* Exit function */
+	}
+
+	uplinksSince += uplinks;
+
+	if (!requesting)
+	{
+		if (!estimated || (uplinksSince >= LINK_CHECK_UPLINKS))
+		{
+			uplinksSince = 0;
+			requestLinkCheck(true);
+		}
+	}
+	else if (uplinksSince >= LINK_LOST_UPLINKS)
+	{
+		/* No answers, the uplinks probably don't arrive: more power first, a higher SF after that */
+		if (power > LINK_POWER_MAX) power = LINK_POWER_MAX;
+		else if (dataRate > SF12_BW125) dataRate--;
+
+		uplinksSince = 0;
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbwarn("No Link Check answers, using a more robust setting.");
+#endif /* DEBUG_DBPRINT */
+
+		applySetting(dataRate, power);
+		requestLinkCheck(true); /* Answers about the previous setting don't count anymore */
+	}
+
+#else /* LINK_MANAGER */
+
+	/* Keep the data rate ADR chose for a (new) join */
+	CONFIG_setLink(LoRa_GetDataRate(), CONFIG_get()->txPower);
+
+#endif /* LINK_MANAGER */
+
+}
+
+
+#if LINK_MANAGER == 1 /* LINK_MANAGER */
+/**************************************************************************//**
+ * @brief
+ *   Calculate the expected margin of a setting.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] dataRate
+ *   The `LoRaDataRate_t` value.
+ *
+ * @param[in] power
+ *   The output power index.
+ *
+ * @return
+ *   The expected margin in 1/16 dB.
+ *****************************************************************************/
+static int32_t predictMargin (uint8_t dataRate, uint8_t power)
+{
+	return (estimate + (powerDBM[power - 1] * LINK_SCALE) - (requiredSNR[dataRate] * (LINK_SCALE / 2)));
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Choose the cheapest setting with enough margin.
+ *
+ * @details
+ *   The settings are tried from the cheapest (SF7, 2 dBm) to the most robust
+ *   (SF12, 14 dBm). A setting cheaper than the one in use needs
+ *   `LINK_HYSTERESIS_DB` more margin. If none of them is good enough the most
+ *   robust one is used.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in,out] dataRate
+ *   The `LoRaDataRate_t` value in use, the chosen one afterwards.
+ *
+ * @param[in,out] power
+ *   The output power index in use, the chosen one afterwards.
+ *****************************************************************************/
+static void chooseSetting (uint8_t *dataRate, uint8_t *power)
+{
+	bool cheaper = true; /* Until the setting in use is reached */
+
+	for (int8_t dr = SF7_BW125; dr >= SF12_BW125; dr--)
+	{
+		for (uint8_t p = LINK_POWER_MIN; p >= LINK_POWER_MAX; p--)
+		{
+			if ((dr == *dataRate) && (p == *power)) cheaper = false;
+
+			int32_t needed = LINK_TARGET_MARGIN_DB * LINK_SCALE;
+			if (cheaper) needed += LINK_HYSTERESIS_DB * LINK_SCALE;
+
+			if (predictMargin(dr, p) >= needed)
+			{
+				*dataRate = dr;
+				*power = p;
+				return; /* Exit function */
+			}
+		}
+	}
+
+	*dataRate = SF12_BW125;
+	*power = LINK_POWER_MAX;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Apply and keep a data rate and output power if they changed.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] dataRate
+ *   The `LoRaDataRate_t` value.
+ *
+ * @param[in] power
+ *   The output power index.
+ *****************************************************************************/
+static void applySetting (uint8_t dataRate, uint8_t power)
+{
+	if ((dataRate == CONFIG_get()->dataRate) && (power == CONFIG_get()->txPower)) return; /* Exit function */
+
+	if ((LoRa_SetDataRate((LoRaDataRate_t) dataRate) != SUCCESS) || (LoRa_SetPower(power) != SUCCESS))
+	{
+		error(65);
+		return; /* Exit function, try again after the next answer */
+	}
+
+	CONFIG_setLink(dataRate, power);
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbwarnInt("Link: data rate ", dataRate, "");
+	dbwarnInt("Link: output power index ", power, "");
+#endif /* DEBUG_DBPRINT */
+
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Start or stop adding Link Check requests to the uplinks.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] enable
+ *   @li `true` - Add a request to every uplink until an answer arrives, only
+ *                downlinks from now on can carry it.
+ *   @li `false` - Stop adding requests.
+ *****************************************************************************/
+static void requestLinkCheck (bool enable)
+{
+	if (LoRa_SetLinkCheck(enable ? LINK_CHECK_INTERVAL : 0) != SUCCESS)
+	{
+		error(66);
+		return; /* Exit function */
+	}
+
+	requesting = enable;
+	checkDataRate = CONFIG_get()->dataRate;
+	checkPower = CONFIG_get()->txPower;
+}
+#endif /* LINK_MANAGER */
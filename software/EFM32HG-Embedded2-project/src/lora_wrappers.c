@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file lora_wrappers.c
  * @brief LoRa wrapper methods
- * @version 2.4
+ * @version 3.8
  * @author
  *   Benjamin Van der Smissen@n
  *   Heavily modified by Brecht Van Eeckhoudt
@@ -22,16 +22,27 @@
  *   @li v2.2: Fixed suboptimal buffer logic causing lockups after some runtime.
  *   @li v2.3: Chanced logic to clear the buffer before going to sleep.
  *   @li v2.4: Removed `static` before the local variables (not necessary).
+ *   @li v2.5: Made room for the cable loop levels and changed `sendCableBroken` argument to a value.
+ *   @li v2.6: Added method to send the accumulated errors.
+ *   @li v2.7: Started sending the crash record (if any) once along with a status value.
+ *   @li v2.8: The LFXO (LEUART clock) is only requested while LoRaWAN functionality is enabled.
+ *   @li v2.9: LoRaWAN communication runs at the high HFRCO band.
+ *   @li v3.0: The RN2483 pins are parked (disabled) using a precomputed pin profile before its rail is switched off.
+ *   @li v3.1: Added `LORA_PERSISTENT` to keep the RN2483 joined in `sys sleep` between uplinks.
+ *   @li v3.2: The LPP buffer is cleared instead of freed after sending (static payload storage).
+ *   @li v3.3: The LFXO is only requested if the RN2483 uses the LEUART (see `RN2483_HF_USART`).
+ *   @li v3.4: Configuration downlinks are applied and acknowledged before disabling LoRaWAN.
+ *   @li v3.5: Messages are merged into as few uplinks as possible, sent when disabling LoRaWAN.
+ *   @li v3.6: Pending messages are packed into as few uplinks as possible, in the order of their `PRIORITY_xxx` value.
+ *   @li v3.7: Added the link manager (`link.c`) and the output power from a configuration downlink.
+ *   @li v3.8: The acknowledgment of a configuration downlink waits for the next uplink.
  *
  * ******************************************************************************
  *
  * @todo
  *   **Future improvements:**@n
- *     - Save LoRaWAN settings during INIT before calling `disableLoRaWAN`?
- *         - Should be possible in ABP (saving to EEPROM? `saveMAC`?) See reference manual!
- *         - Update code where `initLoRaWAN` and other methods are called.
- *     - Fix `sleepLoRaWAN` and `wakeLoRaWAN` methods.
- *         - First separate `ULFRCO` definition in `delay.c`
+ *     - Use `mac save` after a join so a reset module can resume its session
+ *       (the frame counters would also need to be kept, EEPROM wear!).
  *
  * ******************************************************************************
  *
@@ -63,12 +74,13 @@
 
 
 #include <stdlib.h>        /* "round" and memory functionality */
+#include <string.h>        /* memcpy */
 #include <stdbool.h>       /* "bool", "true", "false" */
 #include "em_gpio.h"       /* General Purpose IO */
-#include "em_leuart.h"     /* Low Energy Universal Asynchronous Receiver/Transmitter Peripheral API */
 
 #include "lora.h"          /* LoRaWAN functionality */
 #include "lpp.h"           /* Basic Low Power Payload (LPP) functionality */
+#include "leuart.h"        /* Leuart_Reset */
 #include "pm.h"            /* Power management functionality */
 #include "lora_settings.h" /* LoRaWAN settings */
 
@@ -77,12 +89,69 @@
 #include "debug_dbprint.h" /* Enable or disable printing to UART for debugging */
 #include "datatypes.h"     /* Definitions of the custom data-types */
 #include "util.h"          /* Utility functionality */
+#include "fault.h"         /* Crash record functionality */
+#include "delay.h"         /* LFXO requests */
+#include "config.h"        /* Settings which can be changed with a downlink */
+#include "link.h"          /* Data rate and output power from the link margin */
+
+
+/* Local definitions */
+/** RN2483 pins while the module is powered down, driving them would power it through its IO pins */
+#define RN2483_PINS_OFF(X, p)                                      \
+	X(p, RN2483_RESET_PORT, RN2483_RESET_PIN, gpioModeDisabled, 0) \
+	X(p, RN2483_RX_PORT, RN2483_RX_PIN, gpioModeDisabled, 0)       \
+	X(p, RN2483_TX_PORT, RN2483_TX_PIN, gpioModeDisabled, 0)
+
+/** Duration of `sys sleep` in milliseconds (maximum), the module is always woken up by `initLoRaWAN` before */
+#define LORA_SLEEP_MS 4294967295UL
+
+/** Maximum amount of pending messages and their total size in bytes (a measurement and error report of 51 bytes, a status with crash record, ...) */
+#define UPLINK_RECORDS 8
+#define UPLINK_STORAGE 160
+
+/** A message waiting to be packed into an uplink */
+typedef struct
+{
+	uint8_t priority;  /* `PRIORITY_xxx` value */
+	uint8_t sendError; /* Error number to call if the uplink can't be sent */
+	uint8_t offset;    /* Start in `recordStorage` */
+	uint8_t length;
+	bool crash;        /* Contains the crash record */
+	bool packed;       /* Already put in an uplink */
+} UplinkRecord_t;
 
 
 /* Local (application) variables */
 LoRaSettings_t loraSettings = LORA_INIT_MY_DEVICE;
 LoRaStatus_t loraStatus;
 LPP_Buffer_t appData;
+const PinProfile_t rn2483PinsOff = PIN_PROFILE(RN2483_PINS_OFF);
+
+/** Messages waiting to be packed into uplinks, their bytes are kept in `recordStorage` */
+UplinkRecord_t records[UPLINK_RECORDS];
+uint8_t recordStorage[UPLINK_STORAGE];
+uint8_t recordCount = 0;
+uint8_t recordBytes = 0;
+
+/** The message being added (points in `recordStorage`) */
+LPP_Buffer_t recordData;
+
+/** Keep if the crash record is in one of the pending records */
+bool crashQueued = false;
+
+#if LORA_PERSISTENT == 1 /* LORA_PERSISTENT */
+/** Keep if the RN2483 is sleeping with a joined session */
+bool loraSleeping = false;
+#endif /* LORA_PERSISTENT */
+
+
+/* Local prototypes */
+static void powerDownRN2483 (void);
+static bool openRecord (uint8_t priority, uint8_t size, uint8_t sendError);
+static void closeRecord (bool crash);
+static void flushUplinks (void);
+static void handleDownlink (void);
+static void sendConfigAck (uint8_t result);
 
 
 /**************************************************************************//**
@@ -96,7 +165,43 @@ void initLoRaWAN (void)
 	appData.fill = 0;
 	appData.buffer = NULL;
 
-	/* Initialize LoRaWAN communication */
+#if RN2483_HF_USART == 0 /* RN2483_HF_USART */
+	/* Start the LFXO for the LEUART, it stabilizes while the RN2483 is being reset */
+	LFXO_request();
+#endif /* RN2483_HF_USART */
+
+	/* Building the commands and payloads (hex conversion, ...) is the
+	 * heaviest computation, the waits in between are in EM2 or at a low band */
+	PM_SetBand(PM_BAND_HIGH);
+
+#if LORA_PERSISTENT == 1 /* LORA_PERSISTENT */
+	if (loraSleeping)
+	{
+		loraSleeping = false;
+
+		/* The session is still there, the uplink can be sent right away */
+		if (LoRa_WakeUp() == SUCCESS)
+		{
+			loraStatus = JOINED;
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+			dbinfo("LoRaWAN woken up.");
+#endif /* DEBUG_DBPRINT */
+
+			return;
+		}
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbwarn("RN2483 didn't wake up, resetting it...");
+#endif /* DEBUG_DBPRINT */
+
+		/* Power cycle the module, `LoRa_Init` enables the rail again */
+		powerDownRN2483();
+	}
+#endif /* LORA_PERSISTENT */
+
+	/* Initialize LoRaWAN communication (the data rate and output power come from `link.c`) */
+	LINK_configure(&loraSettings);
 	loraStatus = LoRa_Init(loraSettings);
 
 	if (loraStatus != JOINED) error(30);
@@ -111,14 +216,50 @@ void initLoRaWAN (void)
 /**************************************************************************//**
  * @brief
  *   Disable LoRaWAN functionality.
+ *
+ * @details
+ *   The queued messages are sent first, after that the link manager looks at
+ *   the answers and a configuration downlink received with them is handled.
+ *
+ *   If `LORA_PERSISTENT` is `1` and the module has joined, it's put in
+ *   `sys sleep` instead of cutting its power. The TX pin stays high while
+ *   the LEUART is reset, a low level would wake the module.
  *****************************************************************************/
 void disableLoRaWAN (void)
 {
-	LEUART_Reset(RN2483_UART);
-	PM_Disable(PM_RN2483);
-	GPIO_PinOutClear(RN2483_RESET_PORT, RN2483_RESET_PIN);
-	GPIO_PinOutClear(RN2483_RX_PORT, RN2483_RX_PIN);
-	GPIO_PinOutClear(RN2483_TX_PORT, RN2483_TX_PIN);
+	flushUplinks();
+
+	if (loraStatus == JOINED)
+	{
+		LINK_update();
+		handleDownlink();
+	}
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	LoRaAirtime_t airtime;
+	LoRa_GetAirtime(&airtime);
+	dbinfoInt("Total airtime: ", airtime.ms, " ms");
+	dbinfoInt("Uplinks deferred by the duty cycle: ", airtime.deferred, "");
+#endif /* DEBUG_DBPRINT */
+
+#if LORA_PERSISTENT == 1 /* LORA_PERSISTENT */
+	if (loraStatus == JOINED)
+	{
+		bool wakeUp = false;
+		LoRa_Sleep(LORA_SLEEP_MS, &wakeUp);
+		Leuart_Reset();
+		loraSleeping = true;
+	}
+	else powerDownRN2483();
+#else /* LORA_PERSISTENT */
+	powerDownRN2483();
+#endif /* LORA_PERSISTENT */
+
+#if RN2483_HF_USART == 0 /* RN2483_HF_USART */
+	LFXO_release(); /* The LEUART doesn't need the LFXO anymore */
+#endif /* RN2483_HF_USART */
+
+	PM_SetBand(PM_BAND_DEFAULT);
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
 	dbinfo("LoRaWAN disabled.");
@@ -137,7 +278,7 @@ void disableLoRaWAN (void)
 void sleepLoRaWAN (uint32_t sSleep)
 {
 	bool wakeUp = false;
-	LoRa_Sleep((1000*sSleep), &wakeUp); /* "wakeUp" is not used in underlying method */
+	LoRa_Sleep((1000*sSleep), &wakeUp); /* "wakeUp" is not used in underlying method, the module answers when it wakes up */
 }
 
 
@@ -165,37 +306,21 @@ void wakeLoRaWAN (void)
  *****************************************************************************/
 void sendMeasurements (MeasurementData_t data)
 {
-	/* Initialize LPP-formatted payload
-	 * For 6 measurements we need a max amount of 43 bytes (see `LPP_AddMeasurements` method documentation for the calculation) */
-	if (!LPP_InitBuffer(&appData, 43))
+	/* Reserve space in the uplink - We need 9 + 7*measurements bytes, 51 bytes for 6 measurements (see `LPP_AddMeasurements` method documentation) */
+	if (!openRecord(PRIORITY_MEASUREMENTS, 9 + 7*data.index, 33))
 	{
 		error(31);
 		return; /* Exit function */
 	}
 
 	/* Add measurements to the LPP packet using the custom convention to save bytes send */
-	if (!LPP_AddMeasurements(&appData, data))
+	if (!LPP_AddMeasurements(&recordData, data))
 	{
 		error(32);
 		return; /* Exit function */
 	}
 
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-	dbinfo("Started sending LPP buffer...");
-#endif /* DEBUG_DBPRINT */
-
-	/* Send custom LPP-like-formatted payload */
-	if (LoRa_SendLppBuffer(appData, LORA_UNCONFIMED) != SUCCESS)
-	{
-		error(33);
-		return; /* Exit function */
-	}
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-	dbinfo("LPP buffer send.");
-#endif /* DEBUG_DBPRINT */
-
-	LPP_FreeBuffer(&appData); // Clear buffer before going to sleep
+	closeRecord(false);
 }
 
 
@@ -212,67 +337,53 @@ void sendMeasurements (MeasurementData_t data)
  *****************************************************************************/
 void sendStormDetected (bool stormDetected)
 {
-	/* Initialize LPP-formatted payload - We need 4 bytes */
-	if (!LPP_InitBuffer(&appData, 4))
+	/* Reserve space in the uplink - We need 4 bytes */
+	if (!openRecord(PRIORITY_STORM, 4, 36))
 	{
 		error(34);
 		return; /* Exit function */
 	}
 
 	/* Add value to the LPP packet using the custom convention */
-	if (!LPP_AddStormDetected(&appData, stormDetected))
+	if (!LPP_AddStormDetected(&recordData, stormDetected))
 	{
 		error(35);
 		return; /* Exit function */
 	}
 
-	/* Send custom LPP-like-formatted payload */
-	if (LoRa_SendLppBuffer(appData, LORA_UNCONFIMED) != SUCCESS)
-	{
-		error(36);
-		return; /* Exit function */
-	}
-
-	LPP_FreeBuffer(&appData); // Clear buffer before going to sleep
+	closeRecord(false);
 }
 
 
 /**************************************************************************//**
  * @brief
- *   Send a packet to the cloud using LoRaWAN to indicate that the cable is broken.
+ *   Send a packet to the cloud using LoRaWAN to indicate that the cable is broken
+ *   or degrading.
  *
  * @details
  *   The value gets added to the LPP packet following the *custom message convention*.
  *
  * @param[in] cableBroken
- *   @li `true` - The cable is intact.
- *   @li `false` - The cable is broken!
+ *   @li `CABLE_BROKEN` - The cable is broken!
+ *   @li `CABLE_DEGRADED` - The cable is still intact but its resistance drifted above the baseline.
  *****************************************************************************/
-void sendCableBroken (bool cableBroken)
+void sendCableBroken (uint8_t cableBroken)
 {
-	/* Initialize LPP-formatted payload - We need 4 bytes */
-	if (!LPP_InitBuffer(&appData, 4))
+	/* Reserve space in the uplink - We need 4 bytes */
+	if (!openRecord(PRIORITY_CABLE, 4, 39))
 	{
 		error(37);
 		return; /* Exit function */
 	}
 
 	/* Add value to the LPP packet using the custom convention */
-	if (!LPP_AddCableBroken(&appData, cableBroken))
+	if (!LPP_AddCableBroken(&recordData, cableBroken))
 	{
 		error(38);
 		return; /* Exit function */
 	}
 
-
-	/* Send custom LPP-like-formatted payload */
-	if (LoRa_SendLppBuffer(appData, LORA_UNCONFIMED) != SUCCESS)
-	{
-		error(39);
-		return; /* Exit function */
-	}
-
-	LPP_FreeBuffer(&appData); // Clear buffer before going to sleep
+	closeRecord(false);
 }
 
 
@@ -280,33 +391,70 @@ void sendCableBroken (bool cableBroken)
  * @brief
  *   Send a packet to indicate a *status*.
  *
+ * @details
+ *   If a crash record from before the last reset is available it gets added
+ *   to the same packet. It's cleared after sending so it's only reported once.
+ *
  * @param[in] status
  *   The status value to send.
  *****************************************************************************/
 void sendStatus (uint8_t status)
 {
-	/* Initialize LPP-formatted payload - We need 4 bytes */
-	if (!LPP_InitBuffer(&appData, 4))
+	CrashRecord_t record;
+	bool crashed = !crashQueued && FAULT_getCrashRecord(&record); /* Don't add it twice */
+
+	/* Reserve space in the uplink - We need 4 bytes (+17 bytes for a crash record) */
+	if (!openRecord(PRIORITY_STATUS, crashed ? 21 : 4, 42))
 	{
 		error(40);
 		return; /* Exit function */
 	}
 
 	/* Add value to the LPP packet using the custom convention */
-	if (!LPP_AddStatus(&appData, status))
+	if (!LPP_AddStatus(&recordData, status))
 	{
 		error(41);
 		return; /* Exit function */
 	}
 
-	/* Send custom LPP-like-formatted payload */
-	if (LoRa_SendLppBuffer(appData, LORA_UNCONFIMED) != SUCCESS)
+	/* Add the crash record to the LPP packet using the custom convention */
+	if (crashed && !LPP_AddCrashRecord(&recordData, record))
 	{
-		error(42);
+		error(41);
 		return; /* Exit function */
 	}
 
-	LPP_FreeBuffer(&appData); // Clear buffer before going to sleep
+	closeRecord(crashed); /* The crash record is only cleared after it has been sent */
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Send a packet with the accumulated errors.
+ *
+ * @details
+ *   The values get added to the LPP packet following the *custom message convention*.
+ *
+ * @param[in] report
+ *   The struct which contains the accumulated errors.
+ *****************************************************************************/
+void sendErrorReport (ErrorReport_t report)
+{
+	/* Reserve space in the uplink - We need 19 + 4*records bytes, 51 bytes for 8 records (see `LPP_AddErrorReport` method documentation) */
+	if (!openRecord(PRIORITY_ERRORS, 19 + 4*report.amount, 59))
+	{
+		error(57);
+		return; /* Exit function */
+	}
+
+	/* Add values to the LPP packet using the custom convention */
+	if (!LPP_AddErrorReport(&recordData, report))
+	{
+		error(58);
+		return; /* Exit function */
+	}
+
+	closeRecord(false);
 }
 
 
@@ -322,8 +470,8 @@ void sendStatus (uint8_t status)
  *****************************************************************************/
 void sendTest (MeasurementData_t data)
 {
-	/* Initialize LPP-formatted payload - We need 21 bytes */
-	if (!LPP_InitBuffer(&appData, 21))
+	/* Reserve space in the uplink - We need 21 bytes */
+	if (!openRecord(PRIORITY_TEST, 21, 50))
 	{
 		error(43);
 		return; /* Exit function */
@@ -331,50 +479,280 @@ void sendTest (MeasurementData_t data)
 
 	/* Add measurements to the LPP packet */
 	int16_t batteryLPP = (int16_t)(round((float)data.voltage[0]/10));
-	if (!LPP_deprecated_AddVBAT(&appData, batteryLPP))
+	if (!LPP_deprecated_AddVBAT(&recordData, batteryLPP))
 	{
 		error(44);
 		return; /* Exit function */
 	}
 
 	int16_t intTempLPP = (int16_t)(round((float)data.intTemp[0]/100));
-	if (!LPP_deprecated_AddIntTemp(&appData, intTempLPP))
+	if (!LPP_deprecated_AddIntTemp(&recordData, intTempLPP))
 	{
 		error(45);
 		return; /* Exit function */
 	}
 
 	int16_t extTempLPP = (int16_t)(round((float)data.extTemp[0]/100));
-	if (!LPP_deprecated_AddExtTemp(&appData, extTempLPP))
+	if (!LPP_deprecated_AddExtTemp(&recordData, extTempLPP))
 	{
 		error(46);
 		return; /* Exit function */
 	}
 
-	if (!LPP_deprecated_AddStormDetected(&appData, true))
+	if (!LPP_deprecated_AddStormDetected(&recordData, true))
 	{
 		error(47);
 		return; /* Exit function */
 	}
 
-	if (!LPP_deprecated_AddCableBroken(&appData, true))
+	if (!LPP_deprecated_AddCableBroken(&recordData, true))
 	{
 		error(48);
 		return; /* Exit function */
 	}
 
-	if (!LPP_deprecated_AddStatus(&appData, 9))
+	if (!LPP_deprecated_AddStatus(&recordData, 9))
 	{
 		error(49);
 		return; /* Exit function */
 	}
 
-	/* Send LPP-formatted payload */
-	if (LoRa_SendLppBuffer(appData, LORA_UNCONFIMED) != SUCCESS)
+	closeRecord(false);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Cut the power of the RN2483.
+ *
+ * @details
+ *   The pins are parked while the rail still holds the GPIO clock, they get
+ *   reconfigured by `initLoRaWAN`.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void powerDownRN2483 (void)
+{
+	Leuart_Reset();
+	applyPinProfile(&rn2483PinsOff);
+	PM_Disable(PM_RN2483);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Reserve space for a message in the pending records.
+ *
+ * @details
+ *   The message gets added to `recordData` by the caller, after which it's
+ *   kept with `closeRecord`. If there isn't enough space left, the pending
+ *   records are sent first.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] priority
+ *   The `PRIORITY_xxx` value of the message.
+ *
+ * @param[in] size
+ *   The amount of bytes the message needs.
+ *
+ * @param[in] sendError
+ *   The error number to call if the uplink with this message can't be sent.
+ *
+ * @return
+ *   @li `true` - The message can be added to `recordData`.
+ *   @li `false` - The message is too large for one uplink.
+ *****************************************************************************/
+static bool openRecord (uint8_t priority, uint8_t size, uint8_t sendError)
+{
+	if (size > LPP_MAX_PAYLOAD) return (false);
+
+	/* Send the pending records first if there isn't enough space left */
+	if ((recordCount == UPLINK_RECORDS) || ((recordBytes + size) > UPLINK_STORAGE)) flushUplinks();
+
+	records[recordCount].priority = priority;
+	records[recordCount].sendError = sendError;
+	records[recordCount].offset = recordBytes;
+
+	recordData.buffer = &recordStorage[recordBytes];
+	recordData.length = size;
+	recordData.fill = 0;
+
+	return (true);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Keep the message added to `recordData` after `openRecord`.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] crash
+ *   `true` if the message contains the crash record.
+ *****************************************************************************/
+static void closeRecord (bool crash)
+{
+	records[recordCount].length = recordData.fill;
+	records[recordCount].crash = crash;
+	records[recordCount].packed = false;
+
+	recordBytes += recordData.fill;
+	recordCount++;
+
+	if (crash) crashQueued = true;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Pack the pending records into as few uplinks as possible and send them.
+ *
+ * @details
+ *   Each uplink is filled with the pending record with the lowest `PRIORITY_xxx`
+ *   value which still fits, until none fits anymore. The most important messages
+ *   end up in the first uplink, smaller ones fill up the remaining space. Records
+ *   are never split, the size of each uplink is the maximum payload for the data
+ *   rate (at most `LPP_MAX_PAYLOAD`). `LoRa_SendLppBuffer` waits on the duty cycle
+ *   between the uplinks if necessary.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void flushUplinks (void)
+{
+	uint8_t left = recordCount;
+
+	while (left > 0)
+	{
+		uint8_t length = LoRa_MaxPayload();
+		if (length > LPP_MAX_PAYLOAD) length = LPP_MAX_PAYLOAD;
+
+		if (!LPP_InitBuffer(&appData, length)) break;
+
+		uint8_t sendError = 0;
+		bool crash = false;
+
+		while (true)
+		{
+			/* Find the most important record which still fits */
+			int8_t best = -1;
+			for (uint8_t i = 0; i < recordCount; i++)
+			{
+				if (records[i].packed || (records[i].length > (appData.length - appData.fill))) continue;
+				if ((best < 0) || (records[i].priority < records[best].priority)) best = i;
+			}
+
+			if (best < 0) break;
+
+			memcpy(&appData.buffer[appData.fill], &recordStorage[records[best].offset], records[best].length);
+			appData.fill += records[best].length;
+
+			if (sendError == 0) sendError = records[best].sendError;
+			if (records[best].crash) crash = true;
+
+			records[best].packed = true;
+			left--;
+		}
+
+		if (appData.fill == 0) break; /* Can't happen, records are at most `LPP_MAX_PAYLOAD` bytes */
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+		dbinfoInt("Sending uplink of ", appData.fill, " bytes...");
+#endif /* DEBUG_DBPRINT */
+
+		/* Send custom LPP-like-formatted payload */
+		if (LoRa_SendLppBuffer(appData, LORA_UNCONFIMED) != SUCCESS) error(sendError);
+		else if (crash) FAULT_clearCrashRecord();
+
+		LPP_ClearBuffer(&appData); // Clear buffer before going to sleep
+	}
+
+	recordCount = 0;
+	recordBytes = 0;
+	crashQueued = false;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Apply a received configuration downlink (if any) and acknowledge it.
+ *
+ * @details
+ *   Downlinks on other ports are ignored. The acknowledgment is sent with
+ *   the next uplink.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *****************************************************************************/
+static void handleDownlink (void)
+{
+	LoRaDownlink_t downlink;
+
+	if (!LoRa_GetDownlink(&downlink) || (downlink.port != CONFIG_DOWNLINK_PORT)) return; /* Exit function */
+
+	uint8_t dataRate = CONFIG_get()->dataRate;
+	uint8_t txPower = CONFIG_get()->txPower;
+
+	uint8_t result = CONFIG_handleDownlink(downlink.port, downlink.data, downlink.length);
+
+	/* Apply a new data rate or output power right away, they're also used for the next join */
+	if (CONFIG_get()->dataRate != dataRate)
+	{
+		if (LoRa_SetDataRate((LoRaDataRate_t) CONFIG_get()->dataRate) != SUCCESS) error(61);
+	}
+
+	if (CONFIG_get()->txPower != txPower)
+	{
+		if (LoRa_SetPower(CONFIG_get()->txPower) != SUCCESS) error(67);
+	}
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbinfoInt("Configuration downlink handled, result: ", result, "");
+#endif /* DEBUG_DBPRINT */
+
+	sendConfigAck(result);
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Queue a packet to acknowledge a configuration downlink.
+ *
+ * @details
+ *   The value gets added to the LPP packet following the *custom message convention*.
+ *   It's packed with the next uplink instead of being sent on its own.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] result
+ *   The value returned by `CONFIG_handleDownlink`.
+ *****************************************************************************/
+static void sendConfigAck (uint8_t result)
+{
+	/* Reserve space in the uplink - We need 4 bytes */
+	if (!openRecord(PRIORITY_CONFIG_ACK, 4, 64))
+	{
+		error(62);
+		return; /* Exit function */
+	}
+
+	/* Add value to the LPP packet using the custom convention */
+	if (!LPP_AddConfigAck(&recordData, result))
 	{
-		error(50);
+		error(63);
 		return; /* Exit function */
 	}
 
-	LPP_FreeBuffer(&appData); // Clear buffer before going to sleep
+	closeRecord(false); /* Sent with the messages of the next wake-up, no uplink only for the acknowledgment */
 }
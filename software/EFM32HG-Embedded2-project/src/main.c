@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file main.c
  * @brief The main file for Project 2 from Embedded System Design 2 - Lab.
- * @version 5.2
+ * @version 5.16
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -44,6 +44,20 @@
  *   @li v5.0: Updated sleep logic when waking up using the accelerometer.
  *   @li v5.1: Added extra ISR handlers.
  *   @li v5.2: Removed `static` before a local variable (not necessary).
+ *   @li v5.3: Added wake-up handling for the interrupt-driven cable monitor.
+ *   @li v5.4: Added cable loop level measurement.
+ *   @li v5.5: Started handling all wake-up sources by draining the event ring in one pass.
+ *   @li v5.6: Started sending the accumulated errors along with the scheduled measurements.
+ *   @li v5.7: Moved the fault handlers to `fault.c` and started using the watchdog.
+ *   @li v5.8: Removed the manual RTC disabling, `sleep` stops its own timer.
+ *   @li v5.9: Measurements are scheduled on a fixed grid of absolute RTC deadlines.
+ *   @li v5.10: Updated the limits of `WAKE_UP_PERIOD_S`.
+ *   @li v5.11: Started calibrating the ULFRCO using the internal temperature measurement.
+ *   @li v5.12: Started using the power rails in `pm.c`, the temperature sensor warms up during the other measurements.
+ *   @li v5.13: Updated documentation (the RN2483 can stay joined between uplinks, see `LORA_PERSISTENT`).
+ *   @li v5.14: Moved the sampling settings to `config.c`, they can be changed with a downlink.
+ *   @li v5.15: Updated documentation (messages of one LoRaWAN session are merged into one uplink).
+ *   @li v5.16: Updated documentation (error numbers of the link manager).
  *
  * ******************************************************************************
  *
@@ -61,7 +75,6 @@
  *     - Sleep for some time in *while* loops instead of just incrementing the *escape-counter*.
  *         - First separate `ULFRCO` definition in `delay.c
  *     - Try to shorten delays (for example: 40 ms power-up time for the RN2483...)
- *     - Fix `sleepLoRaWAN` and `wakeLoRaWAN` functionality (also see `lora_wrappers.c`).
  *
  * ******************************************************************************
  *
@@ -101,10 +114,12 @@
  *   If in this project something unexpected occurs, an `error` method gets called.
  *   What happens in this method can be selected in `util.h` with the definition
  *   `ERROR_FORWARDING`. If it's value is `0` the MCU displays (if `dbprint` is enabled)
- *   a UART message and gets put in a `while(true)` to flash the LED. If it's value is
- *   `1` then certain values (all values except 30 - 55 since these are errors in the
- *   LoRaWAN functionality itself) get forwarded to the cloud using LoRaWAN functionality
- *   and the MCU resumes it's code.
+ *   a UART message, flashes the LED for a few seconds and resets itself (the number
+ *   is kept in a crash record, see `fault.c`). If it's value is
+ *   `1` then the values get accumulated (with a counter and first/last measurement
+ *   cycle for each value) and forwarded to the cloud along with the next scheduled
+ *   measurements, and the MCU resumes it's code. Only critical values (0 - 10) get
+ *   forwarded immediately, once until the next report has been sent.
  *
  *   When calling an `error` method, the following things were kept in mind:
  *     - **Values 0 - 9:** Reserved for reset and other critical functionality.
@@ -116,11 +131,17 @@
  *     - **10:** Problem in the case of the state machine (`main.c`)
  *     - **11 - 13:** `adc.c`
  *     - **14 - 17:** `delay.c`
- *     - **18 - 19:** `interrupt.c`
+ *     - **18:** `interrupt.c` (events dropped because the event ring was full)
  *     - **20 - 27:** `ADXL362.c`
  *     - **28 - 29:** `DS18B20.c`
  *     - **30 - 50:** `lora_wrappers.c`
  *     - **51 - 55:** `leuart.c`
+ *     - **56:** `cable.c`
+ *     - **57 - 59:** `lora_wrappers.c`
+ *     - **60:** `config.c`
+ *     - **61 - 64:** `lora_wrappers.c`
+ *     - **65 - 66:** `link.c`
+ *     - **67:** `lora_wrappers.c`
  *
  * ******************************************************************************
  *
@@ -132,6 +153,14 @@
  *   - `LPP_STORM_CHANNEL           0x13 // 19`
  *   - `LPP_CABLE_BROKEN_CHANNEL    0x14 // 20`
  *   - `LPP_STATUS_CHANNEL          0x15 // 21`
+ *   - `LPP_CABLE_LEVEL_CHANNEL     0x16 // 22`
+ *   - `LPP_ERROR_REPORT_CHANNEL    0x17 // 23`
+ *   - `LPP_CRASH_RECORD_CHANNEL    0x18 // 24`
+ *   - `LPP_CONFIG_ACK_CHANNEL      0x19 // 25`
+ *
+ *   Messages sent during the same LoRaWAN session are packed into as few uplinks as
+ *   possible (see `flushUplinks` in `lora_wrappers.c` and the `PRIORITY_xxx` definitions
+ *   in `lora_wrappers.h`), so a payload can contain several of these blocks after each other.
  *
  ******************************************************************************/
 
@@ -148,6 +177,7 @@
 #include "debug_dbprint.h" /* Enable or disable printing to UART for debugging */
 #include "delay.h"         /* Delay functionality */
 #include "util.h"          /* Utility functionality */
+#include "fault.h"         /* Watchdog and fault capture functionality */
 #include "interrupt.h"     /* GPIO wake-up initialization and interrupt handlers */
 #include "ADXL362.h"       /* Functions related to the accelerometer */
 #include "DS18B20.h"       /* Functions related to the temperature sensor */
@@ -155,26 +185,17 @@
 #include "cable.h"         /* Cable checking functionality */
 #include "lora_wrappers.h" /* LoRaWAN functionality */
 #include "datatypes.h"     /* Definitions of the custom data-types */
+#include "pm.h"            /* Power rails */
+#include "config.h"        /* Settings which can be changed with a downlink */
 
 
 /* Local definitions */
-/** Time between each wake-up in seconds
- *    @li max 500 seconds when using LFXO delay
- *    @li 3600 seconds (one hour) works fine when using ULFRCO delay */
-#define WAKE_UP_PERIOD_S   180 // On buoy: 1800 /* 600 = every 10 minutes */
-
-/** Amount of PIN interrupt wakeups (before a RTC wake-up) to be considered as a *storm* */
-#define STORM_INTERRUPTS   8
-
-/** The threshold value [g] for the accelerometer to detect and send an interrupt to wake-up the MCU */
-#define ADXL_THRESHOLD     7
+/* The wake-up period, storm detection, accelerometer threshold/ODR and amount of
+ * measurements per uplink can be changed with a downlink (defaults in `config.h`) */
 
 /** The *g* range to configure the accelerometer with */
 #define ADXL_RANGE         ADXL_RANGE_8G
 
-/** The ODR setting to configure the accelerometer with */
-#define ADXL_ODR           ADXL_ODR_12_5_HZ
-
 /** Public definition to select if the LED is turned on while measuring or sending data
  *    @li `1` - Enable the LED when while measuring or sending data.
  *    @li `0` - Don't enable the LED while measuring or sending data. */
@@ -189,47 +210,6 @@ static MCU_State_t MCUstate; /* Static so it's always kept in memory (@data segm
 MeasurementData_t data;
 
 
-/**************************************************************************//**
- * @brief
- *   Method to check if any interrupts are triggered by buttons.
- *
- * @return
- *   @li `true` - A button interrupt was triggered.
- *   @li `false` - No button interrupt was triggered.
- *****************************************************************************/
-bool checkBTNinterrupts (void)
-{
-	bool value = false;
-
-	if (BTN_getTriggered(0))
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbprintln_color("PB0 pushed!", 4);
-#endif /* DEBUG_DBPRINT */
-
-		value = true;
-
-		BTN_setTriggered(0, false); /* Clear variable */
-	}
-
-
-	if (BTN_getTriggered(1))
-	{
-
-#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbprintln_color("PB1 pushed!", 4);
-#endif /* DEBUG_DBPRINT */
-
-		value = true;
-
-		BTN_setTriggered(1, false); /* Clear variable */
-	}
-
-	return (value);
-}
-
-
 /**************************************************************************//**
  * @brief
  *   Main function.
@@ -242,14 +222,24 @@ int main (void)
 	/* Value used to send one test LoRaWAN message after booting */
 	bool firstBoot = true;
 
-	/* Value to keep the remaining sleep time when waking up using the accelerometer */
-	uint32_t remainingSleeptime = 0;
+	/* Value to keep the RTC deadline of the next scheduled measurement (also after an early wake-up) */
+	uint32_t nextMeasurement = 0;
+
+	/* Values to keep the wake-up sources gathered from the event ring */
+	Event_t event;
+	bool buttonWakeup;
+	bool rtcWakeup;
+	bool cableWakeup;
 
 	/* Set the index to put the measurements in */
 	data.index = 0;
 
 	while (1)
 	{
+		feedWatchdog(); /* Feed the watchdog on every pass through the state machine */
+
+		FAULT_setState(MCUstate); /* Remember the state in case something goes wrong */
+
 		switch (MCUstate)
 		{
 			case INIT:
@@ -266,6 +256,10 @@ int main (void)
 #endif /* Board pinout selection */
 #endif  /* DEBUG_DBPRINT */
 
+				initWatchdog(); /* Start the watchdog and check if we recovered from a crash */
+
+				initConfig(); /* Load the settings (changed by an earlier downlink or the defaults) */
+
 				led(true); /* Enable (and initialize) LED */
 
 				delay(4000); /* 4 second delay to notice initialization */
@@ -275,13 +269,12 @@ int main (void)
 
 				initGPIOwakeup(); /* Initialize GPIO wake-up */
 
-				initADC(BATTERY_VOLTAGE); /* Initialize ADC to read battery voltage */
+				initCableMonitor(); /* Initialize the interrupt-driven cable monitor (if selected) */
 
-				/* Initialize pin and disable power to RN2483 */
-				GPIO_PinModeSet(PM_RN2483_PORT, PM_RN2483_PIN, gpioModePushPull, 0);
+				initADC(BATTERY_VOLTAGE); /* Initialize ADC to read battery voltage */
 
-				/* Initialize pin and disable external sensor power on DRAMCO shield */
-				GPIO_PinModeSet(PM_SENS_EXT_PORT, PM_SENS_EXT_PIN, gpioModePushPull, 0); // TODO: check power usage effect?
+				/* Initialize the pins and disable the power rails (RN2483, external sensor power on DRAMCO shield, ...) */
+				PM_Init(); // TODO: check power usage effect of PM_SENS_EXT?
 
 				/* Initialize accelerometer */
 				if (true)
@@ -300,11 +293,11 @@ int main (void)
 
 					ADXL_configRange(ADXL_RANGE); /* Set the measurement range */
 
-					ADXL_configODR(ADXL_ODR); /* Configure ODR */
+					ADXL_configODR((ADXL_ODR_t) CONFIG_get()->adxlODR); /* Configure ODR */
 
 					if (false) ADXL_readValues(); /* Read and display values forever */
 
-					ADXL_configActivity(ADXL_THRESHOLD); /* Configure (referenced) activity threshold mode on INT1 [g] */
+					ADXL_configActivity(CONFIG_get()->adxlThreshold); /* Configure (referenced) activity threshold mode on INT1 [g] */
 
 					ADXL_enableMeasure(true); /* Enable measurements */
 
@@ -323,6 +316,8 @@ int main (void)
 
 				led(false); /* Disable LED */
 
+				nextMeasurement = RTC_getTicks(); /* Start of the measurement grid */
+
 				MCUstate = MEASURE;
 			} break;
 
@@ -333,8 +328,12 @@ int main (void)
 				led(true); /* Enable LED */
 #endif /* LED_ENABLED */
 
-				/* Measure and store the external temperature */
-				data.extTemp[data.index] = readTempDS18B20();
+#if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
+				ERROR_nextCycle(); /* Start a new cycle for the timestamps of the accumulated errors */
+#endif /* ERROR_FORWARDING */
+
+				/* Power the temperature sensor already, it warms up while the ADC measurements are taken */
+				PM_Enable(PM_DS18B20);
 
 				/* Measure and store the battery voltage */
 				data.voltage[data.index] = readADC(BATTERY_VOLTAGE);
@@ -342,6 +341,17 @@ int main (void)
 				/* Measure and store the internal temperature */
 				data.intTemp[data.index] = readADC(INTERNAL_TEMPERATURE);
 
+#if ULFRCO == 1 /* ULFRCO selected */
+				RTC_calibrate(data.intTemp[data.index]); /* Correct the ULFRCO frequency for the current temperature */
+#endif /* ULFRCO selected */
+
+				/* Measure and store the cable loop level */
+				data.cableLevel[data.index] = readCableLevel();
+
+				/* Measure and store the external temperature */
+				data.extTemp[data.index] = readTempDS18B20();
+				PM_Disable(PM_DS18B20);
+
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
 				dbinfoInt("Measurement ", data.index + 1, "");
 				dbinfoInt("Temperature: ", data.extTemp[data.index], "");
@@ -368,6 +378,10 @@ int main (void)
 
 					sendMeasurements(data); /* Send the measurements */
 
+#if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
+					ERROR_sendReport(); /* Send the accumulated errors (if any) */
+#endif /* ERROR_FORWARDING */
+
 					disableLoRaWAN(); /* Disable RN2483 */
 
 					data.index = 0; /* Reset the index to put the measurements in (needs to be here for the correct data to be affected) */
@@ -379,8 +393,8 @@ int main (void)
 				led(false); /* Disable LED */
 #endif /* LED_ENABLED */
 
-				/* Decide if 6 measurements are taken or not and react accordingly */
-				if (data.index == 6) MCUstate = SEND;
+				/* Decide if enough measurements are taken or not and react accordingly (">=": the amount can be lowered with a downlink) */
+				if (data.index >= CONFIG_get()->measurements) MCUstate = SEND;
 				else MCUstate = SLEEP;
 			} break;
 
@@ -399,6 +413,10 @@ int main (void)
 
 				sendMeasurements(data); /* Send the measurements */
 
+#if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
+				ERROR_sendReport(); /* Send the accumulated errors (if any) */
+#endif /* ERROR_FORWARDING */
+
 				disableLoRaWAN(); /* Disable RN2483 */
 
 				data.index = 0; /* Reset the index to put the measurements in (needs to be here for the correct data to be affected) */
@@ -445,14 +463,17 @@ int main (void)
 
 			case SLEEP:
 			{
-				sleep(WAKE_UP_PERIOD_S); /* Go to sleep for xx seconds */
+				/* Go to the next measurement slot which is still in the future (measurements on other wake-ups don't shift the grid) */
+				while ((int32_t)(nextMeasurement - RTC_getTicks()) <= 0) nextMeasurement += RTC_secondsToTicks(CONFIG_get()->wakeUpPeriod);
+
+				sleepUntil(nextMeasurement); /* Go to sleep until the next slot */
 
 				MCUstate = WAKEUP;
 			} break;
 
 			case SLEEP_HALFTIME:
 			{
-				sleep(WAKE_UP_PERIOD_S/2); /* Go to sleep for xx seconds */
+				sleep(CONFIG_get()->wakeUpPeriod/2); /* Go to sleep for xx seconds */
 
 				MCUstate = WAKEUP;
 			} break;
@@ -464,34 +485,104 @@ int main (void)
 				led(true); /* Enable LED */
 #endif /* LED_ENABLED */
 
+				buttonWakeup = false;
+				rtcWakeup = false;
+				cableWakeup = false;
+
+				/* Handle all of the events gathered by the interrupt handlers in one pass */
+				while (EVENT_get(&event))
+				{
+					switch (event.source)
+					{
+						case EVENT_PB0:
+						case EVENT_PB1:
+						{
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+							if (event.source == EVENT_PB0) dbprintln_color("PB0 pushed!", 4);
+							else dbprintln_color("PB1 pushed!", 4);
+							dbinfoInt("Event handled, RTC tick on interrupt: ", event.tick, "");
+#endif /* DEBUG_DBPRINT */
+
+							buttonWakeup = true;
+						} break;
+
+						case EVENT_RTC:
+						{
+							rtcWakeup = true;
+						} break;
+
+						case EVENT_ADXL:
+						{
+							ADXL_setTriggered(true); /* Also increments the trigger counter */
+						} break;
+
+						case EVENT_CABLE:
+						{
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+							dbprintln_color("Cable monitor triggered!", 4);
+							dbinfoInt("Event handled, RTC tick on interrupt: ", event.tick, "");
+#endif /* DEBUG_DBPRINT */
+
+							cableWakeup = true;
+						} break;
+
+						case EVENT_ADC:
+						{
+							/* Conversions are already handled by `readADC`, nothing to do here */
+						} break;
+
+						default:
+						{
+							error(10);
+						} break;
+					}
+				}
+
 				/* Check if we woke up using buttons */
-				if (checkBTNinterrupts())
+				if (buttonWakeup)
 				{
 					ADXL_clearCounter(); /* Clear the trigger counter */
-					remainingSleeptime = 0; /* Reset passed sleeping time */
 
 					MCUstate = MEASURE; /* Take measurements on "case WAKEUP" exit */
 				}
 
 				/* Check if we woke up using the RTC sleep functionality and act accordingly */
-				if (RTC_checkWakeup())
+				if (rtcWakeup)
 				{
-					RTC_clearWakeup(); /* Clear variable */
-
 					ADXL_clearCounter(); /* Clear the trigger counter because we woke up "normally" */
-					remainingSleeptime = 0; /* Reset passed sleeping time since it's an RTC wakeup */
 
 					MCUstate = MEASURE; /* Take measurements on "case WAKEUP" exit */
 				}
 
+				/* Check if we woke up using the cable monitor */
+				if (cableWakeup)
+				{
+					if (CABLE_confirmBreak())
+					{
+						ADXL_clearCounter(); /* Clear the trigger counter */
+
+						MCUstate = MEASURE; /* Take measurements and send the alarm on "case WAKEUP" exit */
+					}
+					else if ((MCUstate == WAKEUP) && !ADXL_getTriggered())
+					{
+
+#if LED_ENABLED == 1 /* LED_ENABLED */
+						led(false); /* Disable LED */
+#endif /* LED_ENABLED */
+
+						/* Glitch on the cable monitor, go back to sleep until the same deadline */
+						sleepUntil(nextMeasurement);
+					}
+				}
+
 				/* Check if we woke up using the accelerometer */
 				if (ADXL_getTriggered())
 				{
 					/* Check if we detected a storm */
-					if (ADXL_getCounter() > STORM_INTERRUPTS)
+					if (ADXL_getCounter() > CONFIG_get()->stormInterrupts)
 					{
-						RTC_Enable(false); /* Disable the counter */
-
 						MCUstate = SEND_STORM; /* Storm detected, send a message on "case WAKEUP" exit */
 					}
 					else
@@ -505,22 +596,21 @@ int main (void)
 						ADXL_ackInterrupt();   /* Acknowledge ADXL interrupt by reading the status register */
 						ADXL_enableSPI(false); /* Disable SPI functionality */
 
-						/* Check if a storm was detected before going to sleep for WAKE_UP_PERIOD_S/2 */
+						/* Check if a storm was detected before going to sleep for half of the wake-up period */
 						if (stormDetected)
 						{
 							stormDetected = false; /* Reset variable */
 							MCUstate = MEASURE; /* Take measurements on "case WAKEUP" exit */
 						}
-						else
+						else if (MCUstate == WAKEUP) /* Don't go back to sleep if another wake-up source already asked for measurements */
 						{
-							remainingSleeptime += RTC_getPassedSleeptime(); /* Add the time spend sleeping to the variable */
 
 #if LED_ENABLED == 1 /* LED_ENABLED */
 							led(false); /* Disable LED */
 #endif /* LED_ENABLED */
 
-							/* Go back to sleep for the remaining time until another measurement (we only take measurements on RTC/button wake-up) */
-							sleep(WAKE_UP_PERIOD_S - remainingSleeptime);
+							/* Go back to sleep until the same deadline (we only take measurements on RTC/button wake-up) */
+							sleepUntil(nextMeasurement);
 
 							MCUstate = WAKEUP; /* Go back to this case if we wake-up */
 						}
@@ -540,56 +630,3 @@ int main (void)
 		}
 	}
 }
-
-
-/**************************************************************************//**
- * @brief
- *   NMI interrupt service routine.
- *
- * @note
- *   The *weak* definition for this method is located in `startup_gcc_efm32hg.h`.
- *****************************************************************************/
-void NMI_Handler(void)
-{
-	while(1);
-}
-
-
-/**************************************************************************//**
- * @brief
- *   HardFault interrupt service routine.
- *
- * @note
- *   The *weak* definition for this method is located in `startup_gcc_efm32hg.h`.
- *****************************************************************************/
-void HardFault_Handler(void)
-{
-	while(1);
-}
-
-
-/**************************************************************************//**
- * @brief
- *   SVC interrupt service routine.
- *
- * @note
- *   The *weak* definition for this method is located in `startup_gcc_efm32hg.h`.
- *****************************************************************************/
-void SVC_Handler(void)
-{
-	while(1);
-}
-
-
-/**************************************************************************//**
- * @brief
- *   PendSV interrupt service routine.
- *
- * @note
- *   The *weak* definition for this method is located in `startup_gcc_efm32hg.h`.
- *****************************************************************************/
-void PendSV_Handler(void)
-{
-	while(1);
-}
-
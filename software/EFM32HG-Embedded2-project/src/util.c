@@ -1,7 +1,7 @@
 /***************************************************************************//**
  * @file util.c
  * @brief Utility functionality.
- * @version 3.1
+ * @version 3.5
  * @author Brecht Van Eeckhoudt
  *
  * ******************************************************************************
@@ -25,16 +25,17 @@
  *   @li v2.8: Added the ability to enable/disable error forwarding to the cloud using a public definition and changed UART error color.
  *   @li v3.0: Updated version number.
  *   @li v3.1: Removed `static` before the local variables (not necessary).
+ *   @li v3.2: Started accumulating forwarded errors and sending them together with the
+ *             scheduled measurements, only critical errors still get an immediate uplink.
+ *   @li v3.3: Reset the MCU (with a crash record) after flashing the LED for a while instead of
+ *             staying in a `while(true)` loop when error forwarding is disabled.
+ *   @li v3.4: Started requesting the GPIO clock in `pm.c`.
+ *   @li v3.5: Added `applyPinProfile` and the `PIN_PROFILE` macros to switch groups of pins with precomputed masks.
  *
  * ******************************************************************************
  *
  * @todo
  *   **Future improvements:**@n
- *     - Only send a maximum amount of errors to the could using LoRaWAN according to a defined value.
- *         - Reset the counter in the MEASURE/SEND state?
- *     - Go back to INIT state on an error call?
- *         - `GOTO` is supported in C but is dangerous to use (nested loops, ...)
- *         - Check if the clock functionality doesn't break when this is implemented ...
  *
  * ******************************************************************************
  *
@@ -69,24 +70,62 @@
 #include <stdbool.h>       /* "bool", "true", "false" */
 #include "em_cmu.h"        /* Clock Management Unit */
 #include "em_gpio.h"       /* General Purpose IO */
+#include "em_core.h"       /* Core interrupt handling */
 
 #include "util.h"          /* Corresponding header file */
 #include "pin_mapping.h"   /* PORT and PIN definitions */
 #include "debug_dbprint.h" /* Enable or disable printing to UART */
 #include "delay.h"         /* Delay functionality */
+#include "fault.h"         /* Fault capture functionality */
+#include "pm.h"            /* Shared clocks */
 
 #if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
 #include "lora_wrappers.h" /* LoRaWAN functionality */
 #endif /* ERROR_FORWARDING */
 
 
+#if ERROR_FORWARDING == 0 /* ERROR_FORWARDING */
+/* Local definition */
+/** Amount of LED toggles (100 ms each) before resetting the MCU */
+#define ERROR_FLASHES     50
+
+#else /* ERROR_FORWARDING */
+
+/* Local definitions */
+/** Amount of different error numbers to keep a counter and timestamps for (others only end up in the bitmap) */
+#define ERROR_RECORDS     8
+
+/** Error numbers below this value are critical and get an immediate uplink (0 - 9: reserved, 10: state machine) */
+#define ERROR_CRITICAL    11
+
+/** Amount of immediate uplinks for critical errors allowed between two sent error reports */
+#define ERROR_ESCALATIONS 1
+#endif /* ERROR_FORWARDING */
+
+
 /* Local variables */
 uint8_t errorNumber = 0;
 bool LED_initialized = false;
 
+#if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
+uint8_t errorBitmap[16];              /* Bit `n` set = `error(n)` was called since the last report */
+uint8_t errorRecordsUsed = 0;         /* Amount of used places in the arrays below */
+uint8_t errorNumbers[ERROR_RECORDS];  /* Error number of each record */
+uint8_t errorCounts[ERROR_RECORDS];   /* Amount of calls for each record (saturates at 255) */
+uint16_t errorFirst[ERROR_RECORDS];   /* Measurement cycle of the first call for each record */
+uint16_t errorLast[ERROR_RECORDS];    /* Measurement cycle of the last call for each record */
+uint16_t errorCycle = 0;              /* Current measurement cycle */
+uint8_t escalationsLeft = ERROR_ESCALATIONS;
+bool escalating = false;              /* Keep errors thrown while escalating from escalating again */
+#endif /* ERROR_FORWARDING */
 
-/* Local prototype */
+
+/* Local prototypes */
 static void initLED (void);
+#if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
+static void recordError (uint8_t number);
+static uint8_t cyclesAgo (uint16_t cycle);
+#endif /* ERROR_FORWARDING */
 
 
 /**************************************************************************//**
@@ -117,13 +156,18 @@ void led (bool enabled)
  *
  * @details
  *   **ERROR_FORWARDING == 0**@n
- *   The method flashes the LED, displays a UART message and holds the MCU
- *   forever in a loop until it gets reset. The error value gets stored in
- *   a global variable.
+ *   The method displays a UART message and flashes the LED for `ERROR_FLASHES`
+ *   times before saving a crash record with the number (see `fault.c`) and
+ *   resetting the MCU. The error value also gets stored in a global variable.
  *
  *   **ERROR_FORWARDING == 1**@n
- *   The method sends the error value to the cloud using LoRaWAN if the error
- *   number doesn't correspond to LoRaWAN-related functionality (numbers 30 - 55).
+ *   The method adds the error value to the accumulated errors which get sent
+ *   along with the next scheduled measurements (see `ERROR_sendReport`), so
+ *   a repeating error doesn't cost an extra join and uplink each time. Only
+ *   critical errors (numbers below `ERROR_CRITICAL`) get sent immediately,
+ *   and this only `ERROR_ESCALATIONS` times until a report has been sent.
+ *   Errors in LoRaWAN functionality (numbers 30 - 55) are also accumulated
+ *   now, they are reported after the next successful join.
  *
  * @param[in] number
  *   The number to indicate where in the code the error was thrown.
@@ -141,39 +185,48 @@ void error (uint8_t number)
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
 	dbprint_color(">>> Error (", 5);
 	dbprintInt(number);
-	dbprintln_color(")! Please reset MCU. <<<", 5);
+	dbprintln_color(")! Resetting MCU. <<<", 5);
 #endif /* DEBUG_DBPRINT */
 
-	while (1)
+	for (uint8_t i = 0; i < ERROR_FLASHES; i++)
 	{
 		delay(100);
 		GPIO_PinOutToggle(LED_PORT, LED_PIN); /* Toggle LED */
 	}
 
+	FAULT_reset(number); /* Save a crash record and reset the MCU */
+
 #else /* ERROR_FORWARDING */
 
-	/* Check if the error number isn't called in LoRaWAN functionality */
-	if ((number < 30) || (number > 55))
+	recordError(number);
+
+	/* Check if the error is critical and if we're still allowed to send it right away */
+	if ((number < ERROR_CRITICAL) && (escalationsLeft > 0) && !escalating)
 	{
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbprint_color(">>> Error (", 5);
+		dbprint_color(">>> Critical error (", 5);
 		dbprintInt(number);
 		dbprintln_color(")! Sending the message to the cloud. <<<", 5);
 #endif /* DEBUG_DBPRINT */
 
+		escalationsLeft--;
+		escalating = true;
+
 		initLoRaWAN(); /* Initialize LoRaWAN functionality */
 
 		sendStatus(number); /* Send the status value */
 
 		disableLoRaWAN(); /* Disable RN2483 */
+
+		escalating = false;
 	}
 	else
 	{
 
 #if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
-		dbprint_color(">>> Error in LoRaWAN functionality (", 5);
+		dbprint_color(">>> Error (", 5);
 		dbprintInt(number);
-		dbprintln_color(")! <<<", 5);
+		dbprintln_color(")! Sending it with the next measurements. <<<", 5);
 #endif /* DEBUG_DBPRINT */
 
 	}
@@ -183,6 +236,109 @@ void error (uint8_t number)
 }
 
 
+/**************************************************************************//**
+ * @brief
+ *   Put a group of pins in the state described by a (precomputed) profile.
+ *
+ * @details
+ *   Ports without pins in the profile are skipped. For the others the `DOUT`
+ *   register is written first so an output doesn't glitch when its mode
+ *   changes, then the `MODEL` and `MODEH` registers. Every register gets at
+ *   most one masked write, while `GPIO_PinModeSet` does a read-modify-write
+ *   of the mode *and* the output register for every pin.
+ *
+ * @note
+ *   The GPIO clock should be enabled (this is the case if a power rail is
+ *   enabled or `PM_ClockRequest(PM_CLOCK_GPIO)` has been called).
+ *
+ * @param[in] profile
+ *   The profile, made with `PIN_PROFILE`.
+ *****************************************************************************/
+void applyPinProfile (const PinProfile_t *profile)
+{
+	for (uint8_t i = 0; i < PIN_PROFILE_PORTS; i++)
+	{
+		const PinPortProfile_t *port = &profile->port[i];
+
+		if ((port->modelMask | port->modehMask | port->doutMask) == 0) continue;
+
+		/* Interrupt handlers can also change pins (LED, NCS, ...) */
+		CORE_DECLARE_IRQ_STATE;
+		CORE_ENTER_ATOMIC();
+
+		if (port->doutMask) GPIO->P[i].DOUT = (GPIO->P[i].DOUT & ~port->doutMask) | port->dout;
+		if (port->modelMask) GPIO->P[i].MODEL = (GPIO->P[i].MODEL & ~port->modelMask) | port->model;
+		if (port->modehMask) GPIO->P[i].MODEH = (GPIO->P[i].MODEH & ~port->modehMask) | port->modeh;
+
+		CORE_EXIT_ATOMIC();
+	}
+}
+
+
+#if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
+/**************************************************************************//**
+ * @brief
+ *   Start a new measurement cycle for the timestamps of the accumulated errors.
+ *
+ * @details
+ *   This method should be called once at the start of every measurement.
+ *****************************************************************************/
+void ERROR_nextCycle (void)
+{
+	errorCycle++;
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Send the accumulated errors (if any) to the cloud using LoRaWAN.
+ *
+ * @details
+ *   The errors are copied and cleared *before* sending them so errors thrown
+ *   while sending end up in the next report. Sending a report also allows
+ *   the next critical errors to be sent immediately again.
+ *
+ * @note
+ *   Only call this method while LoRaWAN functionality is initialized, for
+ *   example right after sending the scheduled measurements.
+ *****************************************************************************/
+void ERROR_sendReport (void)
+{
+	ErrorReport_t report;
+	bool pending = false;
+
+	/* Check if any error was called since the last report */
+	for (uint8_t i = 0; i < 16; i++)
+	{
+		report.bitmap[i] = errorBitmap[i];
+		if (errorBitmap[i] != 0) pending = true;
+		errorBitmap[i] = 0;
+	}
+
+	if (!pending) return; /* Exit function */
+
+	report.amount = errorRecordsUsed;
+
+	for (uint8_t i = 0; i < errorRecordsUsed; i++)
+	{
+		report.records[i].number = errorNumbers[i];
+		report.records[i].count = errorCounts[i];
+		report.records[i].first = cyclesAgo(errorFirst[i]);
+		report.records[i].last = cyclesAgo(errorLast[i]);
+	}
+
+	errorRecordsUsed = 0;
+	escalationsLeft = ERROR_ESCALATIONS;
+
+#if DEBUG_DBPRINT == 1 /* DEBUG_DBPRINT */
+	dbinfoInt("Sending error report with ", report.amount, " record(s)...");
+#endif /* DEBUG_DBPRINT */
+
+	sendErrorReport(report);
+}
+#endif /* ERROR_FORWARDING */
+
+
 /**************************************************************************//**
  * @brief
  *   Initialize the LED.
@@ -193,9 +349,8 @@ void error (uint8_t number)
  *****************************************************************************/
 static void initLED (void)
 {
-	/* Enable necessary clocks (just in case) */
-	CMU_ClockEnable(cmuClock_HFPER, true); /* GPIO is a High Frequency Peripheral */
-	CMU_ClockEnable(cmuClock_GPIO, true);
+	/* The GPIO clock stays requested, the LED is used until the end */
+	PM_ClockRequest(PM_CLOCK_GPIO);
 
 	/* In the case of gpioModePushPull, the last argument directly sets the pin state */
 	GPIO_PinModeSet(LED_PORT, LED_PIN, gpioModePushPull, 0);
@@ -206,3 +361,70 @@ static void initLED (void)
 
 	LED_initialized = true;
 }
+
+
+#if ERROR_FORWARDING == 1 /* ERROR_FORWARDING */
+/**************************************************************************//**
+ * @brief
+ *   Add an error number to the accumulated errors.
+ *
+ * @details
+ *   The number is always marked in the bitmap. If it's the first call for
+ *   this number and all records are already in use, it's not counted.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] number
+ *   The error number to add.
+ *****************************************************************************/
+static void recordError (uint8_t number)
+{
+	if (number < 128) errorBitmap[number >> 3] |= (1 << (number & 0x7));
+
+	/* Check if the number already has a record */
+	for (uint8_t i = 0; i < errorRecordsUsed; i++)
+	{
+		if (errorNumbers[i] == number)
+		{
+			if (errorCounts[i] < 255) errorCounts[i]++;
+			errorLast[i] = errorCycle;
+			return; /* Exit function */
+		}
+	}
+
+	/* Add a new record if there's still place */
+	if (errorRecordsUsed < ERROR_RECORDS)
+	{
+		errorNumbers[errorRecordsUsed] = number;
+		errorCounts[errorRecordsUsed] = 1;
+		errorFirst[errorRecordsUsed] = errorCycle;
+		errorLast[errorRecordsUsed] = errorCycle;
+		errorRecordsUsed++;
+	}
+}
+
+
+/**************************************************************************//**
+ * @brief
+ *   Convert a measurement cycle to the amount of cycles ago.
+ *
+ * @note
+ *   This is a static method because it's only internally used in this file
+ *   and called by other methods if necessary.
+ *
+ * @param[in] cycle
+ *   The measurement cycle to convert.
+ *
+ * @return
+ *   The amount of cycles ago (saturates at 255).
+ *****************************************************************************/
+static uint8_t cyclesAgo (uint16_t cycle)
+{
+	uint16_t ago = errorCycle - cycle; /* Also correct when `errorCycle` overflowed */
+
+	if (ago > 255) return (255);
+	else return (ago);
+}
+#endif /* ERROR_FORWARDING */
@@ -8,8 +8,15 @@
  * software documentation in "/lora/lpp.c" for the following methods:
  *  - LPP_AddMeasurements
  *  - LPP_AddStormDetected
- *  - LPP_AddCableBroken
+ *  - LPP_AddCableBroken (1 = broken, 2 = degrading)
  *  - LPP_AddStatus
+ *  - LPP_AddErrorReport
+ *  - LPP_AddCrashRecord (always sent after a status value)
+ *  - LPP_AddConfigAck (0 = OK, 255 = malformed, otherwise the rejected command)
+ *
+ * One uplink can contain several of these messages, each one starts with its own
+ * "amount" byte (always below 0x10) followed by its channel(s). The channels are
+ * 0x10 - 0x19, decoding stops at an unknown byte since its length isn't known.
  * 
  * Information gathered from:
  *  - https://dramco.be/tutorials/low-power-iot/ieee-sensors-2017/store-sensor-data-in-the-cloud
@@ -30,13 +37,24 @@ function Decoder (bytes, port) {
 	decoded.StormDetected = [];
 	decoded.CableBroken = [];
 	decoded.Status = [];
-
-	var count = 0; 
-	var NR_of_Meas = bytes[0];
+	decoded.CableLevel = [];
+	decoded.ErrorBitmap = [];
+	decoded.Errors = [];
+	decoded.Crash = {};
+	decoded.ConfigAck = [];
+
+	var count = 0;
+	var NR_of_Meas = 0;
 	var type;
-	count++;
- 
+
 	while (count < bytes.length) {
+		// Start of a new message: the amount of measurements (records) in it
+		if (bytes[count] < 0x10) {
+			NR_of_Meas = bytes[count];
+			count++;
+			continue;
+		}
+
 		switch (bytes[count]) {
 
 			// 0x10 = Battery voltage channel 
@@ -45,7 +63,7 @@ function Decoder (bytes, port) {
 				if (bytes[count] === 0x02) { // 0x02 = Analog Input (Cayenne LPP datatype)
 					count++;
 					type = 0x02;
-					decoded.BatteryVoltage = bytesToArray2(bytes, NR_of_Meas, count, type);
+					decoded.BatteryVoltage = decoded.BatteryVoltage.concat(bytesToArray2(bytes, NR_of_Meas, count, type));
 					count += NR_of_Meas*2;
 				}
 				break;
@@ -56,7 +74,7 @@ function Decoder (bytes, port) {
 				if (bytes[count] === 0x67) { // 0x67 = Temperature (0.1 °C Signed MSB - Cayenne LPP datatype)
 					count++;
 					type = 0x67;
-					decoded.InternalTemperature = bytesToArray2(bytes, NR_of_Meas, count, type);
+					decoded.InternalTemperature = decoded.InternalTemperature.concat(bytesToArray2(bytes, NR_of_Meas, count, type));
 					count += NR_of_Meas*2 ;
 				}
 				break;
@@ -67,7 +85,7 @@ function Decoder (bytes, port) {
 				if (bytes[count] === 0x67) { // 0x67 = Temperature (0.1 °C Signed MSB - Cayenne LPP datatype)
 					count++;
 					type = 0x67;
-					decoded.ExternalTemperature = bytesToArray2(bytes, NR_of_Meas, count, type);
+					decoded.ExternalTemperature = decoded.ExternalTemperature.concat(bytesToArray2(bytes, NR_of_Meas, count, type));
 					count += NR_of_Meas*2;
 				}
 				break;
@@ -77,7 +95,7 @@ function Decoder (bytes, port) {
 				count++;
 				if (bytes[count] === 0x00) { // 0x00 = Digital input (Cayenne LPP datatype)
 					count++;
-					decoded.StormDetected = bytesToArray1(bytes, NR_of_Meas, count);
+					decoded.StormDetected = decoded.StormDetected.concat(bytesToArray1(bytes, NR_of_Meas, count));
 					count += NR_of_Meas;
 				}
 				break;
@@ -87,7 +105,7 @@ function Decoder (bytes, port) {
 				count++;
 				if (bytes[count] === 0x00) { // 0x00 = Digital input (Cayenne LPP datatype)
 					count++;
-					decoded.CableBroken = bytesToArray1(bytes, NR_of_Meas, count);
+					decoded.CableBroken = decoded.CableBroken.concat(bytesToArray1(bytes, NR_of_Meas, count));
 					count += NR_of_Meas;
 				}
 				break;
@@ -97,10 +115,69 @@ function Decoder (bytes, port) {
 				count++;
 				if (bytes[count] === 0x00) { // 0x00 = Digital input (Cayenne LPP datatype)
 					count++;
-					decoded.Status = bytesToArray1(bytes, NR_of_Meas, count);
+					decoded.Status = decoded.Status.concat(bytesToArray1(bytes, NR_of_Meas, count));
 					count += NR_of_Meas;
 				}
 				break;
+
+			// 0x16 = Cable level channel (0 = short, 63 = open)
+			case 0x16:
+				count++;
+				if (bytes[count] === 0x00) { // 0x00 = Digital input (Cayenne LPP datatype)
+					count++;
+					decoded.CableLevel = decoded.CableLevel.concat(bytesToArray1(bytes, NR_of_Meas, count));
+					count += NR_of_Meas;
+				}
+				break;
+
+			// 0x17 = Error report channel (16 byte bitmap + 4 bytes per record)
+			case 0x17:
+				count++;
+				if (bytes[count] === 0x00) { // 0x00 = Digital input (Cayenne LPP datatype)
+					count++;
+					decoded.ErrorBitmap = bytes.slice(count, count + 16);
+					count += 16;
+					for (var i = 0; i < NR_of_Meas; i++) {
+						decoded.Errors.push({
+							Number: bytes[count],
+							Count: bytes[count+1],
+							FirstCyclesAgo: bytes[count+2],
+							LastCyclesAgo: bytes[count+3]
+						});
+						count += 4;
+					}
+				}
+				break;
+
+			// 0x18 = Crash record channel (always 15 bytes of data)
+			case 0x18:
+				count++;
+				if (bytes[count] === 0x00) { // 0x00 = Digital input (Cayenne LPP datatype)
+					count++;
+					decoded.Crash.Type = bytes[count];
+					decoded.Crash.State = bytes[count+1];
+					decoded.Crash.Number = bytes[count+2];
+					decoded.Crash.PC = bytesToUint32(bytes, count+3);
+					decoded.Crash.LR = bytesToUint32(bytes, count+7);
+					decoded.Crash.xPSR = bytesToUint32(bytes, count+11);
+					count += 15;
+				}
+				break;
+
+			// 0x19 = Configuration acknowledgment channel
+			case 0x19:
+				count++;
+				if (bytes[count] === 0x00) { // 0x00 = Digital input (Cayenne LPP datatype)
+					count++;
+					decoded.ConfigAck.push(bytes[count]);
+					count++;
+				}
+				break;
+
+			// Unknown channel, the length of its data isn't known
+			default:
+				count = bytes.length;
+				break;
 		}
 	}
 
@@ -157,3 +234,13 @@ function bytesToArray1(bytes, NR_of_Meas, count) {
 	console.log(readings);
 	return readings;
 }
+
+
+/**
+ * Function to convert 4 bytes (MSB first) to an unsigned value.
+ * @param {*} bytes The "raw" bytes to convert.
+ * @param {*} count Index of the first byte.
+ */
+function bytesToUint32(bytes, count) {
+	return ((bytes[count] << 24) | (bytes[count+1] << 16) | (bytes[count+2] << 8) | bytes[count+3]) >>> 0;
+}
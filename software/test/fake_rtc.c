@@ -0,0 +1,213 @@
+/***************************************************************************//**
+ * @file fake_rtc.c
+ * @brief Fake RTC, interrupt mask and sleep modes for the host tests.
+ *
+ * @details
+ *   The 24-bit counter is the lower part of a 64-bit tick count. Time only
+ *   passes in `FAKE_run` and while sleeping, it jumps from one overflow or
+ *   compare match to the next one so long waits stay fast. Like on the MCU,
+ *   an enabled and pending interrupt calls `RTC_IRQHandler` as soon as the
+ *   interrupts aren't masked by an atomic section.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#include <stdio.h>    /* fprintf */
+#include <stdlib.h>   /* exit */
+
+#include "em_device.h"
+#include "em_cmu.h"
+#include "em_core.h"
+#include "em_emu.h"
+#include "em_rtc.h"
+#include "em_timer.h"
+
+#include "fake_rtc.h"
+
+
+#define COUNTER_MASK 0x00ffffffULL
+
+
+/* Defined in delay.c */
+void RTC_IRQHandler (void);
+
+
+uint32_t FAKE_sleeps = 0;
+
+static uint64_t ticks = 0;
+static uint32_t compare0 = 0;
+static uint32_t flags = 0;
+static uint32_t enabled = 0;
+static uint32_t masked = 0;
+
+static SysTick_Type sysTick;
+SysTick_Type *SysTick = &sysTick;
+
+static TIMER_TypeDef timer1;
+TIMER_TypeDef *TIMER1 = &timer1;
+
+
+/* Call the interrupt handler while an enabled interrupt is pending */
+static void service (void)
+{
+	uint32_t calls = 0;
+
+	while (!masked && (flags & enabled))
+	{
+		if (++calls > 1000)
+		{
+			fprintf(stderr, "RTC interrupt keeps firing\n");
+			exit(2);
+		}
+
+		masked = 1;
+		RTC_IRQHandler();
+		masked = 0;
+	}
+}
+
+
+/* Tick count of the next overflow or compare match */
+static uint64_t nextEvent (void)
+{
+	uint64_t overflow = (ticks | COUNTER_MASK) + 1;
+	uint64_t match = (ticks & ~COUNTER_MASK) | compare0;
+
+	if (match <= ticks) match += COUNTER_MASK + 1;
+
+	return ((match < overflow) ? match : overflow);
+}
+
+
+/* Move to a tick count, at most up to the next event */
+static void moveTo (uint64_t to)
+{
+	ticks = to;
+
+	if ((ticks & COUNTER_MASK) == 0) flags |= RTC_IF_OF;
+	if ((ticks & COUNTER_MASK) == compare0) flags |= RTC_IF_COMP0;
+}
+
+
+/* Sleep until an enabled interrupt is pending */
+static void sleep (void)
+{
+	FAKE_sleeps++;
+
+	while (!(flags & enabled)) moveTo(nextEvent());
+}
+
+
+void FAKE_reset (uint64_t start)
+{
+	ticks = start;
+	compare0 = 0;
+	flags = 0;
+	enabled = 0;
+	masked = 0;
+	FAKE_sleeps = 0;
+}
+
+uint64_t FAKE_getTicks (void)
+{
+	return (ticks);
+}
+
+void FAKE_run (uint64_t amount)
+{
+	uint64_t end = ticks + amount;
+
+	while (nextEvent() <= end)
+	{
+		moveTo(nextEvent());
+		service();
+	}
+
+	ticks = end;
+}
+
+bool FAKE_compareEnabled (void)
+{
+	return ((enabled & RTC_IEN_COMP0) != 0);
+}
+
+uint32_t FAKE_compareValue (void)
+{
+	return (compare0);
+}
+
+
+/* em_core.h */
+uint32_t FAKE_enterAtomic (void)
+{
+	uint32_t state = masked;
+	masked = 1;
+	return (state);
+}
+
+void FAKE_exitAtomic (uint32_t state)
+{
+	masked = state;
+	service();
+}
+
+
+/* em_rtc.h */
+void RTC_Init (const RTC_Init_TypeDef *init) { (void) init; }
+void RTC_CompareSet (unsigned int comp, uint32_t value) { if (comp == 0) compare0 = value & COUNTER_MASK; }
+uint32_t RTC_CounterGet (void) { return (ticks & COUNTER_MASK); }
+void RTC_IntEnable (uint32_t mask) { enabled |= mask; }
+void RTC_IntDisable (uint32_t mask) { enabled &= ~mask; }
+void RTC_IntClear (uint32_t mask) { flags &= ~mask; }
+void RTC_IntSet (uint32_t mask) { flags |= mask; }
+uint32_t RTC_IntGet (void) { return (flags); }
+uint32_t RTC_IntGetEnabled (void) { return (flags & enabled); }
+
+
+/* em_emu.h */
+void EMU_EnterEM1 (void) { sleep(); }
+void EMU_EnterEM2 (bool restore) { (void) restore; sleep(); }
+void EMU_EnterEM3 (bool restore) { (void) restore; sleep(); }
+
+
+/* em_cmu.h */
+void CMU_ClockEnable (CMU_Clock_TypeDef clock, bool enable) { (void) clock; (void) enable; }
+void CMU_ClockSelectSet (CMU_Clock_TypeDef clock, CMU_Select_TypeDef ref) { (void) clock; (void) ref; }
+void CMU_OscillatorEnable (CMU_Osc_TypeDef osc, bool enable, bool wait) { (void) osc; (void) enable; (void) wait; }
+uint32_t CMU_ClockFreqGet (CMU_Clock_TypeDef clock) { (void) clock; return (14000000); }
+
+
+/* em_device.h */
+void NVIC_EnableIRQ (IRQn_Type irq) { (void) irq; }
+void NVIC_DisableIRQ (IRQn_Type irq) { (void) irq; }
+void NVIC_ClearPendingIRQ (IRQn_Type irq) { (void) irq; }
+
+
+/* em_timer.h (EM1 delays aren't tested) */
+void TIMER_Init (TIMER_TypeDef *timer, const TIMER_Init_TypeDef *init) { (void) timer; (void) init; }
+void TIMER_Enable (TIMER_TypeDef *timer, bool enable) { (void) timer; (void) enable; }
+void TIMER_TopSet (TIMER_TypeDef *timer, uint32_t value) { timer->TOP = value; }
+void TIMER_CounterSet (TIMER_TypeDef *timer, uint32_t value) { timer->CNT = value; }
+uint32_t TIMER_CounterGet (TIMER_TypeDef *timer) { return (timer->CNT); }
+void TIMER_IntClear (TIMER_TypeDef *timer, uint32_t mask) { (void) timer; (void) mask; }
+void TIMER_IntEnable (TIMER_TypeDef *timer, uint32_t mask) { (void) timer; (void) mask; }
+void TIMER_IntDisable (TIMER_TypeDef *timer, uint32_t mask) { (void) timer; (void) mask; }
@@ -0,0 +1,46 @@
+/***************************************************************************//**
+ * @file fake_rtc.h
+ * @brief Fake RTC, interrupt mask and sleep modes for the host tests.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#ifndef _FAKE_RTC_H_
+#define _FAKE_RTC_H_
+
+
+#include <stdint.h>  /* (u)intXX_t */
+#include <stdbool.h> /* "bool", "true", "false" */
+
+
+/** Amount of times `EMU_EnterEMx` was called */
+extern uint32_t FAKE_sleeps;
+
+
+void FAKE_reset (uint64_t ticks);
+uint64_t FAKE_getTicks (void);
+void FAKE_run (uint64_t ticks);
+bool FAKE_compareEnabled (void);
+uint32_t FAKE_compareValue (void);
+
+
+#endif /* _FAKE_RTC_H_ */
@@ -0,0 +1,7 @@
+/* Host stand-in for debug_dbprint.h: the tests don't print over UART. */
+#ifndef _DEBUG_DBPRINT_H_
+#define _DEBUG_DBPRINT_H_
+
+#define DEBUG_DBPRINT 0
+
+#endif /* _DEBUG_DBPRINT_H_ */
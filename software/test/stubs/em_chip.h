@@ -0,0 +1,7 @@
+/* Host stand-in for em_chip.h. */
+#ifndef _EM_CHIP_H_
+#define _EM_CHIP_H_
+
+#include "em_device.h"
+
+#endif /* _EM_CHIP_H_ */
@@ -0,0 +1,16 @@
+/* Host stand-in for em_cmu.h. */
+#ifndef _EM_CMU_H_
+#define _EM_CMU_H_
+
+#include "em_device.h"
+
+typedef enum { cmuClock_CORE, cmuClock_HFLE, cmuClock_LFA, cmuClock_RTC, cmuClock_TIMER1, cmuClock_HFPER } CMU_Clock_TypeDef;
+typedef enum { cmuOsc_LFXO, cmuOsc_ULFRCO } CMU_Osc_TypeDef;
+typedef enum { cmuSelect_LFXO, cmuSelect_ULFRCO } CMU_Select_TypeDef;
+
+void CMU_ClockEnable (CMU_Clock_TypeDef clock, bool enable);
+void CMU_ClockSelectSet (CMU_Clock_TypeDef clock, CMU_Select_TypeDef ref);
+void CMU_OscillatorEnable (CMU_Osc_TypeDef osc, bool enable, bool wait);
+uint32_t CMU_ClockFreqGet (CMU_Clock_TypeDef clock);
+
+#endif /* _EM_CMU_H_ */
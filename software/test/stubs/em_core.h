@@ -0,0 +1,17 @@
+/* Host stand-in for em_core.h: the fake interrupt mask is kept in fake.c,
+ * pending interrupts are handled when it's lifted (like on the MCU). */
+#ifndef _EM_CORE_H_
+#define _EM_CORE_H_
+
+#include <stdint.h>
+
+uint32_t FAKE_enterAtomic (void);
+void FAKE_exitAtomic (uint32_t state);
+
+#define CORE_DECLARE_IRQ_STATE uint32_t irqState
+#define CORE_ENTER_ATOMIC()    irqState = FAKE_enterAtomic()
+#define CORE_EXIT_ATOMIC()     FAKE_exitAtomic(irqState)
+#define CORE_ENTER_CRITICAL()  CORE_ENTER_ATOMIC()
+#define CORE_EXIT_CRITICAL()   CORE_EXIT_ATOMIC()
+
+#endif /* _EM_CORE_H_ */
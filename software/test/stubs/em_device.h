@@ -0,0 +1,33 @@
+/* Host stand-in for the device header, only what the tested files use. */
+#ifndef _EM_DEVICE_H_
+#define _EM_DEVICE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum { RTC_IRQn, TIMER1_IRQn, LEUART0_IRQn } IRQn_Type;
+
+void NVIC_EnableIRQ (IRQn_Type irq);
+void NVIC_DisableIRQ (IRQn_Type irq);
+void NVIC_ClearPendingIRQ (IRQn_Type irq);
+
+typedef struct { volatile uint32_t CTRL, LOAD, VAL; } SysTick_Type;
+extern SysTick_Type *SysTick;
+#define SysTick_CTRL_ENABLE_Msk    1
+#define SysTick_CTRL_CLKSOURCE_Msk 4
+
+#define RTC_IF_OF     1
+#define RTC_IF_COMP0  2
+#define RTC_IEN_OF    RTC_IF_OF
+#define RTC_IEN_COMP0 RTC_IF_COMP0
+#define RTC_IFC_OF    RTC_IF_OF
+#define RTC_IFC_COMP0 RTC_IF_COMP0
+#define RTC_IFS_COMP0 RTC_IF_COMP0
+
+typedef struct { volatile uint32_t CNT, TOP; } TIMER_TypeDef;
+extern TIMER_TypeDef *TIMER1;
+#define TIMER_IF_OF  1
+#define TIMER_IEN_OF TIMER_IF_OF
+
+#endif /* _EM_DEVICE_H_ */
@@ -0,0 +1,12 @@
+/* Host stand-in for em_emu.h: sleeping lets the fake time run until an
+ * enabled interrupt is pending. */
+#ifndef _EM_EMU_H_
+#define _EM_EMU_H_
+
+#include "em_device.h"
+
+void EMU_EnterEM1 (void);
+void EMU_EnterEM2 (bool restore);
+void EMU_EnterEM3 (bool restore);
+
+#endif /* _EM_EMU_H_ */
@@ -0,0 +1,14 @@
+/* Host stand-in for em_gpio.h. */
+#ifndef _EM_GPIO_H_
+#define _EM_GPIO_H_
+
+#include "em_device.h"
+
+typedef enum { gpioPortA, gpioPortB, gpioPortC, gpioPortD, gpioPortE, gpioPortF } GPIO_Port_TypeDef;
+typedef enum { gpioModeDisabled, gpioModeInput, gpioModeInputPull, gpioModePushPull } GPIO_Mode_TypeDef;
+
+void GPIO_PinModeSet (GPIO_Port_TypeDef port, unsigned int pin, GPIO_Mode_TypeDef mode, unsigned int out);
+void GPIO_PinOutSet (GPIO_Port_TypeDef port, unsigned int pin);
+void GPIO_PinOutClear (GPIO_Port_TypeDef port, unsigned int pin);
+
+#endif /* _EM_GPIO_H_ */
@@ -0,0 +1,7 @@
+/* Host stand-in for em_leuart.h. */
+#ifndef _EM_LEUART_H_
+#define _EM_LEUART_H_
+
+#include "em_device.h"
+
+#endif /* _EM_LEUART_H_ */
@@ -0,0 +1,20 @@
+/* Host stand-in for em_rtc.h, the registers are modelled in fake.c. */
+#ifndef _EM_RTC_H_
+#define _EM_RTC_H_
+
+#include "em_device.h"
+
+typedef struct { bool enable; bool debugRun; bool comp0Top; } RTC_Init_TypeDef;
+#define RTC_INIT_DEFAULT { true, false, true }
+
+void RTC_Init (const RTC_Init_TypeDef *init);
+void RTC_CompareSet (unsigned int comp, uint32_t value);
+uint32_t RTC_CounterGet (void);
+void RTC_IntEnable (uint32_t flags);
+void RTC_IntDisable (uint32_t flags);
+void RTC_IntClear (uint32_t flags);
+void RTC_IntSet (uint32_t flags);
+uint32_t RTC_IntGet (void);
+uint32_t RTC_IntGetEnabled (void);
+
+#endif /* _EM_RTC_H_ */
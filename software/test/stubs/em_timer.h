@@ -0,0 +1,20 @@
+/* Host stand-in for em_timer.h (EM1 delays aren't tested). */
+#ifndef _EM_TIMER_H_
+#define _EM_TIMER_H_
+
+#include "em_device.h"
+
+typedef enum { timerPrescale1, timerPrescale16 } TIMER_Prescale_TypeDef;
+typedef struct { bool enable; TIMER_Prescale_TypeDef prescale; } TIMER_Init_TypeDef;
+#define TIMER_INIT_DEFAULT { true, timerPrescale1 }
+
+void TIMER_Init (TIMER_TypeDef *timer, const TIMER_Init_TypeDef *init);
+void TIMER_Enable (TIMER_TypeDef *timer, bool enable);
+void TIMER_TopSet (TIMER_TypeDef *timer, uint32_t value);
+void TIMER_CounterSet (TIMER_TypeDef *timer, uint32_t value);
+uint32_t TIMER_CounterGet (TIMER_TypeDef *timer);
+void TIMER_IntClear (TIMER_TypeDef *timer, uint32_t flags);
+void TIMER_IntEnable (TIMER_TypeDef *timer, uint32_t flags);
+void TIMER_IntDisable (TIMER_TypeDef *timer, uint32_t flags);
+
+#endif /* _EM_TIMER_H_ */
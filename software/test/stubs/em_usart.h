@@ -0,0 +1,7 @@
+/* Host stand-in for em_usart.h. */
+#ifndef _EM_USART_H_
+#define _EM_USART_H_
+
+#include "em_device.h"
+
+#endif /* _EM_USART_H_ */
@@ -0,0 +1,78 @@
+/***************************************************************************//**
+ * @file test.h
+ * @brief Checks and reporting shared by the host tests.
+ *
+ * @details
+ *   Each test is one translation unit which includes the firmware file it
+ *   tests, so this header defines its counter as `static`. A failing `CHECK`
+ *   prints its location and the test continues, `TEST_report` gives the
+ *   exit status of `main`.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+
+#include <stdint.h> /* (u)intXX_t */
+#include <stdio.h>  /* printf */
+#include <string.h> /* strcmp, strlen (the firmware files get them through the SDK headers) */
+
+
+/** Amount of failed checks */
+static uint32_t testFailures = 0;
+
+
+/** Check a condition, print its location if it doesn't hold */
+#define CHECK(condition) do {                                                    \
+		if (!(condition)) {                                                      \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			testFailures++;                                                      \
+		}                                                                        \
+	} while (0)
+
+
+/**************************************************************************//**
+ * @brief
+ *   Print the result of a test.
+ *
+ * @param[in] name
+ *   The name of the test.
+ *
+ * @return
+ *   The exit status for `main` (`0` if all of the checks passed).
+ *****************************************************************************/
+static int TEST_report (const char *name)
+{
+	if (testFailures != 0)
+	{
+		printf("%s: %u check(s) failed\n", name, testFailures);
+		return (1);
+	}
+
+	printf("%s: OK\n", name);
+	return (0);
+}
+
+
+#endif /* _TEST_H_ */
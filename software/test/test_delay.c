@@ -0,0 +1,321 @@
+/***************************************************************************//**
+ * @file test_delay.c
+ * @brief Host test of the software timers in `delay.c`.
+ *
+ * @details
+ *   `delay.c` is included so its static methods and variables can be used.
+ *   The RTC is the fake one in `fake_rtc.c`, with `ULFRCO` selected one tick
+ *   is one millisecond. Run with `make` in this directory.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#include "test.h"
+
+#include "../EFM32HG-Embedded2-project/src/delay.c"
+#include "fake_rtc.h"
+
+
+/* Fakes of the other project files */
+static uint8_t lastError = 0;
+static uint32_t feeds = 0;
+static uint16_t eventCount = 0;
+
+void error (uint8_t number) { lastError = number; }
+void feedWatchdog (void) { feeds++; }
+void EVENT_push (Event_Source_t source, uint32_t payload) { (void) source; (void) payload; eventCount++; }
+uint16_t EVENT_getCount (void) { return (eventCount); }
+void PM_ClockRequest (PM_Clock_t clock) { (void) clock; }
+void PM_ClockRelease (PM_Clock_t clock) { (void) clock; }
+
+
+/* Order and time of the callbacks */
+static char order[16];
+static uint32_t times[16];
+static uint8_t calls = 0;
+
+static void expired (char name)
+{
+	if (calls < (sizeof(times) / sizeof(times[0]))) {
+		order[calls] = name;
+		times[calls] = RTC_getTicks();
+		calls++;
+		order[calls] = '\0';
+	}
+}
+
+static void expiredA (void) { expired('A'); }
+static void expiredB (void) { expired('B'); }
+static void expiredC (void) { expired('C'); }
+static void expiredD (void) { expired('D'); }
+
+static Timer_t a, b, c, d;
+
+
+/* Start from a clean state with the RTC at a certain (64-bit) tick count */
+static void start (uint64_t ticks)
+{
+	FAKE_reset(ticks);
+
+	RTC_initialized = false;
+	RTC_overflows = (uint32_t)(ticks >> 24);
+	timerQueue = NULL;
+	rtcFrequency = RTC_FREQ * 1000;
+
+	Timer_t idle = {0};
+	a = b = c = d = idle;
+
+	lastError = 0;
+	feeds = 0;
+	calls = 0;
+	order[0] = '\0';
+
+	RTC_getTicks(); /* Initializes the RTC */
+}
+
+
+static void testOrdering (void)
+{
+	start(1000);
+
+	TIMER_start(&a, 300, false, expiredA);
+	TIMER_start(&b, 100, false, expiredB);
+	TIMER_start(&c, 200, false, expiredC);
+	TIMER_start(&d, 200, false, expiredD); /* Same deadline: after C */
+
+	CHECK(timerQueue == &b);
+	CHECK(b.next == &c);
+	CHECK(c.next == &d);
+	CHECK(d.next == &a);
+	CHECK(a.next == NULL);
+	CHECK(FAKE_compareEnabled() && (FAKE_compareValue() == 1100));
+
+	FAKE_run(1000);
+
+	CHECK(strcmp(order, "BCDA") == 0);
+	CHECK((times[0] == 1100) && (times[1] == 1200) && (times[2] == 1200) && (times[3] == 1300));
+	CHECK(a.expired && b.expired && c.expired && d.expired);
+	CHECK(!a.running && !b.running && !c.running && !d.running);
+	CHECK(timerQueue == NULL);
+	CHECK(!FAKE_compareEnabled());
+}
+
+
+static void testStopRestart (void)
+{
+	start(0);
+
+	TIMER_start(&a, 100, false, expiredA);
+	TIMER_start(&b, 200, false, expiredB);
+	TIMER_start(&c, 300, false, expiredC);
+
+	TIMER_stop(&b);
+	CHECK(!b.running && (timerQueue == &a) && (a.next == &c));
+
+	TIMER_stop(&b); /* Not running anymore: nothing happens */
+	CHECK((timerQueue == &a) && (a.next == &c) && (c.next == NULL));
+
+	TIMER_start(&a, 400, false, expiredA); /* Restart moves it to the back */
+	CHECK((timerQueue == &c) && (c.next == &a) && (a.next == NULL));
+	CHECK(FAKE_compareValue() == 300);
+
+	TIMER_stop(&c); /* The head: compare channel follows */
+	CHECK((timerQueue == &a) && (FAKE_compareValue() == 400));
+
+	FAKE_run(500);
+
+	CHECK(strcmp(order, "A") == 0);
+	CHECK(times[0] == 400);
+	CHECK(!b.expired && !c.expired);
+}
+
+
+static void testPeriodic (void)
+{
+	start(0);
+
+	TIMER_start(&a, 250, true, expiredA);
+	TIMER_start(&b, 600, false, expiredB);
+
+	FAKE_run(1000);
+
+	CHECK(strcmp(order, "AABAA") == 0);
+	CHECK((times[0] == 250) && (times[1] == 500) && (times[2] == 600) && (times[3] == 750) && (times[4] == 1000));
+	CHECK(a.running && (a.deadline == 1250));
+
+	/* Handled late (interrupts masked): the missed periods are caught up without drifting */
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	FAKE_run(600);
+	CHECK(calls == 5);
+	CORE_EXIT_ATOMIC();
+
+	CHECK(strcmp(order, "AABAAAA") == 0);
+	CHECK((times[5] == 1600) && (times[6] == 1600));
+	CHECK(a.running && (a.deadline == 1750));
+	CHECK(FAKE_compareValue() == 1750);
+
+	TIMER_stop(&a);
+	CHECK(!a.running && (timerQueue == NULL));
+
+	FAKE_run(1000);
+	CHECK(calls == 7);
+}
+
+
+static void testCounterWrap (void)
+{
+	/* The 24-bit counter overflows before the deadline */
+	start(0x00fffff0);
+
+	TIMER_start(&a, 100, false, expiredA);
+
+	CHECK(a.deadline == 0x01000054);
+	CHECK(FAKE_compareEnabled() && (FAKE_compareValue() == 0x54));
+
+	FAKE_run(99);
+	CHECK(!a.expired && (RTC_overflows == 1));
+
+	FAKE_run(1);
+	CHECK(a.expired && (times[0] == 0x01000054));
+
+	/* Further away than the compare channel reaches: programmed after overflows */
+	start(5);
+
+	TIMER_start(&a, 0x01800000, false, expiredA);
+	CHECK(!FAKE_compareEnabled());
+
+	FAKE_run(0x01800000 - 1);
+	CHECK(!a.expired && FAKE_compareEnabled() && (FAKE_compareValue() == 0x00800005));
+
+	FAKE_run(1);
+	CHECK(a.expired && (times[0] == 0x01800005));
+}
+
+
+static void testTimebaseWrap (void)
+{
+	/* The 32-bit timebase wraps between the two deadlines */
+	start(0xfffffff0ULL);
+	CHECK(RTC_getTicks() == 0xfffffff0);
+
+	TIMER_start(&a, 100, false, expiredA);
+	TIMER_start(&b, 10, false, expiredB);
+
+	CHECK(a.deadline == 0x54);
+	CHECK((timerQueue == &b) && (b.next == &a));
+
+	FAKE_run(200);
+
+	CHECK(strcmp(order, "BA") == 0);
+	CHECK((times[0] == 0xfffffffa) && (times[1] == 0x54));
+	CHECK((FAKE_getTicks() >> 24) == RTC_overflows);
+}
+
+
+static void testMaxTicks (void)
+{
+	start(123);
+
+	/* Too long: refused */
+	TIMER_start(&a, TIMER_MAX_TICKS + 1U, false, expiredA);
+	CHECK((lastError == 14) && !a.running && (timerQueue == NULL));
+
+	/* The longest timer still gets sorted and fires on time */
+	lastError = 0;
+	TIMER_start(&a, TIMER_MAX_TICKS, false, expiredA);
+	TIMER_start(&b, 10, false, expiredB);
+	CHECK((lastError == 0) && (timerQueue == &b) && (b.next == &a));
+
+	FAKE_run(TIMER_MAX_TICKS - 1);
+	CHECK(b.expired && !a.expired);
+
+	FAKE_run(1);
+	CHECK(strcmp(order, "BA") == 0);
+	CHECK(times[1] == 123U + TIMER_MAX_TICKS);
+
+	/* The delays and sleeps refuse it too, without waiting */
+	uint32_t now = RTC_getTicks();
+
+	delay(TIMER_MAX_TICKS + 1U);
+	CHECK((lastError == 14) && (RTC_getTicks() == now));
+
+	sleep((TIMER_MAX_TICKS / 1000) + 1);
+	CHECK((lastError == 16) && (RTC_getTicks() == now));
+	CHECK(timerQueue == NULL);
+}
+
+
+static void testPendingOverflow (void)
+{
+	start(0x00fffffe);
+
+	/* The interrupt handler can't run yet, the overflow is still counted */
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	FAKE_run(4);
+	CHECK(RTC_overflows == 0);
+	CHECK(RTC_getTicks() == 0x01000002);
+	CORE_EXIT_ATOMIC();
+
+	CHECK(RTC_overflows == 1);
+	CHECK(RTC_getTicks() == 0x01000002);
+}
+
+
+static void testWaiting (void)
+{
+	DelayStats_t stats;
+
+	start(0x00ffff00);
+
+	DELAY_clearStats();
+	delay(500);
+	CHECK(RTC_getTicks() == 0x00ffff00 + 500);
+	CHECK(!delayTimer.running && (timerQueue == NULL));
+
+	DELAY_getStats(DELAY_RTC, &stats);
+	CHECK((stats.calls == 1) && (stats.usLate == 0));
+
+	/* A long sleep keeps feeding the watchdog and adds an event */
+	uint16_t events = EVENT_getCount();
+	sleep(200);
+	CHECK(RTC_getTicks() == 0x00ffff00 + 500 + 200000);
+	CHECK(EVENT_getCount() == events + 1);
+	CHECK(feeds >= 1 + (200 / WDOG_FEED_S));
+	CHECK(timerQueue == NULL);
+}
+
+
+int main (void)
+{
+	testOrdering();
+	testStopRestart();
+	testPeriodic();
+	testCounterWrap();
+	testTimebaseWrap();
+	testMaxTicks();
+	testPendingOverflow();
+	testWaiting();
+
+	return (TEST_report("test_delay"));
+}
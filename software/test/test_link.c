@@ -0,0 +1,245 @@
+/***************************************************************************//**
+ * @file test_link.c
+ * @brief Host test of the link manager in `link.c`.
+ *
+ * @details
+ *   `link.c` is included so its static methods and variables can be used.
+ *   The LoRa functions and the settings in the user data page are faked, the
+ *   test decides when an uplink is sent and when a Link Check answer is
+ *   available. Run with `make` in this directory.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#include "test.h"
+
+#include "../EFM32HG-Embedded2-project/src/link.c"
+
+
+/* 1 dB in the unit of the estimate */
+#define DB(x) ((int32_t)((x) * LINK_SCALE))
+
+
+/* Settings in the user data page and the uplink count */
+static Settings_t settings;
+static uint16_t uplinks = 0;
+
+/* The modem's Link Check state */
+static uint16_t interval = 0;
+static bool answerPending = false;
+static LoRaLink_t answer;
+static uint8_t linkChecksRead = 0;
+
+static uint8_t lastError = 0;
+
+
+/* Fakes of the LoRa functions and the settings */
+const Settings_t * CONFIG_get (void) { return (&settings); }
+
+void CONFIG_setLink (uint8_t dataRate, uint8_t txPower)
+{
+	settings.dataRate = dataRate;
+	settings.txPower = txPower;
+}
+
+void LoRa_GetAirtime (LoRaAirtime_t * stats)
+{
+	LoRaAirtime_t airtime = {0};
+	airtime.uplinks = uplinks;
+	*stats = airtime;
+}
+
+bool LoRa_GetLinkCheck (LoRaLink_t * link)
+{
+	linkChecksRead++;
+	if (!answerPending) return (false);
+
+	answerPending = false;
+	*link = answer;
+	return (true);
+}
+
+LoRaStatus_t LoRa_SetLinkCheck (uint16_t seconds) { interval = seconds; return (SUCCESS); }
+LoRaStatus_t LoRa_SetDataRate (LoRaDataRate_t dataRate) { (void) dataRate; return (SUCCESS); }
+LoRaStatus_t LoRa_SetPower (uint8_t power) { (void) power; return (SUCCESS); }
+LoRaDataRate_t LoRa_GetDataRate (void) { return ((LoRaDataRate_t) settings.dataRate); }
+void error (uint8_t number) { lastError = number; }
+
+
+/* No estimate and no requests, with a certain setting */
+static void start (uint8_t dataRate, uint8_t power)
+{
+	settings.dataRate = dataRate;
+	settings.txPower = power;
+
+	uplinks = 0;
+	lastUplinks = 0;
+	estimated = false;
+	requesting = false;
+	uplinksSince = 0;
+
+	interval = 0;
+	answerPending = false;
+	linkChecksRead = 0;
+	lastError = 0;
+}
+
+/* Some uplinks were sent during a wake-up, optionally with an answer to a request */
+static void wakeUp (uint16_t count, int16_t margin)
+{
+	uplinks += count;
+
+	if (margin >= 0)
+	{
+		answer.margin = margin;
+		answer.gateways = 1;
+		answer.snr = 0;
+		answerPending = true;
+	}
+
+	LINK_update();
+}
+
+
+static void testPredict (void)
+{
+	/* Normalised to a 0 dBm uplink with a 0 dB required SNR */
+	estimate = DB(-2);
+
+	CHECK(predictMargin(SF12_BW125, 1) == DB(-2 + 14 + 20));
+	CHECK(predictMargin(SF12_BW125, 5) == DB(-2 + 2 + 20));
+	CHECK(predictMargin(SF10_BW125, 2) == DB(-2 + 11 + 15));
+	CHECK(predictMargin(SF7_BW125, 3) == DB(-2 + 8 + 7.5));
+}
+
+
+static void testChoose (void)
+{
+	uint8_t dataRate, power;
+
+	/* SF9 at 14 dBm: 17.5 dB, the cheaper settings don't reach 13 + 3 dB */
+	estimate = DB(-9);
+	dataRate = SF12_BW125;
+	power = 1;
+	chooseSetting(&dataRate, &power);
+	CHECK((dataRate == SF9_BW125) && (power == 1));
+
+	/* SF9 at 11 dBm: 14 dB is enough to stay, not enough to go there */
+	estimate = DB(-9.5);
+	dataRate = SF9_BW125;
+	power = 1;
+	chooseSetting(&dataRate, &power);
+	CHECK((dataRate == SF9_BW125) && (power == 1));
+
+	dataRate = SF9_BW125;
+	power = 2;
+	chooseSetting(&dataRate, &power);
+	CHECK((dataRate == SF9_BW125) && (power == 2));
+
+	/* A more robust setting is used without hysteresis: SF9 at 14 dBm gives 14.5 dB */
+	estimate = DB(-12);
+	chooseSetting(&dataRate, &power);
+	CHECK((dataRate == SF9_BW125) && (power == 1));
+
+	/* Nothing is good enough: the most robust setting */
+	estimate = DB(-30);
+	dataRate = SF7_BW125;
+	power = 5;
+	chooseSetting(&dataRate, &power);
+	CHECK((dataRate == SF12_BW125) && (power == LINK_POWER_MAX));
+}
+
+
+static void testSamples (void)
+{
+	start(SF10_BW125, 1);
+
+	/* No estimate yet: the first uplinks start the requests */
+	wakeUp(1, -1);
+	CHECK(requesting && (interval == LINK_CHECK_INTERVAL));
+	CHECK((checkDataRate == SF10_BW125) && (checkPower == 1));
+
+	/* 20 dB at SF10 (-15 dB) and 14 dBm, the requests stop after the answer */
+	wakeUp(1, 20);
+	CHECK(estimated && (estimate == DB(20 - 15 - 14)));
+	CHECK(!requesting && (interval == 0));
+	CHECK((settings.dataRate == SF9_BW125) && (settings.txPower == 1));
+
+	/* Downlinks without requests don't read the modem's last answer again */
+	linkChecksRead = 0;
+	wakeUp(1, 20);
+	CHECK((linkChecksRead == 0) && (estimate == DB(20 - 15 - 14)));
+	CHECK((settings.dataRate == SF9_BW125) && (settings.txPower == 1));
+
+	/* The requests start again after LINK_CHECK_UPLINKS, with the new setting */
+	answerPending = false;
+	wakeUp(LINK_CHECK_UPLINKS - 2, -1);
+	CHECK(!requesting);
+	wakeUp(1, -1);
+	CHECK(requesting && (checkDataRate == SF9_BW125) && (checkPower == 1));
+
+	/* Each new answer weighs 1/LINK_WEIGHT */
+	wakeUp(1, 10);
+	CHECK(estimate == DB(-9) + ((DB(10 - 12.5 - 14) - DB(-9)) / LINK_WEIGHT));
+	CHECK(!requesting);
+}
+
+
+static void testFallback (void)
+{
+	start(SF9_BW125, 3);
+	estimate = DB(-2);
+	estimated = true;
+
+	wakeUp(LINK_CHECK_UPLINKS, -1);
+	CHECK(requesting && (checkPower == 3));
+
+	/* No answers: 14 dBm first */
+	wakeUp(LINK_LOST_UPLINKS - 1, -1);
+	CHECK((settings.dataRate == SF9_BW125) && (settings.txPower == 3));
+	wakeUp(1, -1);
+	CHECK((settings.dataRate == SF9_BW125) && (settings.txPower == LINK_POWER_MAX));
+
+	/* The requests restart, an answer is about the uplinks at 14 dBm */
+	CHECK(requesting && (checkDataRate == SF9_BW125) && (checkPower == LINK_POWER_MAX));
+
+	/* Still no answers: one SF step up */
+	wakeUp(LINK_LOST_UPLINKS, -1);
+	CHECK((settings.dataRate == SF10_BW125) && (settings.txPower == LINK_POWER_MAX));
+	CHECK(requesting && (checkDataRate == SF10_BW125));
+
+	/* 12 dB at SF10 and 14 dBm */
+	wakeUp(1, 12);
+	CHECK(estimate == DB(-2) + ((DB(12 - 15 - 14) - DB(-2)) / LINK_WEIGHT));
+	CHECK(!requesting && (lastError == 0));
+}
+
+
+int main (void)
+{
+	testPredict();
+	testChoose();
+	testSamples();
+	testFallback();
+
+	return (TEST_report("test_link"));
+}
@@ -0,0 +1,221 @@
+/***************************************************************************//**
+ * @file test_lora.c
+ * @brief Host test of the time-on-air and duty cycle logic in `lora.c`.
+ *
+ * @details
+ *   `lora.c` is included so its static methods and variables can be used.
+ *   The RN2483, the uptime and `delay` are faked, a delay moves the uptime
+ *   forward. Run with `make` in this directory.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#include "test.h"
+
+#include "../EFM32HG-Embedded2-project/lora/lora.c"
+
+
+/* Uptime in seconds and the requested delays */
+static uint32_t uptime = 0;
+static uint32_t delays = 0;
+static uint32_t lastDelay = 0;
+
+/* Statuses the fake modem answers uplinks with, and the uptime of each uplink */
+static const RN2483_Status_t * answers = NULL;
+static uint8_t answerCount = 0;
+static uint32_t sentAt[4];
+static uint8_t sent = 0;
+
+
+/* Fakes of the uptime, delay and RN2483 */
+uint32_t RTC_getUptime (void) { return (uptime); }
+
+void delay (uint32_t msDelay)
+{
+	delays++;
+	lastDelay = msDelay;
+	uptime += msDelay / 1000;
+}
+
+static RN2483_Status_t transmitted (void)
+{
+	if (sent < 4) sentAt[sent] = uptime;
+	sent++;
+
+	if (answerCount == 0) return (MAC_TX_OK);
+	answerCount--;
+	return (*answers++);
+}
+
+RN2483_Status_t RN2483_TransmitUnconfirmed (uint8_t * data, uint8_t payloadSize, char * receiveBuffer, uint8_t bufferSize) { (void) data; (void) payloadSize; (void) receiveBuffer; (void) bufferSize; return (transmitted()); }
+RN2483_Status_t RN2483_TransmitConfirmed (uint8_t * data, uint8_t payloadSize, char * receiveBuffer, uint8_t bufferSize) { (void) data; (void) payloadSize; (void) receiveBuffer; (void) bufferSize; return (transmitted()); }
+
+RN2483_Status_t RN2483_Setup (LoRaSettings_t settings, char * receiveBuffer, uint8_t bufferSize) { (void) settings; (void) receiveBuffer; (void) bufferSize; return (JOIN_ACCEPTED); }
+void RN2483_Init (void) { }
+RN2483_Status_t RN2483_Sleep (uint32_t sleepTime, volatile bool * wakeUp, char * receiveBuffer, uint8_t bufferSize) { (void) sleepTime; (void) wakeUp; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_Wake (char * receiveBuffer, uint8_t bufferSize) { (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_SetDataRate (uint8_t dr, char * receiveBuffer, uint8_t bufferSize) { (void) dr; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_GetDataRate (int8_t *dr, char * receiveBuffer, uint8_t bufferSize) { (void) dr; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_SetOutputPower (uint8_t pwr, char * receiveBuffer, uint8_t bufferSize) { (void) pwr; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_SetLinkCheck (uint16_t interval, char * receiveBuffer, uint8_t bufferSize) { (void) interval; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_GetMargin (uint8_t * margin, char * receiveBuffer, uint8_t bufferSize) { (void) margin; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_GetGateways (uint8_t * gateways, char * receiveBuffer, uint8_t bufferSize) { (void) gateways; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_GetDownlinkCounter (uint32_t * counter, char * receiveBuffer, uint8_t bufferSize) { (void) counter; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+RN2483_Status_t RN2483_GetSnr (int8_t * snr, char * receiveBuffer, uint8_t bufferSize) { (void) snr; (void) receiveBuffer; (void) bufferSize; return (MAC_OK); }
+bool RN2483_GetDownlink (LoRaDownlink_t * data) { (void) data; return (false); }
+void PM_Enable (PM_SubSystem_t pmss) { (void) pmss; }
+
+
+/* All channels free and no airtime at a certain uptime */
+static void start (uint32_t seconds)
+{
+	memset(channelFree, 0, sizeof(channelFree));
+	memset(&airtime, 0, sizeof(airtime));
+	uptime = seconds;
+	delays = 0;
+	lastDelay = 0;
+	answers = NULL;
+	answerCount = 0;
+	sent = 0;
+}
+
+
+static void testTimeOnAir (void)
+{
+	/* Semtech LoRa calculator (BW125, CR 4/5, explicit header, CRC, 8 preamble symbols), rounded up to whole ms */
+	CHECK(LoRa_TimeOnAir(SF7_BW125, 10) == 62);    /* 61.7 ms */
+	CHECK(LoRa_TimeOnAir(SF10_BW125, 10) == 371);  /* 370.7 ms */
+	CHECK(LoRa_TimeOnAir(SF12_BW125, 10) == 1483); /* 1482.8 ms */
+	CHECK(LoRa_TimeOnAir(SF12_BW125, 51) == 2794); /* 2793.5 ms */
+
+	/* The join request is a PHY payload of 23 bytes */
+	CHECK(timeOnAir(SF12_BW125, LORA_JOIN_REQUEST_SIZE) == LoRa_TimeOnAir(SF12_BW125, 10));
+}
+
+
+static void testChannels (void)
+{
+	start(1000);
+
+	CHECK(channelWait() == 0);
+
+	/* Each uplink takes the first free channel for 302 times its airtime (rounded up) */
+	accountUplink(1483);
+	CHECK((channelFree[0] == 1448) && (channelWait() == 0));
+
+	uptime = 1010;
+	accountUplink(1483);
+	CHECK((channelFree[1] == 1458) && (channelWait() == 0));
+
+	uptime = 1020;
+	accountUplink(1483);
+	CHECK(channelFree[2] == 1468);
+	CHECK(channelWait() == 428);
+
+	/* The channel which is free first is used again */
+	uptime = 1448;
+	CHECK(channelWait() == 0);
+
+	accountUplink(62); /* 18.7 s */
+	CHECK(channelFree[0] == 1448 + 19);
+	CHECK(channelWait() == 10);
+
+	CHECK((airtime.ms == (3 * 1483) + 62) && (airtime.uplinks == 4));
+	CHECK((airtime.deferred == 0) && (airtime.deferredSeconds == 0));
+}
+
+
+static void testDeferral (void)
+{
+	start(2000);
+
+	for (uint8_t i = 0; i < LORA_CHANNELS; i++) accountUplink(371);
+	CHECK(channelWait() == 113); /* 112.0 s rounded up */
+
+	waitForChannel();
+	CHECK((delays == 1) && (lastDelay == 113000) && (uptime == 2113));
+	CHECK((airtime.deferred == 1) && (airtime.deferredSeconds == 113));
+
+	/* No delay when a channel is free */
+	waitForChannel();
+	CHECK(delays == 1);
+}
+
+
+static void testTransmit (void)
+{
+	uint8_t data[10] = {0};
+	LPP_Buffer_t buffer = {data, sizeof(data), sizeof(data)};
+
+	joinSettings.dataRate = SF7_BW125;
+
+	/* The modem's counters are ahead: all channels are blocked once, then it's sent again */
+	static const RN2483_Status_t outOfSync[] = {NO_FREE_CH, MAC_TX_OK};
+
+	start(500);
+	answers = outOfSync;
+	answerCount = 2;
+
+	CHECK(LoRa_SendLppBuffer(buffer, !LORA_CONFIRMED) == SUCCESS);
+	CHECK((sent == 2) && (sentAt[0] == 500) && (sentAt[1] == 519));
+	CHECK((delays == 1) && (lastDelay == 19000));
+	CHECK((airtime.uplinks == 1) && (airtime.ms == 62) && (airtime.deferred == 1));
+	CHECK((channelFree[0] == 519 + 19) && (channelFree[1] == 519) && (channelFree[2] == 519));
+
+	/* A radio error still used the channel, a refused command didn't */
+	static const RN2483_Status_t macErr[] = {MAC_ERR};
+	static const RN2483_Status_t busy[] = {BUSY};
+
+	start(500);
+	answers = macErr;
+	answerCount = 1;
+
+	CHECK(LoRa_SendLppBuffer(buffer, !LORA_CONFIRMED) == ERROR);
+	CHECK((airtime.uplinks == 1) && (channelFree[0] == 519));
+
+	start(500);
+	answers = busy;
+	answerCount = 1;
+
+	CHECK(LoRa_SendLppBuffer(buffer, !LORA_CONFIRMED) == ERROR);
+	CHECK((sent == 1) && (airtime.uplinks == 0) && (channelFree[0] == 0));
+
+	/* Too long for the data rate: not sent at all */
+	joinSettings.dataRate = SF12_BW125;
+	uint8_t large[52] = {0};
+	LPP_Buffer_t tooLarge = {large, sizeof(large), sizeof(large)};
+
+	start(500);
+	CHECK(LoRa_SendLppBuffer(tooLarge, !LORA_CONFIRMED) == ERROR);
+	CHECK(sent == 0);
+}
+
+
+int main (void)
+{
+	testTimeOnAir();
+	testChannels();
+	testDeferral();
+	testTransmit();
+
+	return (TEST_report("test_lora"));
+}
@@ -0,0 +1,348 @@
+/***************************************************************************//**
+ * @file test_rn2483.c
+ * @brief Host test of the RN2483 command engine in `rn2483.c`.
+ *
+ * @details
+ *   `rn2483.c` is included so its static methods and variables can be used.
+ *   The LEUART and the timers are faked: the sent lines are recorded and the
+ *   test hands the module's response lines to the engine like the LEUART
+ *   interrupt handler does. Run with `make` in this directory.
+ *
+ * ******************************************************************************
+ *
+ * @section License
+ *
+ *   **Copyright (C) 2019 - Brecht Van Eeckhoudt**
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the **GNU General Public License** as published by
+ *   the Free Software Foundation, either **version 3** of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   *A copy of the GNU General Public License can be found in the `LICENSE`
+ *   file along with this source code.*
+ *
+ ******************************************************************************/
+
+
+#include "test.h"
+
+#include "../EFM32HG-Embedded2-project/lora/rn2483.c"
+
+
+/* Sent lines */
+#define SENT_MAX 8
+static char sent[SENT_MAX][RN2483_COMMANDBUFFER_SIZE];
+static uint8_t sentCount = 0;
+
+/* Line handed to the engine and the fake LEUART state */
+static const char * line = "";
+static void (*responseCallback)(void) = NULL;
+static uint8_t clears = 0;
+
+/* Lines the module answers with while RN2483_WaitCommands sleeps */
+static const char * const * script = NULL;
+static uint8_t scriptCount = 0;
+
+/* The engine timeout */
+static Timer_t * timeoutTimer = NULL;
+static uint32_t timeoutMs = 0;
+static void (*timeoutCallback)(void) = NULL;
+
+/* Lines and wait result of the synchronous commands (RN2483_ProcessMacCommand) */
+static const char * firstLine = "";
+static const char * secondLine = "";
+static Leuart_Status_t waitStatus = DATA_RECEIVED;
+
+/* Engine callback */
+static uint8_t finished = 0;
+static RN2483_Status_t finishedStatus;
+
+
+/* Fakes of the LEUART, delay and power management */
+void Leuart_SendAsync (char * buffer, uint8_t bufferLength)
+{
+	CHECK(strlen(buffer) == bufferLength);
+	if (sentCount < SENT_MAX) strcpy(sent[sentCount], buffer);
+	sentCount++;
+}
+
+const char * Leuart_GetResponse (void) { return (line); }
+void Leuart_SetResponseCallback (void (*callback)(void)) { responseCallback = callback; }
+void Leuart_ClearBuffers (void) { clears++; }
+
+void TIMER_start (Timer_t *timer, uint32_t msTime, bool periodic, void (*callback)(void))
+{
+	CHECK(!periodic);
+	timer->running = true;
+	timeoutTimer = timer;
+	timeoutMs = msTime;
+	timeoutCallback = callback;
+}
+
+void TIMER_stop (Timer_t *timer) { timer->running = false; }
+
+/* Sleep until the next line of the script arrives, or until the timeout if there are no lines left */
+bool Leuart_WaitForFlag (volatile bool * flag, uint32_t msTimeout)
+{
+	CHECK(msTimeout == ENGINE_TIMEOUT_SECOND_MS);
+
+	if (*flag) return (true);
+
+	if (scriptCount > 0)
+	{
+		line = *script++;
+		scriptCount--;
+		if (responseCallback != NULL) responseCallback();
+	}
+	else if ((timeoutTimer != NULL) && timeoutTimer->running)
+	{
+		timeoutTimer->running = false;
+		timeoutCallback();
+	}
+
+	return (*flag);
+}
+
+void Leuart_Init (void) { }
+void Leuart_Reinit (void) { }
+void Leuart_SendData (char * buffer, uint8_t bufferLength) { (void) buffer; (void) bufferLength; }
+Leuart_Status_t Leuart_SendCommand (char * cb, uint8_t cbl, volatile bool * wakeUp) { (void) cb; (void) cbl; (void) wakeUp; line = firstLine; return (DATA_SENT); }
+
+/* Without a complete line Leuart_GetResponse returns "" */
+Leuart_Status_t Leuart_WaitForResponse ()
+{
+	line = (waitStatus == RX_TIMEOUT) ? "" : secondLine;
+	return (waitStatus);
+}
+void GPIO_PinModeSet (GPIO_Port_TypeDef port, unsigned int pin, GPIO_Mode_TypeDef mode, unsigned int out) { (void) port; (void) pin; (void) mode; (void) out; }
+void PM_WaitReady (PM_SubSystem_t pmss) { (void) pmss; }
+void delay (uint32_t msDelay) { (void) msDelay; }
+
+
+/* The module answers with a line (LEUART interrupt) */
+static void respond (const char * response)
+{
+	line = response;
+	CHECK(responseCallback != NULL);
+	if (responseCallback != NULL) responseCallback();
+}
+
+static void done (RN2483_Status_t status)
+{
+	finished++;
+	finishedStatus = status;
+}
+
+static char receiveBuffer[RECEIVE_BUFFER_SIZE];
+
+static void run (const RN2483_Command_t * commands, uint8_t count)
+{
+	sentCount = 0;
+	finished = 0;
+	clears = 0;
+	timeoutTimer = NULL;
+	script = NULL;
+	scriptCount = 0;
+	downlinkPending = false;
+
+	RN2483_RunCommands(commands, count, receiveBuffer, sizeof(receiveBuffer), done);
+}
+
+/* The engine finished once with a status, cleaned up and doesn't take lines anymore */
+static bool finishedWith (RN2483_Status_t status)
+{
+	return ((finished == 1) && (finishedStatus == status) && RN2483_CommandsDone() && (responseCallback == NULL) && !engineTimeout.running);
+}
+
+
+static void testOrder (void)
+{
+	static const RN2483_Command_t commands[] = {
+		{"mac set adr", "off", MAC_OK},
+		{"mac set dr", "5", MAC_OK},
+		{"mac save", NULL, MAC_OK}
+	};
+
+	run(commands, 3);
+
+	CHECK((clears == 1) && !RN2483_CommandsDone());
+	CHECK((sentCount == 1) && (strcmp(sent[0], "mac set adr off\r\n") == 0));
+	CHECK(engineTimeout.running && (timeoutMs == ENGINE_TIMEOUT_MS));
+
+	respond("ok");
+	CHECK((sentCount == 2) && (strcmp(sent[1], "mac set dr 5\r\n") == 0));
+	CHECK(finished == 0);
+
+	respond("ok");
+	CHECK((sentCount == 3) && (strcmp(sent[2], "mac save\r\n") == 0));
+	CHECK(finished == 0);
+
+	respond("ok");
+	CHECK(sentCount == 3);
+	CHECK(finishedWith(MAC_OK));
+}
+
+
+static void testUnexpected (void)
+{
+	static const RN2483_Command_t commands[] = {
+		{"mac set adr", "off", MAC_OK},
+		{"mac set dr", "9", MAC_OK},
+		{"mac save", NULL, MAC_OK}
+	};
+
+	run(commands, 3);
+
+	respond("ok");
+	respond("invalid_param");
+
+	CHECK(sentCount == 2);
+	CHECK(finishedWith(INVALID_PARAM));
+
+	/* A command returning data: any other line is unexpected */
+	static const RN2483_Command_t get[] = {
+		{"sys get ver", NULL, DATA_RETURNED},
+		{"mac save", NULL, MAC_OK}
+	};
+
+	run(get, 2);
+
+	respond("RN2483 1.0.4 Oct 12 2017 14:59:25");
+	CHECK((sentCount == 2) && (strcmp(receiveBuffer, "RN2483 1.0.4 Oct 12 2017 14:59:25") == 0));
+
+	respond("busy");
+	CHECK(finishedWith(BUSY));
+}
+
+
+static void testSecondResponse (void)
+{
+	static const RN2483_Command_t commands[] = {
+		{"mac join", "otaa", JOIN_ACCEPTED},
+		{"mac tx", "uncnf 1 0102", MAC_TX_OK},
+		{"mac save", NULL, MAC_OK}
+	};
+
+	run(commands, 3);
+
+	/* The "ok" only moves the engine to the second response with a longer timeout */
+	respond("ok");
+	CHECK((sentCount == 1) && (finished == 0));
+	CHECK(engineTimeout.running && (timeoutMs == ENGINE_TIMEOUT_SECOND_MS));
+
+	respond("accepted");
+	CHECK((sentCount == 2) && (strcmp(sent[1], "mac tx uncnf 1 0102\r\n") == 0));
+	CHECK(timeoutMs == ENGINE_TIMEOUT_MS);
+
+	/* The second response is parsed with its own table ("invalid_data_len" exists in both) */
+	respond("ok");
+	respond("mac_tx_ok");
+	CHECK((sentCount == 3) && (strcmp(sent[2], "mac save\r\n") == 0));
+
+	respond("ok");
+	CHECK(finishedWith(MAC_OK));
+
+	/* A refused first response doesn't wait on a second one */
+	run(commands, 3);
+	respond("not_joined");
+	CHECK((sentCount == 1) && finishedWith(NOT_JOINED));
+
+	/* Unexpected second responses stop the engine */
+	run(commands, 3);
+	respond("ok");
+	respond("denied");
+	CHECK((sentCount == 1) && finishedWith(JOIN_DENIED));
+
+	run(&commands[1], 2);
+	respond("ok");
+	respond("mac_rx 2 0a0B");
+	CHECK((sentCount == 1) && finishedWith(MAC_RX));
+	CHECK(downlinkPending && (downlink.port == 2) && (downlink.length == 2) && (downlink.data[0] == 0x0a) && (downlink.data[1] == 0x0b));
+
+	run(&commands[1], 2);
+	respond("ok");
+	respond("xyz");
+	CHECK(finishedWith(UNKOWN_ERR));
+}
+
+
+static void testTimeout (void)
+{
+	static const RN2483_Command_t commands[] = {
+		{"mac join", "otaa", JOIN_ACCEPTED},
+		{"mac save", NULL, MAC_OK}
+	};
+
+	run(commands, 2);
+	respond("ok");
+
+	timeoutTimer->running = false;
+	timeoutCallback();
+	CHECK((sentCount == 1) && finishedWith(RN_RX_TIMEOUT));
+
+	/* Nothing happens without commands */
+	run(commands, 0);
+	CHECK((sentCount == 0) && (clears == 0) && finishedWith(MAC_OK));
+}
+
+
+static void testWait (void)
+{
+	static const RN2483_Command_t commands[] = {
+		{"mac join", "otaa", JOIN_ACCEPTED},
+		{"mac save", NULL, MAC_OK}
+	};
+	static const char * const answers[] = {"ok", "accepted", "ok"};
+
+	run(commands, 2);
+	script = answers;
+	scriptCount = 3;
+
+	CHECK(RN2483_WaitCommands() == MAC_OK);
+	CHECK((sentCount == 2) && (scriptCount == 0) && finishedWith(MAC_OK));
+
+	/* The module stops answering after the "ok" */
+	run(commands, 2);
+	script = answers;
+	scriptCount = 1;
+
+	CHECK(RN2483_WaitCommands() == RN_RX_TIMEOUT);
+	CHECK((sentCount == 1) && finishedWith(RN_RX_TIMEOUT));
+}
+
+
+static void testProcessMacCommand (void)
+{
+	strcpy(commandBuffer, "mac tx uncnf 1 0102\r\n");
+
+	firstLine = "ok";
+	secondLine = "mac_tx_ok";
+	waitStatus = DATA_RECEIVED;
+	CHECK(RN2483_ProcessMacCommand(receiveBuffer, sizeof(receiveBuffer), true) == MAC_TX_OK);
+
+	/* A timeout on the second response isn't parsed */
+	waitStatus = RX_TIMEOUT;
+	CHECK(RN2483_ProcessMacCommand(receiveBuffer, sizeof(receiveBuffer), true) == RN_RX_TIMEOUT);
+
+	firstLine = "no_free_ch";
+	CHECK(RN2483_ProcessMacCommand(receiveBuffer, sizeof(receiveBuffer), true) == NO_FREE_CH);
+}
+
+
+int main (void)
+{
+	testOrder();
+	testUnexpected();
+	testSecondResponse();
+	testTimeout();
+	testWait();
+	testProcessMacCommand();
+
+	return (TEST_report("test_rn2483"));
+}